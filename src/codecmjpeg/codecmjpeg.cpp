@@ -38,35 +38,41 @@ CodecMJPEG::~CodecMJPEG()
 
 }
 
-bool CodecMJPEG::Initialise(PluginMessageCallback pMessageCallback)
-{
-	m_pMessageCallback = pMessageCallback;
-	return true;
-}
-
 // Messages:
 // - stream_request: received when the user opens a camera.
 // - stream_request_accepted: sent if the codec is capable of handling the requested camera.
 // - stream_frame: sent when a frame has been written to the buffer.
 // - stream_stopped: stop streaming the requested camera.
-void CodecMJPEG::OnMessageReceived(const nlohmann::json& message)
+static constexpr MessageType cStreamRequestMessage = GetMessageType("stream_request");
+static constexpr MessageType cStreamStoppedMessage = GetMessageType("stream_stopped");
+
+bool CodecMJPEG::Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions)
+{
+	m_pMessageCallback = pMessageCallback;
+	subscriptions.Add(cStreamRequestMessage);
+	subscriptions.Add(cStreamStoppedMessage);
+	subscriptions.Add<UpdateMessage>();
+	return true;
+}
+
+void CodecMJPEG::OnMessage(const Message& message)
 {
-	std::string messageType = message["type"];
-	if (messageType == "stream_request")
+	if (message.GetType() == cStreamRequestMessage)
 	{
-		const json& url = message["url"];
-		const json& textureId = message["texture_id"];
+		const json& request = *message.GetJson();
+		const json& url = request["url"];
+		const json& textureId = request["texture_id"];
 		if (url.is_string() && textureId.is_number_unsigned())
 		{
 			ProcessStreamRequest(url.get<std::string>(), textureId.get<uint32_t>());
 		}
 	}
-	else if (messageType == "stream_stopped")
+	else if (message.GetType() == cStreamStoppedMessage)
 	{
-		const std::string& url = message["url"];
+		const std::string& url = (*message.GetJson())["url"];
 		m_Streams.remove_if([&url](const StreamMJPEGSharedPtr& pStream) { return pStream->GetUrl() == url; });
 	}
-	else if (messageType == "update")
+	else if (message.As<UpdateMessage>() != nullptr)
 	{
 		for (StreamMJPEGSharedPtr pStream : m_Streams)
 		{
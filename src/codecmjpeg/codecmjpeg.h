@@ -32,8 +32,8 @@ class CodecMJPEG : public Plugin
 public:
 	CodecMJPEG();
 	virtual ~CodecMJPEG();
-	virtual bool Initialise(PluginMessageCallback pMessageCallback) override;
-	virtual void OnMessageReceived(const nlohmann::json& message) override;
+	virtual bool Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions) override;
+	virtual void OnMessage(const Message& message) override;
 	virtual void DrawUI(ImGuiContext* pContext) override;
 
 private:
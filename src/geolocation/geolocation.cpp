@@ -49,20 +49,20 @@ Geolocation::~Geolocation()
 	}
 }
 
-bool Geolocation::Initialise( PluginMessageCallback pMessageCallback )
+bool Geolocation::Initialise( PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions )
 {
 	m_pMessageCallback = pMessageCallback;
+	subscriptions.Add< GeolocationRequestMessage >();
 	return true;
 }
 
-void Geolocation::OnMessageReceived( const nlohmann::json& message )
+void Geolocation::OnMessage( const Message& message )
 {
-	if ( message[ "type" ] == "geolocation_request" )
+	if ( const GeolocationRequestMessage* pRequest = message.As< GeolocationRequestMessage >() )
 	{
 		{
 			std::lock_guard< std::mutex > lock( m_AccessMutex );
-			std::string address = message[ "ip_address" ];
-			m_Queue.emplace_back( address );
+			m_Queue.emplace_back( pRequest->host, 0 );
 		}
 
 		ConsumeQueue();
@@ -136,61 +136,34 @@ void Geolocation::ConsumeQueue()
 
 			if ( curl_easy_perform( pCurlHandle ) != CURLE_OK )
 			{
-				json message = 
-				{
-					{ "type", "log" },
-					{ "level", "error" }, 
-					{ "plugin", "geolocation" },
-					{ "message", pErrorBuffer }
-				};
-				pGeolocation->m_pMessageCallback( message );
+				pGeolocation->m_pMessageCallback( LogMessage( LogMessage::Level::Error, "geolocation", pErrorBuffer ) );
+			}
+			else if ( pGeolocation->m_Data.find( "Rate limit exceeded." ) != std::string::npos )
+			{
+				pGeolocation->m_pMessageCallback( LogMessage( LogMessage::Level::Warning, "geolocation", "Rate limit exceeded." ) );
+				pGeolocation->m_RateLimitExceeded = true;
 			}
 			else
 			{
-				json message;
-				if ( pGeolocation->m_Data.find( "Rate limit exceeded." ) != std::string::npos )
+				json data = json::parse( pGeolocation->m_Data );
+				if ( data.find( "city" ) != data.end() && 
+					 data.find( "region" ) != data.end() &&
+					 data.find( "country" ) != data.end() &&
+					 data.find( "org" ) != data.end() &&
+					 data.find( "loc" ) != data.end() )
 				{
-					message =
-					{
-						{ "type", "log" },
-						{ "level", "warning" }, 
-						{ "plugin", "geolocation" },
-						{ "message", "Rate limit exceeded." }
-					};
-					pGeolocation->m_RateLimitExceeded = true;
+					pGeolocation->m_pMessageCallback( GeolocationResultMessage(
+						address.GetHost(),
+						GetJsonString( data, "city" ),
+						GetJsonString( data, "region" ),
+						GetJsonString( data, "country" ),
+						GetJsonString( data, "org" ),
+						GetJsonString( data, "loc" ) ) );
 				}
 				else
 				{
-					json data = json::parse( pGeolocation->m_Data );
-					if ( data.find( "city" ) != data.end() && 
-						 data.find( "region" ) != data.end() &&
-						 data.find( "country" ) != data.end() &&
-						 data.find( "org" ) != data.end() &&
-						 data.find( "loc" ) != data.end() )
-					{
-						message = 
-						{
-							{ "type", "geolocation_result" },
-							{ "address", address.ToString() },
-							{ "city", data[ "city" ] },
-							{ "region", data[ "region" ] },
-							{ "country", data[ "country" ] },
-							{ "org", data[ "org" ] },
-							{ "loc", data[ "loc" ] }
-						};
-					}
-					else
-					{
-						message =
-						{
-							{ "type", "log" },
-							{ "level", "error" }, 
-							{ "plugin", "geolocation" },
-							{ "message", "Error processing JSON response." }
-						};
-					}
+					pGeolocation->m_pMessageCallback( LogMessage( LogMessage::Level::Error, "geolocation", "Error processing JSON response." ) );
 				}
-				pGeolocation->m_pMessageCallback( message );
 			}
 
 			curl_easy_cleanup( pCurlHandle );
@@ -31,8 +31,8 @@ class Geolocation : public Plugin
 public:
 	Geolocation();
 	virtual ~Geolocation();
-	virtual bool Initialise( PluginMessageCallback pMessageCallback ) override;
-	virtual void OnMessageReceived( const nlohmann::json& message ) override;
+	virtual bool Initialise( PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions ) override;
+	virtual void OnMessage( const Message& message ) override;
 	virtual void DrawUI( ImGuiContext* pContext ) override;
 
 private:
@@ -61,7 +61,8 @@ GoogleSearch::~GoogleSearch()
 	curl_easy_cleanup(m_pCurlHandle);
 }
 
-bool GoogleSearch::Initialise(PluginMessageCallback pMessageCallback)
+// Only ever sends, so it subscribes to nothing and never receives a message.
+bool GoogleSearch::Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& /* subscriptions */)
 {
 	m_pMessageCallback = pMessageCallback;
 	return true;
@@ -74,11 +75,6 @@ void GoogleSearch::LoadQueries()
 	m_QueryDatum.push_back(data);
 }
 
-void GoogleSearch::OnMessageReceived(const nlohmann::json& message)
-{
-
-}
-
 void GoogleSearch::DrawUI(ImGuiContext* pContext)
 {
 	ImGui::SetCurrentContext(pContext);
@@ -146,7 +142,7 @@ void GoogleSearch::ThreadMain(GoogleSearch* pGoogleSearch)
 					{ "plugin", "googlesearch" },
 					{ "message", pErrorBuffer }
 				};
-				pGoogleSearch->m_pMessageCallback(message);
+				pGoogleSearch->m_pMessageCallback(JsonMessage(message));
 			}
 			else
 			{
@@ -188,6 +184,17 @@ void GoogleSearch::ThreadMain(GoogleSearch* pGoogleSearch)
 
 void GoogleSearch::ProcessResults(GoogleSearch* pGoogleSearch, const QueryData& queryData)
 {
+	struct PendingResult
+	{
+		std::string url;
+		int port;
+		std::future<Network::Resolver::Resolution> resolution;
+	};
+
+	// Every host is submitted before waiting on any of them, so the lookups run concurrently.
+	// Hosts which show up in several results are only looked up once.
+	std::vector<PendingResult> pendingResults;
+	pendingResults.reserve(queryData.results.size());
 	for (const QueryResult& result : queryData.results)
 	{
 		std::string url = result.GetUrl();
@@ -211,19 +218,25 @@ void GoogleSearch::ProcessResults(GoogleSearch* pGoogleSearch, const QueryData&
 			host = host.substr(0, portPos);
 		}
 
-		Network::IPAddress address;
-		if (Network::Resolve(host, address) == Network::Result::Success)
+		pendingResults.push_back({ url, port, pGoogleSearch->m_Resolver.Resolve(host) });
+	}
+
+	// Everything which resolved goes out in a single message, which refers to the URLs in pendingResults.
+	std::vector<HTTPServersFoundMessage::Server> servers;
+	servers.reserve(pendingResults.size());
+	for (PendingResult& pendingResult : pendingResults)
+	{
+		const Network::Resolver::Resolution resolution = pendingResult.resolution.get();
+		if (resolution.result == Network::Result::Success)
 		{
-			json message =
-			{
-				{ "type", "http_server_found" },
-				{ "url", url },
-				{ "ip_address", address.GetHostAsString() },
-				{ "port", port }
-			};
-			pGoogleSearch->m_pMessageCallback(message);
+			servers.push_back({ pendingResult.url, resolution.address.GetHost(), static_cast<uint16_t>(pendingResult.port), std::string_view() });
 		}
 	}
+
+	if (servers.empty() == false)
+	{
+		pGoogleSearch->m_pMessageCallback(HTTPServersFoundMessage(servers.data(), servers.size()));
+	}
 }
 
 bool GoogleSearch::FilterResult(const QueryData& queryData, const QueryResult& result)
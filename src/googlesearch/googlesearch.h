@@ -22,6 +22,7 @@
 
 #include "../watcher/plugin.h"
 #include "network/network.h"
+#include "network/resolver.h"
 #include "query.h"
 
 using CURL = void;
@@ -32,8 +33,7 @@ class GoogleSearch : public Plugin
 public:
 	GoogleSearch();
 	virtual ~GoogleSearch();
-	virtual bool Initialise(PluginMessageCallback pMessageCallback) override;
-	virtual void OnMessageReceived(const nlohmann::json& message) override;
+	virtual bool Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions) override;
 	virtual void DrawUI(ImGuiContext* pContext) override;
 
 	void Start();
@@ -60,4 +60,5 @@ private:
 	std::string m_CurlData;
 	QueryDatum m_QueryDatum;
 	std::mutex m_QueryDatumMutex;
+	Network::Resolver m_Resolver;
 };
@@ -78,29 +78,36 @@ HTTPCameraDetector::~HTTPCameraDetector()
 
 }
 
-bool HTTPCameraDetector::Initialise(PluginMessageCallback pMessageCallback)
+bool HTTPCameraDetector::Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions)
 {
 	m_pMessageCallback = pMessageCallback;
+	subscriptions.Add<HTTPServersFoundMessage>();
+	subscriptions.Add<HTTPServerScanResultMessage>(); // Our own results, as they come back through the watcher.
 	return true;
 }
 
-void HTTPCameraDetector::OnMessageReceived(const nlohmann::json& message)
+void HTTPCameraDetector::OnMessage(const Message& message)
 {
-	const std::string& messageType = message["type"];
-	if (messageType == "http_server_found")
+	if (const HTTPServersFoundMessage* pFound = message.As<HTTPServersFoundMessage>())
 	{
-		m_PendingResults++;
-		ThreadPool::Job job = std::bind(HTTPCameraDetector::Scan, this, message["url"], message["ip_address"], message["port"]);
-		m_ThreadPool.Queue(job);
+		// Scanners batch everything they found since they last sent, along with the
+		// start of each server's response if they grabbed it.
+		for (size_t i = 0; i < pFound->count; ++i)
+		{
+			const HTTPServersFoundMessage::Server& server = pFound->pServers[i];
+			m_PendingResults++;
+			ThreadPool::Job job = std::bind(HTTPCameraDetector::Scan, this, std::string(server.url), server.host, server.port, std::string(server.banner));
+			m_ThreadPool.Queue(job);
+		}
 	}
-	else if (messageType == "http_server_scan_result")
+	else if (const HTTPServerScanResultMessage* pScanResult = message.As<HTTPServerScanResultMessage>())
 	{
 		std::lock_guard<std::mutex> lock(m_ResultsMutex);
 		m_PendingResults--;
 		Result result;
-		result.url = message["url"];
-		result.title = message["title"];
-		result.isCamera = message["is_camera"];
+		result.url = std::string(pScanResult->url);
+		result.title = std::string(pScanResult->title);
+		result.isCamera = pScanResult->isCamera;
 		m_Results.push_front(result);
 		if (m_Results.size() > 100)
 		{
@@ -190,25 +197,20 @@ void HTTPCameraDetector::LoadRules()
 	}
 }
 
-void HTTPCameraDetector::Scan(HTTPCameraDetector* pDetector, const std::string& url, const std::string& ipAddress, int port)
+// Redirects are left for curl to follow.
+static bool IsUsableBanner(const std::string& banner)
+{
+	return banner.empty() == false && banner.compare(0, 10, "HTTP/1.0 3") != 0 && banner.compare(0, 10, "HTTP/1.1 3") != 0;
+}
+
+void HTTPCameraDetector::Scan(HTTPCameraDetector* pDetector, const std::string& url, uint32_t host, uint16_t port, const std::string& banner)
 {
 	if (url.rfind(".mjpg") != std::string::npos)
 	{
-		json message =
-		{
-			{ "type", "http_server_scan_result" },
-			{ "url", url },
-			{ "ip_address", ipAddress },
-			{ "port", port },
-			{ "is_camera", true },
-			{ "title", "" }
-		};
-		pDetector->m_pMessageCallback(message);
+		pDetector->m_pMessageCallback(HTTPServerScanResultMessage(url, host, port, true, std::string_view()));
 	}
 	else
 	{
-		CURL* pCurl = curl_easy_init();
-
 		char tagBuffer[32];
 		char attrBuffer[32];
 		char valBuffer[128];
@@ -224,26 +226,27 @@ void HTTPCameraDetector::Scan(HTTPCameraDetector* pDetector, const std::string&
 
 		ScanCallbackData data;
 		data.pHsp = hsp;
-		curl_easy_setopt(pCurl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(pCurl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(pCurl, CURLOPT_WRITEDATA, &data);
-		curl_easy_setopt(pCurl, CURLOPT_FOLLOWLOCATION, 1L);
-		curl_easy_setopt(pCurl, CURLOPT_TIMEOUT, 10L);
+		if (IsUsableBanner(banner))
+		{
+			// The headers go through the parser too, but hold no tags.
+			write_callback(const_cast<char*>(banner.data()), 1, banner.size(), &data);
+		}
+		else
+		{
+			CURL* pCurl = curl_easy_init();
+			curl_easy_setopt(pCurl, CURLOPT_URL, url.c_str());
+			curl_easy_setopt(pCurl, CURLOPT_WRITEFUNCTION, write_callback);
+			curl_easy_setopt(pCurl, CURLOPT_WRITEDATA, &data);
+			curl_easy_setopt(pCurl, CURLOPT_FOLLOWLOCATION, 1L);
+			curl_easy_setopt(pCurl, CURLOPT_TIMEOUT, 10L);
 
-		curl_easy_perform(pCurl);
+			curl_easy_perform(pCurl);
 
-		curl_easy_cleanup(pCurl);
+			curl_easy_cleanup(pCurl);
+		}
 
-		json message =
-		{
-			{ "type", "http_server_scan_result" },
-			{ "url", url },
-			{ "ip_address", ipAddress },
-			{ "port", port },
-			{ "is_camera", EvaluateDetectionRules(pDetector, url, data.title) },
-			{ "title", data.title }
-		};
-		pDetector->m_pMessageCallback(message);
+		const bool isCamera = EvaluateDetectionRules(pDetector, url, data.title);
+		pDetector->m_pMessageCallback(HTTPServerScanResultMessage(url, host, port, isCamera, data.title));
 	}
 }
 
@@ -34,10 +34,10 @@ class HTTPCameraDetector : public Plugin
 public:
 	HTTPCameraDetector();
 	virtual ~HTTPCameraDetector();
-	virtual bool Initialise(PluginMessageCallback pMessageCallback) override;
-	virtual void OnMessageReceived(const nlohmann::json& message) override;
+	virtual bool Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions) override;
+	virtual void OnMessage(const Message& message) override;
 	virtual void DrawUI(ImGuiContext* pContext) override;
-	static void Scan(HTTPCameraDetector* pDetector, const std::string& url, const std::string& ipAddress, int port);
+	static void Scan(HTTPCameraDetector* pDetector, const std::string& url, uint32_t host, uint16_t port, const std::string& banner);
 
 private:
 	void LoadRules();
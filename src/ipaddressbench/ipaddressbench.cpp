@@ -0,0 +1,170 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+//-----------------------------------------------------------------------------
+// ipaddressbench
+// Micro-benchmark for Network::IPAddress. Parses and formats a set of random
+// addresses with IPAddress, and with the sscanf and stringstream based code
+// it replaced, checks that both agree and reports the time taken by each.
+//-----------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <network/network.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Built at compile time.
+static constexpr Network::IPAddress sLiteralAddress( "192.168.1.20:8080" );
+static_assert( sLiteralAddress.GetHost() == 0xC0A80114 && sLiteralAddress.GetPort() == 8080, "IPAddress literal" );
+
+//-----------------------------------------------------------------------------
+// The previous implementation, as a reference.
+//-----------------------------------------------------------------------------
+
+static bool LegacyIsValid( const std::string& address )
+{
+	std::vector< int > v = { 0, 0, 0, 0 };
+	int port = 0;
+	int block = 0;
+	if ( sscanf( address.c_str(), "%d.%d.%d.%d:%d", &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ], &port ) == 5 ||
+		sscanf( address.c_str(), "%d.%d.%d.%d/%d", &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ], &block ) == 5 ||
+		sscanf( address.c_str(), "%d.%d.%d.%d", &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ] ) == 4 )
+	{
+		for ( int i = 0; i < 4; ++i )
+		{
+			if ( v[ i ] < 0 || v[ i ] > 255 )
+			{
+				return false;
+			}
+		}
+		return port >= 0 && port <= 65535 && ( block == 0 || ( block >= 8 && block <= 24 ) );
+	}
+	return false;
+}
+
+static Network::IPAddress LegacyParse( const std::string& address )
+{
+	if ( LegacyIsValid( address ) == false )
+	{
+		return Network::IPAddress();
+	}
+
+	std::vector< int > v = { 0, 0, 0, 0 };
+	int port = 0;
+	if ( sscanf( address.c_str(), "%d.%d.%d.%d:%d", &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ], &port ) != 5 )
+	{
+		sscanf( address.c_str(), "%d.%d.%d.%d", &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ] );
+	}
+	Network::IPAddress ipAddress;
+	ipAddress.SetHost( static_cast< uint32_t >( ( v[ 0 ] << 24 ) | ( v[ 1 ] << 16 ) | ( v[ 2 ] << 8 ) | v[ 3 ] ) );
+	ipAddress.SetPort( static_cast< uint16_t >( port ) );
+	return ipAddress;
+}
+
+static std::string LegacyToString( const Network::IPAddress& address )
+{
+	const uint32_t host = address.GetHost();
+	std::stringstream ss;
+	ss << ( host >> 24 ) << "." << ( ( host >> 16 ) & 0xFF ) << "." << ( ( host >> 8 ) & 0xFF ) << "." << ( host & 0xFF );
+	if ( address.GetPort() != 0u )
+	{
+		ss << ":" << address.GetPort();
+	}
+	return ss.str();
+}
+
+//-----------------------------------------------------------------------------
+
+template< typename F >
+static double Measure( F function )
+{
+	const Clock::time_point start = Clock::now();
+	function();
+	return std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+}
+
+static void Report( const char* pName, double legacy, double current, size_t count )
+{
+	printf( "%-10s %9.1f ms %9.1f ms %8.1fx %8.1f ns/address\n", pName, legacy, current, legacy / current, current * 1e6 / static_cast< double >( count ) );
+}
+
+int main( int argc, char** argv )
+{
+	const size_t count = ( argc > 1 ) ? strtoull( argv[ 1 ], nullptr, 10 ) : 1000000;
+	if ( count == 0 )
+	{
+		printf( "Usage: ipaddressbench [address count, default 1000000]\n" );
+		return 1;
+	}
+
+	std::mt19937 random( 1 );
+	std::vector< std::string > texts;
+	texts.reserve( count );
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const uint16_t port = ( i % 2 == 0 ) ? static_cast< uint16_t >( random() ) : 0;
+		texts.push_back( LegacyToString( Network::IPAddress( static_cast< uint32_t >( random() ), port ) ) );
+	}
+
+	std::vector< Network::IPAddress > legacyAddresses( count );
+	std::vector< Network::IPAddress > addresses( count );
+	const double legacyParse = Measure( [ & ]() { for ( size_t i = 0; i < count; ++i ) legacyAddresses[ i ] = LegacyParse( texts[ i ] ); } );
+	const double parse = Measure( [ & ]() { for ( size_t i = 0; i < count; ++i ) addresses[ i ] = Network::IPAddress( texts[ i ] ); } );
+
+	size_t legacyLength = 0;
+	size_t length = 0;
+	const double legacyFormat = Measure( [ & ]() { for ( size_t i = 0; i < count; ++i ) legacyLength += LegacyToString( addresses[ i ] ).size(); } );
+	const double format = Measure( [ & ]() { for ( size_t i = 0; i < count; ++i ) length += addresses[ i ].ToString().size(); } );
+
+	size_t bufferLength = 0;
+	const double formatBuffer = Measure( [ & ]()
+	{
+		char buffer[ Network::IPAddress::cMaxStringSize ];
+		for ( size_t i = 0; i < count; ++i )
+		{
+			bufferLength += addresses[ i ].ToChars( buffer );
+		}
+	} );
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const Network::IPAddress& address = addresses[ i ];
+		if ( address.GetHost() != legacyAddresses[ i ].GetHost() || address.GetPort() != legacyAddresses[ i ].GetPort() || address.ToString() != texts[ i ] )
+		{
+			printf( "Mismatch on '%s'.\n", texts[ i ].c_str() );
+			return 1;
+		}
+	}
+	if ( length != legacyLength || bufferLength != legacyLength )
+	{
+		printf( "Formatted lengths differ.\n" );
+		return 1;
+	}
+
+	printf( "%zu addresses\n", count );
+	printf( "%-10s %12s %12s %9s\n", "", "legacy", "current", "speed-up" );
+	Report( "Parse", legacyParse, parse, count );
+	Report( "ToString", legacyFormat, format, count );
+	Report( "ToChars", legacyFormat, formatBuffer, count );
+	return 0;
+}
@@ -0,0 +1,655 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+//-----------------------------------------------------------------------------
+// portscanbench
+// Headless benchmark for the port scanner. Starts a farm of listeners on the
+// loopback network, where every address in 127.0.0.0/8 is local without any
+// configuration, then scans a whole block of it the same way the port scanner
+// does and reports throughput, connect latency, CPU time and descriptor usage.
+// Every host and port in the block is, deterministically for a given seed:
+// - open: a listener accepts the connection,
+// - closed: nothing listens, so the kernel answers with a reset,
+// - blackholed: a listener whose accept queue is kept full, which makes the
+//   kernel silently drop every SYN, the same as a filtering firewall.
+// The outcomes the scan reports are checked against the farm's layout.
+//-----------------------------------------------------------------------------
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <network/network.h>
+#include "connectengine.h"
+#include "ipgenerator.h"
+#include "portprobe.h"
+#include "ratelimiter.h"
+#include "rttestimator.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+	uint32_t baseAddress = 0x7F010000; // 127.1.0.0
+	unsigned int prefixLength = 16;
+	Network::PortVector ports = { 80, 81, 8080 };
+	double open = 0.02;
+	double blackhole = 0.01;
+	uint64_t seed = 1;
+	bool useEngine = true;
+	bool portMajor = false;
+	int threads = 100;
+	int shards = std::max( 1, static_cast< int >( std::thread::hardware_concurrency() ) );
+	int inFlight = 4096;
+	unsigned int rate = 0;
+	unsigned int minimumTimeout = 200;
+	unsigned int maximumTimeout = 1000;
+};
+
+enum class Outcome
+{
+	Open,
+	Closed,
+	Blackhole
+};
+
+//-----------------------------------------------------------------------------
+// Farm
+//-----------------------------------------------------------------------------
+
+class Farm
+{
+public:
+	~Farm();
+	bool Start( const Options& options );
+	static Outcome GetOutcome( const Options& options, uint32_t host, uint16_t port );
+
+	size_t GetExpected( Outcome outcome ) const { return m_Expected[ static_cast< size_t >( outcome ) ]; }
+	size_t GetDescriptorCount() const { return m_Sockets.size(); }
+
+private:
+	int Listen( uint32_t host, uint16_t port, int backlog );
+	bool FillAcceptQueue( uint32_t host, uint16_t port );
+
+	std::vector< int > m_Sockets;
+	size_t m_Expected[ 3 ] = { 0, 0, 0 };
+};
+
+Farm::~Farm()
+{
+	for ( int socket : m_Sockets )
+	{
+		close( socket );
+	}
+}
+
+// SplitMix64 over the seed, host and port, mapped to [0, 1).
+Outcome Farm::GetOutcome( const Options& options, uint32_t host, uint16_t port )
+{
+	uint64_t z = options.seed * 0x9E3779B97F4A7C15ull + ( static_cast< uint64_t >( host ) << 16 | port );
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	const double r = static_cast< double >( z >> 11 ) / static_cast< double >( 1ull << 53 );
+
+	if ( r < options.open )
+	{
+		return Outcome::Open;
+	}
+	else if ( r < options.open + options.blackhole )
+	{
+		return Outcome::Blackhole;
+	}
+	return Outcome::Closed;
+}
+
+bool Farm::Start( const Options& options )
+{
+	const uint64_t hostCount = 1ull << ( 32u - options.prefixLength );
+	for ( uint64_t i = 0; i < hostCount; ++i )
+	{
+		const uint32_t host = options.baseAddress + static_cast< uint32_t >( i );
+		for ( uint16_t port : options.ports )
+		{
+			const Outcome outcome = GetOutcome( options, host, port );
+			m_Expected[ static_cast< size_t >( outcome ) ]++;
+			if ( outcome == Outcome::Open && Listen( host, port, SOMAXCONN ) == -1 )
+			{
+				return false;
+			}
+			else if ( outcome == Outcome::Blackhole && ( Listen( host, port, 0 ) == -1 || FillAcceptQueue( host, port ) == false ) )
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int Farm::Listen( uint32_t host, uint16_t port, int backlog )
+{
+	const int s = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if ( s == -1 )
+	{
+		perror( "socket" );
+		return -1;
+	}
+	m_Sockets.push_back( s );
+
+	const int enable = 1;
+	setsockopt( s, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof( enable ) );
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( host );
+	address.sin_port = htons( port );
+	if ( bind( s, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) == -1 || listen( s, backlog ) == -1 )
+	{
+		perror( "bind" );
+		return -1;
+	}
+	return s;
+}
+
+// With a backlog of 0 the accept queue holds a single connection, which is never
+// accepted. Once it's there the kernel drops every further SYN.
+bool Farm::FillAcceptQueue( uint32_t host, uint16_t port )
+{
+	const int s = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if ( s == -1 )
+	{
+		perror( "socket" );
+		return false;
+	}
+	m_Sockets.push_back( s );
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( host );
+	address.sin_port = htons( port );
+	if ( connect( s, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) == -1 )
+	{
+		perror( "connect" );
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Scan
+// Each worker keeps its own statistics, merged once the scan is over.
+//-----------------------------------------------------------------------------
+
+struct Statistics
+{
+	size_t counts[ 3 ] = { 0, 0, 0 };
+	size_t skipped = 0;
+	size_t mismatches = 0;
+	std::vector< uint32_t > latencies; // In microseconds.
+};
+
+static void Record( const Options& options, Statistics& statistics, const Network::IPAddress& address, PortProbe::Result result )
+{
+	Outcome outcome = Outcome::Closed;
+	if ( result == PortProbe::Result::Open )
+	{
+		outcome = Outcome::Open;
+	}
+	else if ( result == PortProbe::Result::Timeout )
+	{
+		outcome = Outcome::Blackhole;
+	}
+
+	statistics.counts[ static_cast< size_t >( outcome ) ]++;
+	if ( outcome != Farm::GetOutcome( options, address.GetHost(), address.GetPort() ) )
+	{
+		statistics.mismatches++;
+	}
+}
+
+// In port-major order, the hosts which didn't answer on the first port, which are
+// skipped for the others. Indexed by the host's offset in the block.
+class SilentHosts
+{
+public:
+	SilentHosts( const Options& options ) : m_BaseAddress( options.baseAddress ), m_Words( ( ( 1ull << ( 32u - options.prefixLength ) ) + 63 ) / 64 ) {}
+	bool Contains( const Network::IPAddress& address ) const
+	{
+		const uint32_t host = address.GetHost() - m_BaseAddress;
+		return ( m_Words[ host / 64 ].load( std::memory_order_relaxed ) & ( 1ull << ( host % 64 ) ) ) != 0;
+	}
+	void Add( const Network::IPAddress& address )
+	{
+		const uint32_t host = address.GetHost() - m_BaseAddress;
+		m_Words[ host / 64 ].fetch_or( 1ull << ( host % 64 ), std::memory_order_relaxed );
+	}
+
+private:
+	uint32_t m_BaseAddress;
+	std::vector< std::atomic< uint64_t > > m_Words;
+};
+
+// Same as PortScanner::ThreadMain(): every address's ports are probed at once or,
+// in port-major order, one per pass.
+static void BlockingWorkerMain( const Options& options, IPGenerator& generator, RateLimiter& rateLimiter, RTTEstimator& estimator, SilentHosts& silentHosts, unsigned int worker, Statistics& statistics )
+{
+	PortProbe probe( &estimator );
+	PortProbe::Results results;
+	Network::IPAddress address;
+	IPGenerator::Stride stride = generator.GetStride( worker, static_cast< unsigned int >( options.threads ) );
+	unsigned int pass = 0;
+	while ( generator.GetNext( stride, address, pass ) )
+	{
+		if ( options.portMajor )
+		{
+			if ( pass > 0 && silentHosts.Contains( address ) )
+			{
+				statistics.skipped++;
+				continue;
+			}
+
+			rateLimiter.Acquire();
+			address.SetPort( options.ports[ pass ] );
+			const Clock::time_point start = Clock::now();
+			const PortProbe::Result result = probe.Probe( address );
+			statistics.latencies.push_back( static_cast< uint32_t >( std::chrono::duration_cast< std::chrono::microseconds >( Clock::now() - start ).count() ) );
+			if ( pass == 0 && result == PortProbe::Result::Timeout )
+			{
+				silentHosts.Add( address );
+			}
+			Record( options, statistics, address, result );
+			continue;
+		}
+
+		rateLimiter.Acquire( static_cast< unsigned int >( options.ports.size() ) );
+
+		const Clock::time_point start = Clock::now();
+		probe.Probe( address, options.ports, results );
+		statistics.latencies.push_back( static_cast< uint32_t >( std::chrono::duration_cast< std::chrono::microseconds >( Clock::now() - start ).count() ) );
+
+		for ( size_t i = 0; i < options.ports.size(); ++i )
+		{
+			address.SetPort( options.ports[ i ] );
+			Record( options, statistics, address, results[ i ] );
+		}
+	}
+}
+
+// Same as PortScanner::EngineThreadMain(), for a single block.
+static void EngineShardMain( const Options& options, IPGenerator& generator, RateLimiter& rateLimiter, RTTEstimator& estimator, SilentHosts& silentHosts, unsigned int shard, Statistics& statistics )
+{
+	const int inFlight = std::max( 1, options.inFlight / options.shards );
+	ConnectEngine engine( inFlight, [ &options, &estimator, &silentHosts, &statistics ]( const Network::IPAddress& address, Network::Result result, unsigned int time, const std::string& /* banner */ )
+	{
+		if ( PortProbe::IsRoundTrip( result ) )
+		{
+			estimator.AddSample( address, time );
+		}
+		else if ( options.portMajor && address.GetPort() == options.ports[ 0 ] && PortProbe::ToResult( result ) == PortProbe::Result::Timeout )
+		{
+			silentHosts.Add( address );
+		}
+		statistics.latencies.push_back( time );
+		Record( options, statistics, address, PortProbe::ToResult( result ) );
+	} );
+
+	if ( engine.IsValid() == false )
+	{
+		printf( "Failed to create connect engine.\n" );
+		return;
+	}
+
+	IPGenerator::Stride stride = generator.GetStride( shard, static_cast< unsigned int >( options.shards ) );
+	Network::IPAddress address;
+	size_t portIndex = 0;
+	size_t portEnd = 0;
+	bool generating = true;
+	while ( generating || engine.GetInFlight() > 0 )
+	{
+		bool throttled = false;
+		while ( generating && engine.CanSubmit() )
+		{
+			if ( portIndex == portEnd )
+			{
+				unsigned int pass = 0;
+				if ( generator.GetNext( stride, address, pass ) == false )
+				{
+					generating = false;
+					break;
+				}
+
+				if ( options.portMajor == false )
+				{
+					portIndex = 0;
+					portEnd = options.ports.size();
+				}
+				else if ( pass > 0 && silentHosts.Contains( address ) )
+				{
+					statistics.skipped++;
+					continue;
+				}
+				else
+				{
+					portIndex = pass;
+					portEnd = pass + 1;
+				}
+			}
+
+			if ( rateLimiter.TryAcquire() == false )
+			{
+				throttled = true;
+				break;
+			}
+
+			address.SetPort( options.ports[ portIndex++ ] );
+			engine.Submit( address, estimator.GetTimeout( address ) );
+		}
+
+		const unsigned int waitTime = throttled ? 1u : options.maximumTimeout;
+		if ( engine.GetInFlight() > 0 )
+		{
+			engine.Poll( waitTime );
+		}
+		else if ( throttled )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( waitTime ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Resource usage
+//-----------------------------------------------------------------------------
+
+static size_t GetOpenDescriptorCount()
+{
+	DIR* pDirectory = opendir( "/proc/self/fd" );
+	if ( pDirectory == nullptr )
+	{
+		return 0;
+	}
+
+	size_t count = 0;
+	while ( readdir( pDirectory ) != nullptr )
+	{
+		count++;
+	}
+	closedir( pDirectory );
+
+	// ".", ".." and the directory's own descriptor.
+	return count > 3 ? count - 3 : 0;
+}
+
+static double GetSeconds( const timeval& time )
+{
+	return static_cast< double >( time.tv_sec ) + static_cast< double >( time.tv_usec ) / 1e6;
+}
+
+// Lets the farm and the scanner have as many descriptors as the hard limit allows.
+static void RaiseDescriptorLimit()
+{
+	rlimit limit;
+	if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit( RLIMIT_NOFILE, &limit );
+	}
+}
+
+static uint32_t GetPercentile( const std::vector< uint32_t >& sorted, double percentile )
+{
+	if ( sorted.empty() )
+	{
+		return 0;
+	}
+	const size_t index = static_cast< size_t >( percentile * static_cast< double >( sorted.size() - 1 ) + 0.5 );
+	return sorted[ index ];
+}
+
+//-----------------------------------------------------------------------------
+// Command line
+//-----------------------------------------------------------------------------
+
+static void PrintUsage()
+{
+	printf( "Usage: portscanbench [options]\n" );
+	printf( "  --block a.b.c.d/n     Block to scan, within 127.0.0.0/8 (default 127.1.0.0/16)\n" );
+	printf( "  --ports p,p,...       Ports probed on every host (default 80,81,8080)\n" );
+	printf( "  --open f              Fraction of ports which are open (default 0.02)\n" );
+	printf( "  --blackhole f         Fraction of ports which drop every SYN (default 0.01)\n" );
+	printf( "  --seed n              Seed for the farm's layout (default 1)\n" );
+	printf( "  --engine              Scan through the connect engine (default)\n" );
+	printf( "  --shards n            Engine shards (default: one per core)\n" );
+	printf( "  --in-flight n         Engine connections in flight, across all shards (default 4096)\n" );
+	printf( "  --threads n           Scan with n blocking workers instead of the engine\n" );
+	printf( "  --port-major          Visit every address once per port, skipping the ports of\n" );
+	printf( "                        hosts which didn't answer on the first one\n" );
+	printf( "  --rate n              Probes per second, 0 for unlimited (default 0)\n" );
+	printf( "  --timeout-min ms      Lower bound of the adaptive timeout (default 200)\n" );
+	printf( "  --timeout-max ms      Upper bound of the adaptive timeout (default 1000)\n" );
+}
+
+static bool ParseBlock( const char* pText, Options& options )
+{
+	unsigned int a, b, c, d, prefixLength;
+	if ( sscanf( pText, "%u.%u.%u.%u/%u", &a, &b, &c, &d, &prefixLength ) != 5 || a != 127 || b > 255 || c > 255 || d > 255 || prefixLength < 8 || prefixLength > 32 )
+	{
+		return false;
+	}
+
+	const uint32_t mask = static_cast< uint32_t >( ~( ( 1ull << ( 32u - prefixLength ) ) - 1ull ) );
+	options.baseAddress = ( a << 24 | b << 16 | c << 8 | d ) & mask;
+	options.prefixLength = prefixLength;
+	return true;
+}
+
+static bool ParsePorts( const char* pText, Options& options )
+{
+	options.ports.clear();
+	std::string text( pText );
+	size_t start = 0;
+	while ( start <= text.size() )
+	{
+		const size_t end = std::min( text.find( ',', start ), text.size() );
+		const int port = atoi( text.substr( start, end - start ).c_str() );
+		if ( port <= 0 || port > 65535 )
+		{
+			return false;
+		}
+		options.ports.push_back( static_cast< uint16_t >( port ) );
+		start = end + 1;
+	}
+	return options.ports.empty() == false;
+}
+
+static bool ParseOptions( int argc, char** argv, Options& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		const std::string option( argv[ i ] );
+		const char* pValue = ( i + 1 < argc ) ? argv[ i + 1 ] : nullptr;
+		bool valid = true;
+		if ( option == "--engine" )
+		{
+			options.useEngine = true;
+			continue;
+		}
+		else if ( option == "--port-major" )
+		{
+			options.portMajor = true;
+			continue;
+		}
+		else if ( pValue == nullptr )
+		{
+			valid = false;
+		}
+		else if ( option == "--block" ) valid = ParseBlock( pValue, options );
+		else if ( option == "--ports" ) valid = ParsePorts( pValue, options );
+		else if ( option == "--open" ) options.open = atof( pValue );
+		else if ( option == "--blackhole" ) options.blackhole = atof( pValue );
+		else if ( option == "--seed" ) options.seed = strtoull( pValue, nullptr, 10 );
+		else if ( option == "--shards" ) options.shards = std::max( 1, atoi( pValue ) );
+		else if ( option == "--in-flight" ) options.inFlight = std::max( 1, atoi( pValue ) );
+		else if ( option == "--threads" ) { options.threads = std::max( 1, atoi( pValue ) ); options.useEngine = false; }
+		else if ( option == "--rate" ) options.rate = static_cast< unsigned int >( std::max( 0, atoi( pValue ) ) );
+		else if ( option == "--timeout-min" ) options.minimumTimeout = static_cast< unsigned int >( std::max( 1, atoi( pValue ) ) );
+		else if ( option == "--timeout-max" ) options.maximumTimeout = static_cast< unsigned int >( std::max( 1, atoi( pValue ) ) );
+		else valid = false;
+
+		if ( valid == false )
+		{
+			printf( "Invalid option '%s'.\n", option.c_str() );
+			return false;
+		}
+		++i;
+	}
+
+	options.maximumTimeout = std::max( options.minimumTimeout, options.maximumTimeout );
+	return true;
+}
+
+int main( int argc, char** argv )
+{
+	Options options;
+	if ( ParseOptions( argc, argv, options ) == false )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	RaiseDescriptorLimit();
+	Network::Initialise();
+
+	Farm farm;
+	printf( "Starting farm...\n" );
+	if ( farm.Start( options ) == false )
+	{
+		printf( "Failed to start the farm, try a smaller block or raising the descriptor limit.\n" );
+		return 1;
+	}
+
+	const size_t baseDescriptors = GetOpenDescriptorCount();
+	IPGenerator generator( options.baseAddress, options.prefixLength );
+	generator.SetPassCount( options.portMajor ? static_cast< unsigned int >( options.ports.size() ) : 1u );
+	SilentHosts silentHosts( options );
+	RateLimiter rateLimiter( options.rate, std::max( 1u, options.rate / 10u ) );
+	RTTEstimator estimator( options.minimumTimeout, options.maximumTimeout );
+
+	const int workerCount = options.useEngine ? options.shards : options.threads;
+	std::vector< Statistics > statistics( static_cast< size_t >( workerCount ) );
+	std::atomic_bool done( false );
+	size_t peakDescriptors = baseDescriptors;
+	std::thread monitor( [ &done, &peakDescriptors ]()
+	{
+		while ( done == false )
+		{
+			peakDescriptors = std::max( peakDescriptors, GetOpenDescriptorCount() );
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+	} );
+
+	rusage usageBefore, usageAfter;
+	getrusage( RUSAGE_SELF, &usageBefore );
+	const Clock::time_point start = Clock::now();
+
+	std::vector< std::thread > workers;
+	for ( int i = 0; i < workerCount; ++i )
+	{
+		if ( options.useEngine )
+		{
+			workers.emplace_back( EngineShardMain, std::cref( options ), std::ref( generator ), std::ref( rateLimiter ), std::ref( estimator ), std::ref( silentHosts ), static_cast< unsigned int >( i ), std::ref( statistics[ i ] ) );
+		}
+		else
+		{
+			workers.emplace_back( BlockingWorkerMain, std::cref( options ), std::ref( generator ), std::ref( rateLimiter ), std::ref( estimator ), std::ref( silentHosts ), static_cast< unsigned int >( i ), std::ref( statistics[ i ] ) );
+		}
+	}
+	for ( std::thread& worker : workers )
+	{
+		worker.join();
+	}
+
+	const double elapsed = std::chrono::duration< double >( Clock::now() - start ).count();
+	getrusage( RUSAGE_SELF, &usageAfter );
+	done = true;
+	monitor.join();
+
+	Statistics total;
+	for ( Statistics& s : statistics )
+	{
+		for ( size_t i = 0; i < 3; ++i )
+		{
+			total.counts[ i ] += s.counts[ i ];
+		}
+		total.skipped += s.skipped;
+		total.mismatches += s.mismatches;
+		total.latencies.insert( total.latencies.end(), s.latencies.begin(), s.latencies.end() );
+	}
+	std::sort( total.latencies.begin(), total.latencies.end() );
+
+	const size_t probes = total.counts[ 0 ] + total.counts[ 1 ] + total.counts[ 2 ];
+	const double userTime = GetSeconds( usageAfter.ru_utime ) - GetSeconds( usageBefore.ru_utime );
+	const double systemTime = GetSeconds( usageAfter.ru_stime ) - GetSeconds( usageBefore.ru_stime );
+	const char* pLatencyUnit = options.useEngine ? "connection" : "address";
+
+	printf( "Mode:        %s, %s\n", options.useEngine ? "connect engine" : "blocking probes", options.portMajor ? "port-major" : "address-major" );
+	printf( "Workers:     %d\n", workerCount );
+	printf( "Probes:      %zu in %.2f s, %.0f probes/s\n", probes, elapsed, static_cast< double >( probes ) / elapsed );
+	printf( "Open:        %zu (expected %zu)\n", total.counts[ 0 ], farm.GetExpected( Outcome::Open ) );
+	printf( "Closed:      %zu (expected %zu)\n", total.counts[ 1 ], farm.GetExpected( Outcome::Closed ) );
+	printf( "Timed out:   %zu (expected %zu)\n", total.counts[ 2 ], farm.GetExpected( Outcome::Blackhole ) );
+	if ( options.portMajor )
+	{
+		printf( "Skipped:     %zu, on hosts silent on port %u\n", total.skipped, options.ports[ 0 ] );
+	}
+	printf( "Latency:     p50 %.3f ms, p99 %.3f ms, per %s\n", GetPercentile( total.latencies, 0.5 ) / 1000.0, GetPercentile( total.latencies, 0.99 ) / 1000.0, pLatencyUnit );
+	printf( "CPU time:    %.2f s user, %.2f s system, %.0f%% of a core\n", userTime, systemTime, 100.0 * ( userTime + systemTime ) / elapsed );
+	printf( "Peak fds:    %zu, not counting the farm's %zu\n", peakDescriptors - baseDescriptors, farm.GetDescriptorCount() );
+
+	if ( total.mismatches > 0 )
+	{
+		printf( "%zu probes reported the wrong outcome.\n", total.mismatches );
+		return 1;
+	}
+	return 0;
+}
+
+#else
+
+#include <cstdio>
+
+int main()
+{
+	printf( "portscanbench relies on the loopback network behaving as it does on Linux.\n" );
+	return 1;
+}
+
+#endif
@@ -0,0 +1,72 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <cstring>
+#include "bannerarena.h"
+
+BannerArena::BannerArena( size_t capacity ) :
+m_pData( std::make_unique< char[] >( capacity ) ),
+m_Capacity( capacity ),
+m_Written( 0 ),
+m_Released( 0 )
+{
+
+}
+
+bool BannerArena::TryWrite( const std::string& banner, Entry& entry )
+{
+	const size_t size = banner.size();
+	if ( size > m_Capacity )
+	{
+		return false;
+	}
+
+	// Banners are never split, so one which doesn't fit before the end of the buffer
+	// starts over at the beginning and the space it skipped is released along with it.
+	size_t offset = static_cast< size_t >( m_Written % m_Capacity );
+	size_t required = size;
+	if ( offset + size > m_Capacity )
+	{
+		required += m_Capacity - offset;
+		offset = 0;
+	}
+
+	if ( m_Written + required - m_Released.load( std::memory_order_acquire ) > m_Capacity )
+	{
+		return false;
+	}
+
+	if ( size > 0 )
+	{
+		memcpy( m_pData.get() + offset, banner.data(), size );
+	}
+	m_Written += required;
+
+	entry.offset = static_cast< uint32_t >( offset );
+	entry.size = static_cast< uint32_t >( size );
+	entry.end = m_Written;
+	return true;
+}
+
+std::string_view BannerArena::Read( const Entry& entry ) const
+{
+	return std::string_view( m_pData.get() + entry.offset, entry.size );
+}
+
+void BannerArena::Release( const Entry& entry )
+{
+	m_Released.store( entry.end, std::memory_order_release );
+}
@@ -0,0 +1,63 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//-----------------------------------------------------------------------------
+// BannerArena
+// Where a worker keeps the banners of the hits it has pushed, until the main
+// thread has broadcast them. The worker is the only writer and the main thread
+// the only reader, and banners are released in the order they were written, so
+// the arena is a ring of bytes which needs nothing more than two positions.
+// This keeps the hits themselves small and trivially copyable.
+//-----------------------------------------------------------------------------
+class BannerArena
+{
+public:
+	static constexpr size_t cDefaultCapacity = 64 * 1024;
+
+	// Where a banner was written, and how far to release the arena once it has been read.
+	struct Entry
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint64_t end;
+	};
+
+	BannerArena( size_t capacity = cDefaultCapacity );
+
+	BannerArena( const BannerArena& ) = delete;
+	BannerArena& operator=( const BannerArena& ) = delete;
+
+	// Worker thread only. Returns false if the main thread hasn't released enough yet.
+	bool TryWrite( const std::string& banner, Entry& entry );
+
+	// Main thread only. Entries must be released in the order they were written.
+	std::string_view Read( const Entry& entry ) const;
+	void Release( const Entry& entry );
+
+private:
+	std::unique_ptr< char[] > m_pData;
+	size_t m_Capacity;
+	uint64_t m_Written; // Only touched by the worker.
+	std::atomic< uint64_t > m_Released;
+};
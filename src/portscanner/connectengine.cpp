@@ -0,0 +1,251 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef __linux__
+
+#include <algorithm>
+#include "connectengine.h"
+#include "httpbanner.h"
+
+ConnectEngine::ConnectEngine( int maxInFlight, Callback callback ) :
+m_InFlight( 0 ),
+m_Timers( maxInFlight ),
+m_Callback( callback ),
+m_GrabBanners( false )
+{
+	m_Attempts.resize( maxInFlight );
+	m_FreeIndices.reserve( maxInFlight );
+	for ( int i = maxInFlight - 1; i >= 0; --i )
+	{
+		m_Attempts[ i ].socket = -1;
+		m_Attempts[ i ].generation = 0;
+		m_Attempts[ i ].receiving = false;
+		m_Attempts[ i ].connectTime = 0;
+		m_FreeIndices.push_back( i );
+	}
+}
+
+ConnectEngine::~ConnectEngine()
+{
+	Cancel();
+}
+
+bool ConnectEngine::IsValid() const
+{
+	return m_Poller.IsValid();
+}
+
+void ConnectEngine::SetGrabBanners( bool grabBanners )
+{
+	m_GrabBanners = grabBanners;
+}
+
+bool ConnectEngine::CanSubmit() const
+{
+	return m_FreeIndices.empty() == false;
+}
+
+int ConnectEngine::GetInFlight() const
+{
+	return m_InFlight;
+}
+
+bool ConnectEngine::Submit( const Network::IPAddress& address, unsigned int timeout )
+{
+	if ( CanSubmit() == false )
+	{
+		return false;
+	}
+
+	Network::TCPSocket socket;
+	Network::Result result = Network::ConnectTCPNonBlocking( address, socket );
+
+	// A connection accepted straight away (loopback) still goes through the poller if its
+	// banner is wanted, as the socket is reported as writable immediately.
+	const bool isConnected = ( result == Network::Result::Success && m_GrabBanners );
+	if ( result != Network::Result::InProgress && isConnected == false )
+	{
+		// The attempt is already over, either because the connection was accepted
+		// straight away or because the socket couldn't be created.
+		if ( result == Network::Result::Success )
+		{
+			Network::Close( socket );
+		}
+		m_Callback( address, result, 0, std::string() );
+		return true;
+	}
+
+	const int index = m_FreeIndices.back();
+	m_FreeIndices.pop_back();
+
+	Attempt& attempt = m_Attempts[ index ];
+	attempt.socket = socket;
+	attempt.address = address;
+	attempt.startTime = Clock::now();
+	attempt.generation++;
+	m_Timers.Schedule( index, timeout );
+	m_InFlight++;
+
+	if ( m_Poller.Add( socket, Network::Poller::cWritable, GetEventData( index ) ) == false )
+	{
+		Complete( index, Network::Result::InsufficientMemory );
+	}
+
+	return true;
+}
+
+void ConnectEngine::Poll( unsigned int waitTime )
+{
+	if ( m_InFlight == 0 )
+	{
+		return;
+	}
+
+	// Never sleep for longer than a tick, otherwise the timer wheel falls behind.
+	const unsigned int timeout = std::min( waitTime, m_Timers.GetTickDuration() );
+
+	constexpr int cMaxEvents = 256;
+	Network::Poller::Event events[ cMaxEvents ];
+	const int numEvents = m_Poller.Wait( events, cMaxEvents, timeout );
+	for ( int i = 0; i < numEvents; ++i )
+	{
+		const int index = static_cast< int >( events[ i ].data & 0xFFFFFFFF );
+		const uint32_t generation = static_cast< uint32_t >( events[ i ].data >> 32 );
+		Attempt& attempt = m_Attempts[ index ];
+		if ( attempt.socket == -1 || attempt.generation != generation )
+		{
+			continue;
+		}
+		else if ( attempt.receiving )
+		{
+			ReceiveBanner( index );
+		}
+		else
+		{
+			OnConnected( index, Network::GetConnectResult( attempt.socket ) );
+		}
+	}
+
+	// A connection which timed out waiting for its banner still succeeded.
+	m_Timers.Expire( [ this ]( int index )
+	{
+		Complete( index, m_Attempts[ index ].receiving ? Network::Result::Success : Network::Result::Timeout );
+	} );
+}
+
+void ConnectEngine::Cancel()
+{
+	for ( int i = 0; i < static_cast< int >( m_Attempts.size() ); ++i )
+	{
+		if ( m_Attempts[ i ].socket != -1 )
+		{
+			Release( i );
+		}
+	}
+}
+
+// The generation is packed alongside the index so a stale event can never be
+// attributed to a newer attempt which reused the same slot.
+uint64_t ConnectEngine::GetEventData( int index ) const
+{
+	return ( static_cast< uint64_t >( m_Attempts[ index ].generation ) << 32 ) | static_cast< uint32_t >( index );
+}
+
+// In microseconds.
+unsigned int ConnectEngine::GetElapsed( int index ) const
+{
+	const auto elapsed = std::chrono::duration_cast< std::chrono::microseconds >( Clock::now() - m_Attempts[ index ].startTime );
+	return static_cast< unsigned int >( elapsed.count() );
+}
+
+// Successful connections are kept open to grab their banner, if it is wanted. The
+// attempt then gets a new deadline for the banner to come in.
+void ConnectEngine::OnConnected( int index, Network::Result result )
+{
+	if ( result != Network::Result::Success || m_GrabBanners == false )
+	{
+		Complete( index, result );
+		return;
+	}
+
+	Attempt& attempt = m_Attempts[ index ];
+	attempt.connectTime = GetElapsed( index );
+	attempt.receiving = true;
+
+	// The request is small enough to always fit in a new connection's send buffer.
+	const std::string request = HTTPBanner::GetRequest( attempt.address );
+	if ( Network::Send( attempt.socket, request.data(), request.size(), 0 ) != Network::Result::Success ||
+		m_Poller.Modify( attempt.socket, Network::Poller::cReadable, GetEventData( index ) ) == false )
+	{
+		Complete( index, Network::Result::Success );
+		return;
+	}
+
+	m_Timers.Schedule( index, HTTPBanner::cTimeout );
+}
+
+// Reads whatever has arrived, without blocking. The attempt completes once the
+// banner is complete or the server closes the connection.
+void ConnectEngine::ReceiveBanner( int index )
+{
+	Attempt& attempt = m_Attempts[ index ];
+	char buffer[ 1024 ];
+	while ( HTTPBanner::IsComplete( attempt.banner ) == false )
+	{
+		size_t received = 0;
+		const Network::Result result = Network::Receive( attempt.socket, buffer, sizeof( buffer ), 0, received );
+		if ( result == Network::Result::Timeout )
+		{
+			return;
+		}
+		else if ( result != Network::Result::Success || received == 0 )
+		{
+			break;
+		}
+		HTTPBanner::Append( attempt.banner, buffer, received );
+	}
+
+	Complete( index, Network::Result::Success );
+}
+
+// The attempt is released before the callback is invoked, so the callback is
+// free to submit a new attempt in its place.
+// The time reported is always how long it took to connect, even if the banner
+// was waited for afterwards.
+void ConnectEngine::Complete( int index, Network::Result result )
+{
+	Attempt& attempt = m_Attempts[ index ];
+	const Network::IPAddress address = attempt.address;
+	const unsigned int time = attempt.receiving ? attempt.connectTime : GetElapsed( index );
+	std::string banner;
+	banner.swap( attempt.banner );
+	Release( index );
+	m_Callback( address, result, time, banner );
+}
+
+// Closing the socket also removes it from the poller.
+void ConnectEngine::Release( int index )
+{
+	Attempt& attempt = m_Attempts[ index ];
+	m_Timers.Cancel( index );
+	Network::Close( attempt.socket );
+	attempt.socket = -1;
+	attempt.receiving = false;
+	attempt.banner.clear();
+	m_FreeIndices.push_back( index );
+	m_InFlight--;
+}
+
+#endif
@@ -0,0 +1,92 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <network/network.h>
+#include <network/poller.h>
+#include <network/timerwheel.h>
+
+//-----------------------------------------------------------------------------
+// ConnectEngine
+// Keeps a large number of non-blocking TCP connection attempts in flight on a
+// single thread. Completion is detected through a Network::Poller and attempts
+// which take longer than their timeout are expired by a Network::TimerWheel.
+// Every attempt reports its outcome and how long it took, in microseconds,
+// through the callback, from within Submit() or Poll(), after which its socket
+// is closed.
+// If banners are grabbed, connections which succeed are kept open until the
+// start of the response to an HTTP request is in (see HTTPBanner), which is
+// passed to the callback along with them. Otherwise the banner is always empty.
+// Not thread safe: each engine is meant to be owned by a single thread.
+//-----------------------------------------------------------------------------
+class ConnectEngine
+{
+public:
+	using Callback = std::function< void( const Network::IPAddress& address, Network::Result result, unsigned int time, const std::string& banner ) >;
+
+	ConnectEngine( int maxInFlight, Callback callback );
+	~ConnectEngine();
+
+	bool IsValid() const;
+	void SetGrabBanners( bool grabBanners );
+	bool CanSubmit() const;
+	int GetInFlight() const;
+
+	// Starts a connection attempt, which must complete within "timeout" milliseconds.
+	// Returns false if the engine is already at capacity.
+	bool Submit( const Network::IPAddress& address, unsigned int timeout );
+
+	// Processes completed and expired attempts, waiting at most "waitTime"
+	// milliseconds for something to happen.
+	void Poll( unsigned int waitTime );
+
+	// Closes every attempt in flight without reporting them.
+	void Cancel();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Attempt
+	{
+		Network::TCPSocket socket;
+		Network::IPAddress address;
+		Clock::time_point startTime;
+		uint32_t generation;
+		bool receiving; // Connected, and waiting for the banner.
+		unsigned int connectTime; // In microseconds.
+		std::string banner;
+	};
+
+	uint64_t GetEventData( int index ) const;
+	unsigned int GetElapsed( int index ) const;
+	void OnConnected( int index, Network::Result result );
+	void ReceiveBanner( int index );
+	void Complete( int index, Network::Result result );
+	void Release( int index );
+
+	std::vector< Attempt > m_Attempts;
+	std::vector< int > m_FreeIndices;
+	int m_InFlight;
+	Network::Poller m_Poller;
+	Network::TimerWheel m_Timers; // One timer per attempt, with the same index.
+	Callback m_Callback;
+	bool m_GrabBanners;
+};
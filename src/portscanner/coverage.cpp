@@ -15,173 +15,439 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <SDL.h>
 #include <imgui/imgui.h>
 #include "coverage.h"
+#include "mappedfile.h"
 
 #define COVERAGE_DEBUG (0) // Force a particular block, for debugging purposes.
 
-static const std::string sCoverageFilePath( "plugins/portscanner/coverage" );
+static const std::string sCoverageFilePath( "plugins/portscanner/coverage24" );
+static const std::string sLegacyCoverageFilePath( "plugins/portscanner/coverage" );
+static const std::string sJournalFilePath( "plugins/portscanner/coverage24.journal" );
+static const std::string sExclusionsFilePath( "plugins/portscanner/exclusions.txt" );
+static const std::chrono::seconds sSyncInterval( 1 );
+
+static const GLubyte sNotScannedColour[ 3 ] = { 0x0E, 0x11, 0x18 }; // Dark blue
+static const GLubyte sScannedColour[ 3 ] = { 0x88, 0xFF, 0xD7 }; // Cyan
+static const GLubyte sExcludedColour[ 3 ] = { 0x40, 0x40, 0x40 }; // Grey
+static const GLubyte sInProgressColour[ 3 ] = { 0x00, 0xFF, 0x00 }; // Green
 
 Coverage::Coverage() :
-m_UITexture( 0 ),
-m_UITextureWidth( 256 ),
-m_UITextureHeight( 256 ),
-m_pUITextureData( nullptr ),
-m_RebuildUITexture( true )
-{
-	// At the worst case, all indices in the bitmap will be free.
-	m_FreeIndices.reserve( cBitSetSize );
+m_ZoomedNetwork( -1 ),
+m_ZoomLevel( 2 ),
+m_Words( cUITextureSize * cNetworksPerBlock / 64 ),
+m_FreeBlocks( cBlockCount ),
+m_Journal( sJournalFilePath ),
+m_CompactionSize( cCompactionThreshold ),
+m_Compacting( false )
+{
+	LoadExclusions();
 	ClearBlockStates();
 
-	CreateUserInterfaceTexture();
+	CreateUserInterfaceTexture( m_OverviewTexture, GL_LINEAR );
+	CreateUserInterfaceTexture( m_ZoomTexture, GL_NEAREST );
 
 	std::random_device rd;
 	m_MersenneTwister = std::mt19937(rd());
 	m_Distribution = std::uniform_int_distribution<unsigned int>(0u, 0xFFFFFFFF);
+	m_LastSync = std::chrono::steady_clock::now();
+}
+
+Coverage::~Coverage()
+{
+	WaitForCompaction();
 }
 
 void Coverage::ClearBlockStates() 
 {
-	m_BitSet.reset();
-	m_HasInProgressBlock = false;
-	m_InProgressBlockIndex = 0;
-	m_RebuildUITexture = true;
-	for ( int i = 0; i < cBitSetSize; i++ )
+	m_ScannedNetworks.Clear();
+	m_InProgressBlocks.clear();
+	OnAllBlocksChanged();
+	m_FreeBlocks.Fill();
+
+	for ( uint32_t index = 0; index < cBlockCount; ++index )
 	{
-		m_FreeIndices.push_back( i );
+		if ( m_ExcludedBlocks[ index ] )
+		{
+			m_FreeBlocks.Remove( index );
+		}
 	}
 }
 
-void Coverage::CreateUserInterfaceTexture()
+//-----------------------------------------------------------------------------
+// Coverage::LoadExclusions()
+// The reserved ranges are always excluded, and more can be listed in the
+// exclusions file, one CIDR block per line.
+//-----------------------------------------------------------------------------
+void Coverage::LoadExclusions()
 {
-	m_pUITextureData = new GLubyte[ m_UITextureWidth * m_UITextureHeight * 3 ];
-	memset( m_pUITextureData, 0xFF, m_UITextureWidth * m_UITextureHeight * 3 * sizeof( GLubyte ) );
+	m_Exclusions.Clear();
+	m_Exclusions.AddReserved();
+	m_Exclusions.Load( sExclusionsFilePath );
+
+	for ( uint32_t index = 0; index < cBlockCount; ++index )
+	{
+		const uint32_t first = index << 16;
+		m_ExcludedBlocks[ index ] = ( m_Exclusions.GetExcludedCount( first, first | 0xFFFF ) == 0x10000 );
+	}
 
-	glGenTextures( 1, &m_UITexture );
-	glBindTexture( GL_TEXTURE_2D, m_UITexture );
+	OnAllBlocksChanged();
+	if ( m_ZoomedNetwork >= 0 )
+	{
+		SetZoomedNetwork( m_ZoomedNetwork );
+	}
+}
 
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, m_UITextureWidth, m_UITextureHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, m_pUITextureData );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+const ExclusionList& Coverage::GetExclusions() const
+{
+	return m_Exclusions;
+}
+
+void Coverage::CreateUserInterfaceTexture( UITexture& texture, GLint filter )
+{
+	texture.data.assign( cUITextureSize * cUITextureSize * 3, 0xFF );
+	texture.dirtyRows.set();
+
+	glGenTextures( 1, &texture.id );
+	glBindTexture( GL_TEXTURE_2D, texture.id );
+
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, cUITextureSize, cUITextureSize, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.data() );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
 }
 
+// Rows are contiguous in the texture's data, so every run of dirty rows is a
+// single upload.
+void Coverage::UploadUserInterfaceTexture( UITexture& texture )
+{
+	if ( texture.dirtyRows.none() )
+	{
+		return;
+	}
+
+	glBindTexture( GL_TEXTURE_2D, texture.id );
+	int row = 0;
+	while ( row < cUITextureSize )
+	{
+		if ( texture.dirtyRows[ row ] == false )
+		{
+			row++;
+			continue;
+		}
+
+		const int first = row;
+		while ( row < cUITextureSize && texture.dirtyRows[ row ] )
+		{
+			row++;
+		}
+		const GLubyte* pRows = &texture.data[ first * cUITextureSize * 3 ];
+		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, first, cUITextureSize, row - first, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)pRows );
+	}
+	texture.dirtyRows.reset();
+}
+
 void Coverage::UpdateUserInterfaceTexture()
 {
-	if ( m_RebuildUITexture == false )
+	for ( int row = 0; row < cUITextureSize; ++row )
 	{
-		return; 
+		if ( m_OverviewTexture.dirtyRows[ row ] )
+		{
+			UpdateOverviewRow( row );
+		}
 	}
+	UploadUserInterfaceTexture( m_OverviewTexture );
 
-	for ( int y = 0; y < m_UITextureHeight; ++y )
+	if ( m_ZoomedNetwork >= 0 )
 	{
-		for ( int x = 0; x < m_UITextureWidth; ++x )
+		for ( int row = 0; row < cUITextureSize; ++row )
 		{
-			IndexType bitSetIndex = y * m_UITextureWidth + x;
-			int textureDataIndex = bitSetIndex * 3;
-			if ( m_HasInProgressBlock && m_InProgressBlockIndex == bitSetIndex )
+			if ( m_ZoomTexture.dirtyRows[ row ] )
 			{
-				// Green
-				m_pUITextureData[ textureDataIndex     ] = 0x00;
-				m_pUITextureData[ textureDataIndex + 1 ] = 0xFF;
-				m_pUITextureData[ textureDataIndex + 2 ] = 0x00;
+				UpdateZoomRow( row );
 			}
+		}
+		UploadUserInterfaceTexture( m_ZoomTexture );
+	}
+}
 
-			else if ( m_BitSet.test( bitSetIndex ) )
-			{
-				// Cyan
-				m_pUITextureData[ textureDataIndex     ] = 0x88;
-				m_pUITextureData[ textureDataIndex + 1 ] = 0xFF;
-				m_pUITextureData[ textureDataIndex + 2 ] = 0xD7;
-			}
-			else
+static void SetPixel( GLubyte* pPixel, const GLubyte* pColour )
+{
+	pPixel[ 0 ] = pColour[ 0 ];
+	pPixel[ 1 ] = pColour[ 1 ];
+	pPixel[ 2 ] = pColour[ 2 ];
+}
+
+// One row of the overview is a /8, whose networks all live in the same 64 KB of
+// the bitmap. Each block is four words of it.
+void Coverage::UpdateOverviewRow( int row )
+{
+	m_ScannedNetworks.GetWords( static_cast< uint32_t >( row ) << 16, m_Words.size(), m_Words.data() );
+
+	GLubyte* pPixel = &m_OverviewTexture.data[ row * cUITextureSize * 3 ];
+	for ( int x = 0; x < cUITextureSize; ++x, pPixel += 3 )
+	{
+		const IndexType index = static_cast< IndexType >( row * cUITextureSize + x );
+		if ( m_ExcludedBlocks[ index ] )
+		{
+			SetPixel( pPixel, sExcludedColour );
+			continue;
+		}
+
+		if ( std::find( m_InProgressBlocks.begin(), m_InProgressBlocks.end(), index ) != m_InProgressBlocks.end() )
+		{
+			SetPixel( pPixel, sInProgressColour );
+			continue;
+		}
+
+		// From dark blue for an unscanned block to cyan once all its networks have been scanned.
+		const uint64_t* pBlockWords = &m_Words[ x * cNetworksPerBlock / 64 ];
+		const int scanned = static_cast< int >( std::bitset< 64 >( pBlockWords[ 0 ] ).count() + std::bitset< 64 >( pBlockWords[ 1 ] ).count() +
+			std::bitset< 64 >( pBlockWords[ 2 ] ).count() + std::bitset< 64 >( pBlockWords[ 3 ] ).count() );
+		const int total = static_cast< int >( cNetworksPerBlock );
+		for ( int channel = 0; channel < 3; ++channel )
+		{
+			pPixel[ channel ] = static_cast< GLubyte >( sNotScannedColour[ channel ] + ( sScannedColour[ channel ] - sNotScannedColour[ channel ] ) * scanned / total );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ExpandWord()
+// Writes a pixel for each of the 64 networks in a word. Most words are all
+// scanned or all not, which only needs a fill, and the others only look at
+// each bit once the word as a whole has been ruled out.
+//-----------------------------------------------------------------------------
+static void ExpandWord( uint64_t scanned, uint64_t excluded, const GLubyte* pNotScannedColour, GLubyte* pPixels )
+{
+	const GLubyte* pFill = nullptr;
+	if ( excluded == ~0ull )
+	{
+		pFill = sExcludedColour;
+	}
+	else if ( excluded == 0 && scanned == 0 )
+	{
+		pFill = pNotScannedColour;
+	}
+	else if ( excluded == 0 && scanned == ~0ull )
+	{
+		pFill = sScannedColour;
+	}
+
+	if ( pFill != nullptr )
+	{
+		SetPixel( pPixels, pFill );
+		for ( size_t filled = 3; filled < 64 * 3; filled *= 2 )
+		{
+			memcpy( pPixels + filled, pPixels, std::min< size_t >( filled, 64 * 3 - filled ) );
+		}
+		return;
+	}
+
+	for ( int bit = 0; bit < 64; ++bit, pPixels += 3 )
+	{
+		const uint64_t mask = 1ull << bit;
+		SetPixel( pPixels, ( excluded & mask ) ? sExcludedColour : ( ( scanned & mask ) ? sScannedColour : pNotScannedColour ) );
+	}
+}
+
+// One row of the zoomed view is a /16 block, with a pixel per /24 network.
+void Coverage::UpdateZoomRow( int row )
+{
+	const IndexType index = static_cast< IndexType >( m_ZoomedNetwork * cUITextureSize + row );
+	const uint32_t firstNetwork = static_cast< uint32_t >( index ) * cNetworksPerBlock;
+	const size_t wordCount = cNetworksPerBlock / 64;
+	uint64_t words[ wordCount ];
+	m_ScannedNetworks.GetWords( firstNetwork, wordCount, words );
+
+	const bool isInProgress = std::find( m_InProgressBlocks.begin(), m_InProgressBlocks.end(), index ) != m_InProgressBlocks.end();
+	const GLubyte* pNotScannedColour = isInProgress ? sInProgressColour : sNotScannedColour;
+	GLubyte* pPixels = &m_ZoomTexture.data[ row * cUITextureSize * 3 ];
+	for ( size_t i = 0; i < wordCount; ++i )
+	{
+		ExpandWord( words[ i ], m_ZoomExcludedWords[ row * wordCount + i ], pNotScannedColour, pPixels + i * 64 * 3 );
+	}
+}
+
+// Works out which of the /8's networks are excluded up front, as that doesn't
+// change while it's being looked at.
+void Coverage::SetZoomedNetwork( int network )
+{
+	m_ZoomedNetwork = network;
+	m_ZoomTexture.dirtyRows.set();
+	if ( network < 0 )
+	{
+		return;
+	}
+
+	const size_t wordCount = cNetworksPerBlock / 64;
+	m_ZoomExcludedWords.assign( cUITextureSize * wordCount, 0 );
+	for ( int row = 0; row < cUITextureSize; ++row )
+	{
+		const IndexType index = static_cast< IndexType >( network * cUITextureSize + row );
+		const uint32_t first = static_cast< uint32_t >( index ) << 16;
+		uint64_t* pWords = &m_ZoomExcludedWords[ row * wordCount ];
+		if ( m_ExcludedBlocks[ index ] )
+		{
+			std::fill( pWords, pWords + wordCount, ~0ull );
+		}
+		else if ( m_Exclusions.GetExcludedCount( first, first | 0xFFFF ) > 0 )
+		{
+			for ( uint32_t i = 0; i < cNetworksPerBlock; ++i )
 			{
-				// Dark blue
-				m_pUITextureData[ textureDataIndex     ] = 0x0E;
-				m_pUITextureData[ textureDataIndex + 1 ] = 0x11;
-				m_pUITextureData[ textureDataIndex + 2 ] = 0x18;
+				const uint32_t networkFirst = first | ( i << 8 );
+				if ( m_Exclusions.GetExcludedCount( networkFirst, networkFirst | 0xFF ) == 0x100 )
+				{
+					pWords[ i / 64 ] |= 1ull << ( i % 64 );
+				}
 			}
 		}
 	}
+}
 
-	glBindTexture( GL_TEXTURE_2D, m_UITexture );
-	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, m_UITextureWidth, m_UITextureHeight, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)m_pUITextureData );
+void Coverage::OnBlockChanged( IndexType index )
+{
+	m_OverviewTexture.dirtyRows.set( index >> 8 );
+	if ( ( index >> 8 ) == m_ZoomedNetwork )
+	{
+		m_ZoomTexture.dirtyRows.set( index & 0xFF );
+	}
+}
 
-	m_RebuildUITexture = false;
+void Coverage::OnAllBlocksChanged()
+{
+	m_OverviewTexture.dirtyRows.set();
+	m_ZoomTexture.dirtyRows.set();
 }
 
 Coverage::BlockState Coverage::GetBlockState( const Network::IPAddress& ipAddress ) const
 {
 	IndexType index = IPAddressToIndex( ipAddress );
-	if ( m_HasInProgressBlock && m_InProgressBlockIndex == index )
+	if ( std::find( m_InProgressBlocks.begin(), m_InProgressBlocks.end(), index ) != m_InProgressBlocks.end() )
 	{
 		return Coverage::BlockState::InProgress;
 	}
-	return m_BitSet.test( index ) ? Coverage::BlockState::Scanned : Coverage::BlockState::NotScanned;
+	return ( GetScannedNetworkCount( index ) == cNetworksPerBlock ) ? Coverage::BlockState::Scanned : Coverage::BlockState::NotScanned;
 }
 
 void Coverage::SetBlockState( const Network::IPAddress& ipAddress, Coverage::BlockState state )
 {
 	IndexType index = IPAddressToIndex( ipAddress );
+	std::vector< IndexType >::iterator inProgressIt = std::find( m_InProgressBlocks.begin(), m_InProgressBlocks.end(), index );
 	if ( state == Coverage::BlockState::InProgress )
 	{
-		m_HasInProgressBlock = true;
-		m_InProgressBlockIndex = index;
+		if ( inProgressIt == m_InProgressBlocks.end() )
+		{
+			m_InProgressBlocks.push_back( index );
+		}
+
+		// Several blocks can be in progress at once, so make sure this one doesn't get handed out again.
+		m_FreeBlocks.Remove( index );
 	}
 	else
 	{
-		if ( m_HasInProgressBlock && m_InProgressBlockIndex == index )
+		if ( inProgressIt != m_InProgressBlocks.end() )
 		{
-			m_HasInProgressBlock = false;
-			m_InProgressBlockIndex = 0;
+			m_InProgressBlocks.erase( inProgressIt );
 		}
 		
+		const uint32_t firstNetwork = static_cast< uint32_t >( index ) * cNetworksPerBlock;
 		if ( state == Coverage::BlockState::Scanned )
 		{
-			m_BitSet.set( index, true );
-			std::vector< IndexType >::iterator it = std::find( m_FreeIndices.begin(), m_FreeIndices.end(), index );
-			if ( it != m_FreeIndices.end() )
+			m_Journal.Append( firstNetwork, cNetworksPerBlock, ProgressJournal::Operation::Add );
+			for ( uint32_t network = firstNetwork; network < firstNetwork + cNetworksPerBlock; ++network )
 			{
-				std::iter_swap( it, m_FreeIndices.end() - 1 );
-				m_FreeIndices.pop_back();
+				m_ScannedNetworks.Add( network );
 			}
+			m_FreeBlocks.Remove( index );
 		}
 		else if ( state == Coverage::BlockState::NotScanned )
 		{
-			m_BitSet.set( index, false );
-			std::vector< IndexType >::iterator it = std::find( m_FreeIndices.begin(), m_FreeIndices.end(), index );
-			if ( it == m_FreeIndices.end() )
+			m_Journal.Append( firstNetwork, cNetworksPerBlock, ProgressJournal::Operation::Remove );
+			for ( uint32_t network = firstNetwork; network < firstNetwork + cNetworksPerBlock; ++network )
+			{
+				m_ScannedNetworks.Remove( network );
+			}
+
+			if ( m_ExcludedBlocks[ index ] == false )
 			{
-				m_FreeIndices.push_back( index );
+				m_FreeBlocks.Insert( index );
 			}
 		}
 	}
 
-	m_RebuildUITexture = true;
+	OnBlockChanged( index );
 }
 
 bool Coverage::GetNextBlock( Network::IPAddress& ipAddress )
 {
-	if ( m_FreeIndices.empty() )
+	if ( m_FreeBlocks.IsEmpty() )
 	{
 		return false;
 	}
 
 #if COVERAGE_DEBUG
-	ipAddress.SetHost({ 81, 231, 0, 0 });
+	ipAddress.SetHost(81, 231, 0, 0);
 #else
 	const int r = m_Distribution(m_MersenneTwister);
-	IndexType idx = m_FreeIndices[ r % m_FreeIndices.size() ];
+	IndexType idx = static_cast< IndexType >( m_FreeBlocks.Get( r % m_FreeBlocks.GetSize() ) );
 	ipAddress = IndexToIPAddress( idx );
 #endif
 	ipAddress.SetBlock(16);
 	return true;
 }
 
+bool Coverage::IsNetworkScanned( const Network::IPAddress& ipAddress ) const
+{
+	return m_ScannedNetworks.Contains( ipAddress.GetHost() >> 8 );
+}
+
+void Coverage::SetNetworkScanned( const Network::IPAddress& ipAddress )
+{
+	const uint32_t network = ipAddress.GetHost() >> 8;
+	if ( m_ScannedNetworks.Contains( network ) )
+	{
+		return;
+	}
+
+	m_ScannedNetworks.Add( network );
+	m_Journal.Append( network, 1, ProgressJournal::Operation::Add );
+
+	const IndexType index = static_cast< IndexType >( ipAddress.GetHost() >> 16 );
+	if ( GetScannedNetworkCount( index ) == cNetworksPerBlock )
+	{
+		m_FreeBlocks.Remove( index );
+	}
+	OnBlockChanged( index );
+}
+
+void Coverage::ReleaseBlock( const Network::IPAddress& ipAddress )
+{
+	const IndexType index = IPAddressToIndex( ipAddress );
+	std::vector< IndexType >::iterator it = std::find( m_InProgressBlocks.begin(), m_InProgressBlocks.end(), index );
+	if ( it != m_InProgressBlocks.end() )
+	{
+		m_InProgressBlocks.erase( it );
+	}
+
+	if ( GetScannedNetworkCount( index ) < cNetworksPerBlock && m_ExcludedBlocks[ index ] == false )
+	{
+		m_FreeBlocks.Insert( index );
+	}
+	OnBlockChanged( index );
+}
+
+uint32_t Coverage::GetScannedNetworkCount( IndexType index ) const
+{
+	const uint64_t firstNetwork = static_cast< uint64_t >( index ) * cNetworksPerBlock;
+	return static_cast< uint32_t >( m_ScannedNetworks.GetCardinality( firstNetwork, firstNetwork + cNetworksPerBlock ) );
+}
+
 Coverage::IndexType Coverage::IPAddressToIndex( const Network::IPAddress& ipAddress ) const
 {
 	unsigned int addr = ipAddress.GetHost();
@@ -194,82 +460,222 @@ Network::IPAddress Coverage::IndexToIPAddress( Coverage::IndexType index ) const
 	return Network::IPAddress( static_cast< unsigned int >( index ) << 16, 0u );
 }
 
+//-----------------------------------------------------------------------------
+// Coverage::Read()
+// Loads the last snapshot and replays the journal on top of it. If the journal
+// had anything in it, everything is written out as a new snapshot so the next
+// run starts with an empty journal.
+//-----------------------------------------------------------------------------
 void Coverage::Read()
 {
+	WaitForCompaction();
+	m_Journal.Flush( true );
+	LoadExclusions();
 	ClearBlockStates();
-	
-	std::ifstream fs( sCoverageFilePath, std::ios_base::in | std::ios_base::binary );
-	if ( fs.good() )
-	{
-		fs.seekg( 0, fs.end );
-		std::streamoff fileSize = fs.tellg();
-		fs.seekg( 0, fs.beg );
-		SDL_assert( fileSize == cCoverageFileSize );
-		if ( fileSize == cCoverageFileSize )
+
+	bool migrated = false;
+	MappedFile file;
+	if ( file.OpenForReading( sCoverageFilePath ) )
+	{
+		if ( m_ScannedNetworks.Deserialise( file.GetData(), file.GetSize() ) == false )
 		{
-			std::array< unsigned char, cCoverageFileSize > buffer;
-			fs.read( reinterpret_cast< char* >( buffer.data() ), cCoverageFileSize );
+			printf( "Coverage file '%s' is corrupt, ignoring it.\n", sCoverageFilePath.c_str() );
+		}
+		file.Close();
+	}
+	else
+	{
+		// The old file is left as it was.
+		migrated = ReadLegacy();
+	}
+
+	ProgressJournal::Records records;
+	const bool journalValid = m_Journal.Replay( records );
+	if ( journalValid == false )
+	{
+		printf( "Progress journal '%s' ends with a damaged record, ignoring the rest of it.\n", sJournalFilePath.c_str() );
+	}
 
-			unsigned char v = 0u;
-			unsigned int bitSetIndex = 0u;
-			for ( size_t s = 0u; s < cCoverageFileSize; ++s )
+	for ( const ProgressJournal::Record& record : records )
+	{
+		const uint64_t end = static_cast< uint64_t >( record.first ) + record.count;
+		for ( uint64_t network = record.first; network < end; ++network )
+		{
+			if ( record.operation == ProgressJournal::Operation::Add )
 			{
-				unsigned char v = static_cast< unsigned char >( buffer[ s ] );
-				for ( int i = 0; i < 8; ++i )
-				{
-					const bool isSet = v & ( 0x80 >> i );
-					m_BitSet.set( s * 8 + i, isSet );
-				}
+				m_ScannedNetworks.Add( static_cast< uint32_t >( network ) );
+			}
+			else
+			{
+				m_ScannedNetworks.Remove( static_cast< uint32_t >( network ) );
 			}
+		}
+	}
+
+	if ( migrated || records.empty() == false || journalValid == false )
+	{
+		Write();
+	}
 
+	for ( uint32_t index = 0; index < cBlockCount; ++index )
+	{
+		if ( GetScannedNetworkCount( static_cast< IndexType >( index ) ) == cNetworksPerBlock )
+		{
+			m_FreeBlocks.Remove( index );
 		}
-		fs.close();
 	}
 }
 
 //-----------------------------------------------------------------------------
-// Coverage::Write()
-// Writes the coverage bitset to disk in binary format.
-// There's no easy way to write out a std::bitset so we have to populate bytes
-// individually before writing the resulting buffer to disk.
+// Coverage::ReadLegacy()
+// The previous format was a plain 8 KB bitset of /16 blocks, most significant
+// bit first. Every network in a block which was set is considered scanned.
 //-----------------------------------------------------------------------------
-void Coverage::Write()
+bool Coverage::ReadLegacy()
 {
-	static_assert( cCoverageFileSize == cBitSetSize / 8, "Size mismatch" );
+	std::ifstream fs( sLegacyCoverageFilePath, std::ios_base::in | std::ios_base::binary );
+	if ( fs.good() == false )
+	{
+		return false;
+	}
 
-	std::ofstream fs( sCoverageFilePath, std::ios_base::out | std::ios_base::binary );
-	if ( fs.good() )
+	fs.seekg( 0, fs.end );
+	std::streamoff fileSize = fs.tellg();
+	fs.seekg( 0, fs.beg );
+	if ( fileSize != cLegacyCoverageFileSize )
 	{
-		constexpr size_t cNumBytes = cBitSetSize / 8;
-		std::array< char, cNumBytes > buffer;
-		buffer.fill( 0 );
+		return false;
+	}
 
-		unsigned char v = 0u;
-		unsigned int bufferIndex = 0u;
-		for ( size_t s = 0u; s < cBitSetSize; s++ )
+	std::array< unsigned char, cLegacyCoverageFileSize > buffer;
+	fs.read( reinterpret_cast< char* >( buffer.data() ), cLegacyCoverageFileSize );
+	for ( size_t s = 0u; s < cLegacyCoverageFileSize; ++s )
+	{
+		unsigned char v = static_cast< unsigned char >( buffer[ s ] );
+		for ( int i = 0; i < 8; ++i )
 		{
-			if ( s != 0 && s % 8 == 0 )
+			if ( v & ( 0x80 >> i ) )
 			{
-				buffer[ bufferIndex++ ] = v;
-				v = 0x0;
-			}
-
-			if ( m_BitSet[ s ] )
-			{
-				int bitPosition = s % 8;
-				v |= 0x80 >> bitPosition;
+				const uint32_t firstNetwork = static_cast< uint32_t >( s * 8 + i ) * cNetworksPerBlock;
+				for ( uint32_t network = firstNetwork; network < firstNetwork + cNetworksPerBlock; ++network )
+				{
+					m_ScannedNetworks.Add( network );
+				}
 			}
 		}
+	}
+	return true;
+}
 
-		fs.write( buffer.data(), cNumBytes * sizeof( char ));
-		fs.close();
+std::vector< unsigned char > Coverage::GetSnapshot() const
+{
+	std::vector< unsigned char > snapshot( m_ScannedNetworks.GetSerialisedSize() );
+	m_ScannedNetworks.Serialise( snapshot.data() );
+	return snapshot;
+}
+
+// Writes a full snapshot right away, which makes both journals redundant.
+void Coverage::Write()
+{
+	WaitForCompaction();
+
+	std::vector< unsigned char > snapshot = GetSnapshot();
+	if ( WriteSnapshot( snapshot ) )
+	{
+		m_Journal.Clear();
 	}
-	else
+	m_CompactionSize = m_Journal.GetSize() + cCompactionThreshold;
+}
+
+void Coverage::Sync( bool force )
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const bool sync = force || now - m_LastSync >= sSyncInterval;
+	if ( sync )
 	{
-		SDL_assert(false);
+		m_LastSync = now;
+	}
+
+	m_Journal.Flush( sync );
+	if ( m_Journal.GetSize() >= m_CompactionSize )
+	{
+		Compact();
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Coverage::Compact()
+// The journal is set aside and a copy of the scanned networks is written out
+// as the new snapshot by a background thread, while new changes go to a fresh
+// journal. The old journal is only discarded once the snapshot is durable.
+//-----------------------------------------------------------------------------
+void Coverage::Compact()
+{
+	if ( m_Compacting )
+	{
+		return;
+	}
+	WaitForCompaction();
+
+	if ( m_Journal.Rotate() == false )
+	{
+		// A previous compaction didn't complete and its journal is still around,
+		// so fold everything into a snapshot now instead.
+		Write();
+		return;
+	}
+
+	std::vector< unsigned char > snapshot = GetSnapshot();
+	m_CompactionSize = cCompactionThreshold;
+	m_Compacting = true;
+	m_CompactionThread = std::thread( CompactionThreadMain, this, std::move( snapshot ) );
+}
+
+void Coverage::CompactionThreadMain( Coverage* pCoverage, std::vector< unsigned char > snapshot )
+{
+	if ( WriteSnapshot( snapshot ) )
+	{
+		pCoverage->m_Journal.DiscardRotated();
+	}
+	pCoverage->m_Compacting = false;
+}
+
+void Coverage::WaitForCompaction()
+{
+	if ( m_CompactionThread.joinable() )
+	{
+		m_CompactionThread.join();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Coverage::WriteSnapshot()
+// Copies the snapshot into a temporary file mapped in memory, which then
+// replaces the coverage file, so a crash can't leave a partial file behind.
+//-----------------------------------------------------------------------------
+bool Coverage::WriteSnapshot( const std::vector< unsigned char >& snapshot )
+{
+	const std::string temporaryFilePath = sCoverageFilePath + ".tmp";
+
+	MappedFile file;
+	if ( file.Create( temporaryFilePath, snapshot.size() ) == false )
+	{
+		printf( "Failed to create coverage file '%s'.\n", temporaryFilePath.c_str() );
+		return false;
+	}
+
+	memcpy( file.GetData(), snapshot.data(), snapshot.size() );
+	const bool flushed = file.Flush();
+	file.Close();
+
+	if ( flushed == false || MappedFile::Replace( temporaryFilePath, sCoverageFilePath ) == false )
+	{
+		printf( "Failed to write coverage file '%s'.\n", sCoverageFilePath.c_str() );
+		return false;
+	}
+	return true;
+}
+
 void Coverage::DrawUI( bool& isWindowOpen )
 {
 	if ( !isWindowOpen )
@@ -303,6 +709,55 @@ void Coverage::DrawUI( bool& isWindowOpen )
 
 	UpdateUserInterfaceTexture();
 
-	ImGui::Image( reinterpret_cast< ImTextureID >( m_UITexture ), ImVec2( 512, 512 ) );
+	// Clicking on a row of the overview zooms into that /8.
+	const ImVec2 imagePosition = ImGui::GetCursorScreenPos();
+	const float imageSize = 512.0f;
+	ImGui::Image( reinterpret_cast< ImTextureID >( m_OverviewTexture.id ), ImVec2( imageSize, imageSize ) );
+	if ( ImGui::IsItemHovered() )
+	{
+		const ImVec2 mouse = ImGui::GetIO().MousePos;
+		const int x = std::min( cUITextureSize - 1, std::max( 0, static_cast< int >( ( mouse.x - imagePosition.x ) * cUITextureSize / imageSize ) ) );
+		const int y = std::min( cUITextureSize - 1, std::max( 0, static_cast< int >( ( mouse.y - imagePosition.y ) * cUITextureSize / imageSize ) ) );
+		ImGui::SetTooltip( "%d.%d.0.0/16", y, x );
+		if ( ImGui::IsMouseClicked( 0 ) )
+		{
+			SetZoomedNetwork( y );
+		}
+	}
+
+	DrawZoomUI();
 	ImGui::End();
 }
+
+void Coverage::DrawZoomUI()
+{
+	if ( m_ZoomedNetwork < 0 )
+	{
+		ImGui::Text( "Click on the map to view a /8 network in detail." );
+		return;
+	}
+
+	ImGui::Text( "%d.0.0.0/8, a pixel per /24 network", m_ZoomedNetwork );
+	ImGui::SameLine();
+	if ( ImGui::Button( "Close" ) )
+	{
+		SetZoomedNetwork( -1 );
+		return;
+	}
+
+	ImGui::SameLine();
+	ImGui::SliderInt( "Zoom", &m_ZoomLevel, 1, 4, "x%d" );
+	const float imageSize = static_cast< float >( cUITextureSize * m_ZoomLevel );
+
+	ImGui::BeginChild( "Zoomed network", ImVec2( 0, 0 ), false, ImGuiWindowFlags_HorizontalScrollbar );
+	const ImVec2 imagePosition = ImGui::GetCursorScreenPos();
+	ImGui::Image( reinterpret_cast< ImTextureID >( m_ZoomTexture.id ), ImVec2( imageSize, imageSize ) );
+	if ( ImGui::IsItemHovered() )
+	{
+		const ImVec2 mouse = ImGui::GetIO().MousePos;
+		const int x = std::min( cUITextureSize - 1, std::max( 0, static_cast< int >( ( mouse.x - imagePosition.x ) * cUITextureSize / imageSize ) ) );
+		const int y = std::min( cUITextureSize - 1, std::max( 0, static_cast< int >( ( mouse.y - imagePosition.y ) * cUITextureSize / imageSize ) ) );
+		ImGui::SetTooltip( "%d.%d.%d.0/24", m_ZoomedNetwork, y, x );
+	}
+	ImGui::EndChild();
+}
@@ -13,8 +13,11 @@
 // You should have received a copy of the GNU General Public License
 // along with watcher. If not, see <https://www.gnu.org/licenses/>.
 
+#include <atomic>
 #include <bitset>
+#include <chrono>
 #include <random>
+#include <thread>
 #include <vector>
 
 // Needed to include GL.h properly.
@@ -29,16 +32,28 @@
 #include <GL/gl.h>
 
 #include "network/network.h"
+#include "exclusionlist.h"
+#include "freeset.h"
+#include "progressjournal.h"
+#include "roaringbitmap.h"
 
 
 //-----------------------------------------------------------------------------
 // Coverage
-// Keeps track of which IP blocks have been scanned already and provides 
+// Keeps track of which IP blocks have been scanned already and provides the
+// next one to scan. Progress is stored as a compressed bitmap of /24 networks,
+// which is read and written through a memory mapped file.
+// Changes made since that snapshot was written go to a journal, which is
+// replayed on Read(). Once it grows large enough the journal is compacted into
+// a new snapshot, in the background.
+// Blocks made up entirely of reserved or otherwise excluded addresses are
+// never handed out.
 //-----------------------------------------------------------------------------
 class Coverage
 {
 public:
 	Coverage();
+	~Coverage();
 
 	enum class BlockState
 	{
@@ -48,33 +63,86 @@ public:
 	};
 
 	void ClearBlockStates();
+
+	// Scans are handed out a /16 block at a time...
 	BlockState GetBlockState( const Network::IPAddress& ipAddress ) const;
 	void SetBlockState( const Network::IPAddress& ipAddress, BlockState state );
 	bool GetNextBlock( Network::IPAddress& ipAddress );
 
+	// ...but progress is kept for every /24 network, so an interrupted block only
+	// needs its remaining networks scanned.
+	bool IsNetworkScanned( const Network::IPAddress& ipAddress ) const;
+	void SetNetworkScanned( const Network::IPAddress& ipAddress );
+
+	// Ends a block's scan, keeping whichever of its networks were scanned.
+	void ReleaseBlock( const Network::IPAddress& ipAddress );
+
+	const ExclusionList& GetExclusions() const;
+
 	void Read();
 	void Write();
 
+	// The scanned networks, serialised the same way as in the coverage file.
+	std::vector< unsigned char > GetSnapshot() const;
+
+	// Journals the changes made since the last call. They are made durable if
+	// "force" is set or enough time has passed.
+	void Sync( bool force );
+
 	void DrawUI( bool& isWindowOpen );
 
 private:
 	using IndexType = unsigned short;
 	IndexType IPAddressToIndex( const Network::IPAddress& ipAddress ) const;
 	Network::IPAddress IndexToIPAddress( IndexType index ) const;
-	void CreateUserInterfaceTexture();
+	uint32_t GetScannedNetworkCount( IndexType index ) const;
+	bool ReadLegacy();
+	void LoadExclusions();
+	void Compact();
+	void WaitForCompaction();
+	static bool WriteSnapshot( const std::vector< unsigned char >& snapshot );
+	static void CompactionThreadMain( Coverage* pCoverage, std::vector< unsigned char > snapshot );
+
+	// The overview has a pixel per /16 block and a row per /8. The zoomed view
+	// shows a single /8 with a pixel per /24 network, so a row per block.
+	// Only rows which have changed are rebuilt and uploaded.
+	struct UITexture
+	{
+		GLuint id;
+		std::vector< GLubyte > data; // RGB.
+		std::bitset< 256 > dirtyRows;
+	};
+	static constexpr int cUITextureSize = 256;
+	static void CreateUserInterfaceTexture( UITexture& texture, GLint filter );
+	static void UploadUserInterfaceTexture( UITexture& texture );
 	void UpdateUserInterfaceTexture();
+	void UpdateOverviewRow( int row );
+	void UpdateZoomRow( int row );
+	void SetZoomedNetwork( int network );
+	void OnBlockChanged( IndexType index );
+	void OnAllBlocksChanged();
+	void DrawZoomUI();
 
-	static constexpr size_t cCoverageFileSize = 8192;
-	static constexpr size_t cBitSetSize = 256 * 256;
-	std::bitset< cBitSetSize > m_BitSet;
-	std::vector< IndexType > m_FreeIndices;
-	bool m_HasInProgressBlock;
-	IndexType m_InProgressBlockIndex;
-	GLuint m_UITexture;
-	GLsizei m_UITextureWidth;
-	GLsizei m_UITextureHeight;
-	GLubyte* m_pUITextureData;
-	bool m_RebuildUITexture;
+	static constexpr size_t cLegacyCoverageFileSize = 8192;
+	static constexpr size_t cBlockCount = 256 * 256;
+	static constexpr uint32_t cNetworksPerBlock = 256;
+	static constexpr size_t cCompactionThreshold = 1024 * 1024;
+	RoaringBitmap m_ScannedNetworks; // Indexed by the top 24 bits of each /24 network.
+	std::vector< IndexType > m_InProgressBlocks; // Only ever holds a handful of blocks.
+	UITexture m_OverviewTexture;
+	UITexture m_ZoomTexture;
+	int m_ZoomedNetwork; // The /8 shown in the zoomed view, or -1.
+	int m_ZoomLevel;
+	std::vector< uint64_t > m_ZoomExcludedWords; // A bit per /24 network of the zoomed /8.
+	std::vector< uint64_t > m_Words; // Scratch space for the scanned networks of a /8.
+	FreeSet m_FreeBlocks; // Blocks which are neither fully scanned, excluded nor in progress.
+	ExclusionList m_Exclusions;
+	std::bitset< cBlockCount > m_ExcludedBlocks;
 	std::mt19937 m_MersenneTwister;
 	std::uniform_int_distribution<unsigned int> m_Distribution;
+	ProgressJournal m_Journal;
+	size_t m_CompactionSize; // Journal size at which the next compaction starts.
+	std::chrono::steady_clock::time_point m_LastSync;
+	std::thread m_CompactionThread;
+	std::atomic_bool m_Compacting;
 };
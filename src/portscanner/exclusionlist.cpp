@@ -0,0 +1,184 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+#include "network/network.h"
+#include "exclusionlist.h"
+
+// Special purpose ranges from RFC 6890 and its updates, plus multicast and the
+// reserved class E space.
+static const char* sReservedRanges[] =
+{
+	"0.0.0.0/8",		// "This" network
+	"10.0.0.0/8",		// Private
+	"100.64.0.0/10",	// Carrier grade NAT
+	"127.0.0.0/8",		// Loopback
+	"169.254.0.0/16",	// Link local
+	"172.16.0.0/12",	// Private
+	"192.0.0.0/24",		// IETF protocol assignments
+	"192.0.2.0/24",		// TEST-NET-1
+	"192.88.99.0/24",	// 6to4 relay anycast, deprecated
+	"192.168.0.0/16",	// Private
+	"198.18.0.0/15",	// Benchmarking
+	"198.51.100.0/24",	// TEST-NET-2
+	"203.0.113.0/24",	// TEST-NET-3
+	"224.0.0.0/4",		// Multicast
+	"240.0.0.0/4"		// Reserved, including the limited broadcast address
+};
+
+void ExclusionList::AddReserved()
+{
+	for ( const char* pRange : sReservedRanges )
+	{
+		Add( pRange );
+	}
+}
+
+void ExclusionList::Add( uint32_t baseAddress, unsigned int prefixLength )
+{
+	if ( prefixLength > 32u )
+	{
+		prefixLength = 32u;
+	}
+
+	const unsigned int bits = 32u - prefixLength;
+	const uint32_t size = static_cast< uint32_t >( ( 1ull << bits ) - 1ull );
+	Range range;
+	range.first = baseAddress & ~size;
+	range.last = range.first + size;
+
+	// Absorb every range which overlaps or touches the new one, which keeps them disjoint.
+	std::vector< Range >::iterator begin = std::lower_bound( m_Ranges.begin(), m_Ranges.end(), range,
+		[]( const Range& a, const Range& b ) { return static_cast< uint64_t >( a.last ) + 1ull < b.first; } );
+	std::vector< Range >::iterator end = begin;
+	while ( end != m_Ranges.end() && static_cast< uint64_t >( end->first ) <= static_cast< uint64_t >( range.last ) + 1ull )
+	{
+		range.first = std::min( range.first, end->first );
+		range.last = std::max( range.last, end->last );
+		++end;
+	}
+	begin = m_Ranges.erase( begin, end );
+	m_Ranges.insert( begin, range );
+}
+
+// Network::IPAddress only accepts blocks from /8 to /24, which doesn't cover the
+// likes of multicast space or single addresses, so only the address itself is
+// left to it and the prefix length is read here.
+bool ExclusionList::Add( const std::string& cidr )
+{
+	const std::string_view text( cidr );
+	const size_t separator = text.find( '/' );
+	Network::IPAddress address;
+	if ( Network::IPAddress::Parse( text.substr( 0, separator ), address ) == false || address.GetPort() != 0 )
+	{
+		return false;
+	}
+
+	unsigned int prefixLength = 32;
+	if ( separator != std::string_view::npos )
+	{
+		const std::string_view prefix = text.substr( separator + 1 );
+		if ( prefix.empty() || prefix.size() > 2 )
+		{
+			return false;
+		}
+
+		prefixLength = 0;
+		for ( char c : prefix )
+		{
+			if ( c < '0' || c > '9' )
+			{
+				return false;
+			}
+			prefixLength = prefixLength * 10 + static_cast< unsigned int >( c - '0' );
+		}
+
+		if ( prefixLength > 32 )
+		{
+			return false;
+		}
+	}
+
+	Add( address.GetHost(), prefixLength );
+	return true;
+}
+
+bool ExclusionList::Load( const std::string& path )
+{
+	std::ifstream file( path );
+	if ( file.good() == false )
+	{
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while ( std::getline( file, line ) )
+	{
+		lineNumber++;
+		const size_t comment = line.find( '#' );
+		if ( comment != std::string::npos )
+		{
+			line.erase( comment );
+		}
+
+		const size_t first = line.find_first_not_of( " \t\r" );
+		if ( first == std::string::npos )
+		{
+			continue;
+		}
+		const size_t last = line.find_last_not_of( " \t\r" );
+		const std::string cidr = line.substr( first, last - first + 1 );
+
+		if ( Add( cidr ) == false )
+		{
+			printf( "Ignoring invalid exclusion '%s' in '%s', line %d.\n", cidr.c_str(), path.c_str(), lineNumber );
+		}
+	}
+	return true;
+}
+
+void ExclusionList::Clear()
+{
+	m_Ranges.clear();
+}
+
+bool ExclusionList::IsEmpty() const
+{
+	return m_Ranges.empty();
+}
+
+bool ExclusionList::IsExcluded( uint32_t address ) const
+{
+	// First range which doesn't end before the address.
+	std::vector< Range >::const_iterator it = std::lower_bound( m_Ranges.begin(), m_Ranges.end(), address,
+		[]( const Range& range, uint32_t value ) { return range.last < value; } );
+	return it != m_Ranges.end() && it->first <= address;
+}
+
+uint64_t ExclusionList::GetExcludedCount( uint32_t first, uint32_t last ) const
+{
+	uint64_t count = 0;
+	std::vector< Range >::const_iterator it = std::lower_bound( m_Ranges.begin(), m_Ranges.end(), first,
+		[]( const Range& range, uint32_t value ) { return range.last < value; } );
+	for ( ; it != m_Ranges.end() && it->first <= last; ++it )
+	{
+		count += static_cast< uint64_t >( std::min( it->last, last ) ) - std::max( it->first, first ) + 1ull;
+	}
+	return count;
+}
@@ -0,0 +1,58 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// ExclusionList
+// Address ranges which must never be probed, such as private, loopback and
+// multicast space. Ranges are kept sorted and merged, so a lookup is a binary
+// search over a handful of entries.
+//-----------------------------------------------------------------------------
+class ExclusionList
+{
+public:
+	// Adds the reserved ranges which aren't routable on the public internet.
+	void AddReserved();
+
+	void Add( uint32_t baseAddress, unsigned int prefixLength );
+
+	// Accepts "a.b.c.d/n", or "a.b.c.d" for a single address.
+	bool Add( const std::string& cidr );
+
+	// Reads one CIDR block per line. Anything following a '#' is a comment.
+	bool Load( const std::string& path );
+
+	void Clear();
+	bool IsEmpty() const;
+
+	bool IsExcluded( uint32_t address ) const;
+
+	// How many addresses in [first, last] are excluded.
+	uint64_t GetExcludedCount( uint32_t first, uint32_t last ) const;
+
+private:
+	struct Range
+	{
+		uint32_t first;
+		uint32_t last;
+	};
+
+	std::vector< Range > m_Ranges; // Sorted, and never overlapping nor adjacent.
+};
@@ -0,0 +1,85 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <SDL.h>
+#include "freeset.h"
+
+FreeSet::FreeSet( uint32_t capacity ) :
+m_Indices( capacity ),
+m_Positions( capacity ),
+m_Size( capacity )
+{
+	for ( uint32_t i = 0; i < capacity; ++i )
+	{
+		m_Indices[ i ] = i;
+		m_Positions[ i ] = i;
+	}
+}
+
+// Any arrangement of the indices is valid, so there's nothing to rebuild.
+void FreeSet::Fill()
+{
+	m_Size = static_cast< uint32_t >( m_Indices.size() );
+}
+
+bool FreeSet::Contains( uint32_t index ) const
+{
+	SDL_assert( index < m_Positions.size() );
+	return m_Positions[ index ] < m_Size;
+}
+
+void FreeSet::Insert( uint32_t index )
+{
+	if ( Contains( index ) == false )
+	{
+		Swap( m_Positions[ index ], m_Size );
+		m_Size++;
+	}
+}
+
+void FreeSet::Remove( uint32_t index )
+{
+	if ( Contains( index ) )
+	{
+		m_Size--;
+		Swap( m_Positions[ index ], m_Size );
+	}
+}
+
+bool FreeSet::IsEmpty() const
+{
+	return m_Size == 0;
+}
+
+uint32_t FreeSet::GetSize() const
+{
+	return m_Size;
+}
+
+uint32_t FreeSet::Get( uint32_t position ) const
+{
+	SDL_assert( position < m_Size );
+	return m_Indices[ position ];
+}
+
+void FreeSet::Swap( uint32_t positionA, uint32_t positionB )
+{
+	const uint32_t indexA = m_Indices[ positionA ];
+	const uint32_t indexB = m_Indices[ positionB ];
+	m_Indices[ positionA ] = indexB;
+	m_Indices[ positionB ] = indexA;
+	m_Positions[ indexA ] = positionB;
+	m_Positions[ indexB ] = positionA;
+}
@@ -0,0 +1,55 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// FreeSet
+// Set of indices in [0, capacity) with constant time insertion, removal,
+// membership test and access by position, which makes picking a uniformly
+// random member a single lookup.
+// Every index is stored exactly once in a dense array, the members of the set
+// occupying its first GetSize() elements, alongside a map from each index to
+// its position in that array. Insertion and removal only swap an index across
+// the boundary. Costs 8 bytes per index, so 128 MB at /24 granularity.
+//-----------------------------------------------------------------------------
+class FreeSet
+{
+public:
+	FreeSet( uint32_t capacity );
+
+	// Makes every index a member.
+	void Fill();
+
+	bool Contains( uint32_t index ) const;
+	void Insert( uint32_t index );
+	void Remove( uint32_t index );
+
+	bool IsEmpty() const;
+	uint32_t GetSize() const;
+
+	// Members are in no particular order, position must be less than GetSize().
+	uint32_t Get( uint32_t position ) const;
+
+private:
+	void Swap( uint32_t positionA, uint32_t positionB );
+
+	std::vector< uint32_t > m_Indices;
+	std::vector< uint32_t > m_Positions;
+	uint32_t m_Size;
+};
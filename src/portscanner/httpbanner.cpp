@@ -0,0 +1,74 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include "httpbanner.h"
+
+// HTTP/1.0, so the response is never chunked and the server closes the connection once done.
+std::string HTTPBanner::GetRequest( const Network::IPAddress& address )
+{
+	return "GET / HTTP/1.0\r\nHost: " + address.ToString() + "\r\nUser-Agent: Mozilla/5.0\r\nAccept: text/html\r\nConnection: close\r\n\r\n";
+}
+
+void HTTPBanner::Append( std::string& banner, const char* pData, size_t size )
+{
+	for ( size_t i = 0; i < size && banner.size() < cMaxSize; ++i )
+	{
+		const unsigned char c = static_cast< unsigned char >( pData[ i ] );
+		if ( ( c >= 0x20 && c < 0x7F ) || c == '\t' || c == '\r' || c == '\n' )
+		{
+			banner.push_back( static_cast< char >( c ) );
+		}
+	}
+}
+
+bool HTTPBanner::IsComplete( const std::string& banner )
+{
+	static const std::string sTitleEndTag = "</title";
+	if ( banner.size() >= cMaxSize )
+	{
+		return true;
+	}
+
+	return std::search( banner.begin(), banner.end(), sTitleEndTag.begin(), sTitleEndTag.end(),
+		[]( char a, char b ) { return std::tolower( static_cast< unsigned char >( a ) ) == b; } ) != banner.end();
+}
+
+void HTTPBanner::Grab( Network::TCPSocket socket, const Network::IPAddress& address, std::string& banner )
+{
+	using namespace std::chrono;
+
+	banner.clear();
+	const std::string request = GetRequest( address );
+	const steady_clock::time_point deadline = steady_clock::now() + milliseconds( cTimeout );
+	if ( Network::Send( socket, request.data(), request.size(), cTimeout ) != Network::Result::Success )
+	{
+		return;
+	}
+
+	char buffer[ 1024 ];
+	while ( IsComplete( banner ) == false )
+	{
+		const auto remaining = duration_cast< milliseconds >( deadline - steady_clock::now() ).count();
+		size_t received = 0;
+		if ( remaining <= 0 || Network::Receive( socket, buffer, sizeof( buffer ), static_cast< unsigned int >( remaining ), received ) != Network::Result::Success || received == 0 )
+		{
+			return;
+		}
+		Append( banner, buffer, received );
+	}
+}
@@ -0,0 +1,47 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <network/network.h>
+
+//-----------------------------------------------------------------------------
+// HTTPBanner
+// The start of the response to a minimal "GET /", fetched on the very
+// connection which found the port open. The HTTP camera detector can then
+// read the page's title from it rather than connecting a second time.
+// Only text is kept, as the title parser skips everything else anyway.
+//-----------------------------------------------------------------------------
+class HTTPBanner
+{
+public:
+	static constexpr size_t cMaxSize = 4096;
+	static constexpr unsigned int cTimeout = 2000; // In milliseconds, for the whole exchange.
+
+	static std::string GetRequest( const Network::IPAddress& address );
+
+	// Appends what was received, up to cMaxSize.
+	static void Append( std::string& banner, const char* pData, size_t size );
+
+	// Whether there's no point waiting for more, because the title is already in
+	// or there's no room left.
+	static bool IsComplete( const std::string& banner );
+
+	// Sends the request on a connected socket and waits for the response, until it
+	// is complete, the server closes the connection or cTimeout is up.
+	static void Grab( Network::TCPSocket socket, const Network::IPAddress& address, std::string& banner );
+};
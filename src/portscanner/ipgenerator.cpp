@@ -13,63 +13,187 @@
 // You should have received a copy of the GNU General Public License
 // along with watcher. If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <random>
 #include "ipgenerator.h"
 
-IPGenerator::IPGenerator( const Network::IPAddress& ipAddress )
+IPGenerator::IPGenerator( uint32_t baseAddress, unsigned int prefixLength )
 {
-	std::lock_guard< std::mutex > lock( m_Mutex );
+	Initialise( baseAddress, prefixLength );
+}
 
-	srand( static_cast< unsigned int >( time( nullptr ) ) );
+IPGenerator::IPGenerator( const std::vector< uint32_t >& networks24, const ExclusionList* pExclusions ) :
+m_BaseAddress( 0 ),
+m_Passes( 1 )
+{
+	m_Networks.reserve( networks24.size() );
+	for ( uint32_t network : networks24 )
+	{
+		network &= 0xFFFFFF00;
+		const uint64_t excluded = ( pExclusions != nullptr ) ? pExclusions->GetExcludedCount( network, network + 0xFF ) : 0;
+		if ( excluded == 256 )
+		{
+			continue;
+		}
+		else if ( excluded > 0 )
+		{
+			for ( uint32_t address = network; address <= network + 0xFF; ++address )
+			{
+				if ( pExclusions->IsExcluded( address ) )
+				{
+					m_Exclusions.Add( address, 32u );
+				}
+			}
+		}
+		m_Networks.push_back( network );
+	}
+
+	std::random_device rd;
+	std::shuffle( m_Networks.begin(), m_Networks.end(), std::mt19937( rd() ) );
+
+	m_Count = static_cast< uint64_t >( m_Networks.size() ) * 256u;
+	m_RemainingIPs = static_cast< int64_t >( m_Count );
 
-	uint8_t block = ipAddress.GetBlock();
-	uint32_t host = ipAddress.GetHost();
+	// Addresses are permuted within a single window.
+	InitialiseKeys( 8u + 4u );
+	static_assert( cWindowNetworks == 16, "The permutation's size must match the window's" );
+}
 
-	// A CIDR block of less than 8 is meaningless - just use a single address.
-	if ( block < 8 )
+void IPGenerator::Initialise( uint32_t baseAddress, unsigned int prefixLength )
+{
+	if ( prefixLength > 32u )
 	{
-		m_PossibleIPs.push_back( host );
+		prefixLength = 32u;
 	}
-	else
+
+	// Create a mask representing the starting address for our desired block.
+	const unsigned int bits = 32u - prefixLength;
+	const uint32_t mask = static_cast< uint32_t >( ~( ( 1ull << bits ) - 1ull ) );
+	m_BaseAddress = baseAddress & mask;
+	m_Count = 1ull << bits;
+	m_Passes = 1;
+	m_RemainingIPs = static_cast< int64_t >( m_Count );
+	InitialiseKeys( bits );
+}
+
+void IPGenerator::InitialiseKeys( unsigned int bits )
+{
+	// The Feistel network needs two halves of equal size, so blocks with an odd
+	// number of bits are permuted over twice the range and cycle-walked back into it.
+	m_HalfBits = ( bits + 1u ) / 2u;
+	m_HalfMask = ( 1u << m_HalfBits ) - 1u;
+
+	std::random_device rd;
+	for ( uint32_t& key : m_Keys )
 	{
-		// Create a mask representing the starting address for our desired block.
-		uint32_t mask = ~( 0xFFFFFFFF >> block );
-		host &= mask;
-
-		// Generate the possible IP addresses we can provide.
-		// This is required because we randomise the order in which we scan addresses,
-		// so we need to keep track of what hasn't been scanned yet.
-		size_t count = 1ULL << ( 32 - block );
-		m_PossibleIPs.reserve( count );
-		for ( size_t i = 0u; i < count; ++i )
+		key = rd();
+	}
+}
+
+IPGenerator::Stride IPGenerator::GetStride( unsigned int worker, unsigned int workerCount ) const
+{
+	Stride stride;
+	stride.next = worker;
+	stride.step = workerCount > 0 ? workerCount : 1u;
+	return stride;
+}
+
+void IPGenerator::SetPassCount( unsigned int passes )
+{
+	m_Passes = ( passes > 0 ) ? passes : 1u;
+	m_RemainingIPs = static_cast< int64_t >( GetCount() );
+}
+
+bool IPGenerator::GetNext( Stride& stride, Network::IPAddress& ipAddress )
+{
+	unsigned int pass;
+	return GetNext( stride, ipAddress, pass );
+}
+
+bool IPGenerator::GetNext( Stride& stride, Network::IPAddress& ipAddress, unsigned int& pass )
+{
+	uint32_t address = 0;
+	do
+	{
+		if ( stride.next >= GetCount() )
 		{
-			m_PossibleIPs.push_back( host + static_cast< uint32_t >( i ) );
+			return false;
 		}
+
+		// Every pass visits the addresses in the same order.
+		pass = static_cast< unsigned int >( stride.next / m_Count );
+		address = GetAddress( stride.next % m_Count );
+		stride.next += stride.step;
+		m_RemainingIPs.fetch_sub( 1, std::memory_order_relaxed );
 	}
+	while ( m_Exclusions.IsEmpty() == false && m_Exclusions.IsExcluded( address ) );
+
+	ipAddress = Network::IPAddress( address, 0 );
+	return true;
+}
+
+uint64_t IPGenerator::GetCount() const
+{
+	return m_Count * m_Passes;
+}
 
-	m_RemainingIPs = m_PossibleIPs.size();
+int64_t IPGenerator::GetRemaining() const
+{
+	return m_RemainingIPs;
 }
 
-bool IPGenerator::GetNext( Network::IPAddress& ipAddress )
+uint32_t IPGenerator::GetAddress( uint64_t index ) const
 {
-	std::lock_guard< std::mutex > lock( m_Mutex );
+	if ( m_Networks.empty() )
+	{
+		return m_BaseAddress + Permute( static_cast< uint32_t >( index ), m_Count );
+	}
+
+	// Every window is full except possibly the last one.
+	const uint64_t windowSize = cWindowNetworks * 256u;
+	const size_t firstNetwork = static_cast< size_t >( index / windowSize ) * cWindowNetworks;
+	const uint64_t windowCount = std::min< uint64_t >( cWindowNetworks, m_Networks.size() - firstNetwork ) * 256u;
+	const uint32_t offset = Permute( static_cast< uint32_t >( index % windowSize ), windowCount );
+	return m_Networks[ firstNetwork + ( offset >> 8 ) ] + ( offset & 0xFF );
+}
 
-	if ( m_PossibleIPs.empty() )
+// Cycle walking: if the permuted value falls outside [0, count), keep permuting
+// until it lands back inside. This is still a bijection over the range and only
+// takes a few rounds on average, as long as the permutation's range isn't much
+// larger than the count.
+uint32_t IPGenerator::Permute( uint32_t index, uint64_t count ) const
+{
+	if ( count == 1u )
 	{
-		return false;
+		return 0u;
 	}
-	else
+
+	uint64_t value = index;
+	do
 	{
-		const size_t numAddresses = m_PossibleIPs.size();
-		const size_t idx = rand() % numAddresses;
-		ipAddress = Network::IPAddress( m_PossibleIPs[ idx ], 0 );
-		std::swap( m_PossibleIPs[ idx ], m_PossibleIPs[ numAddresses - 1 ] );
-		m_PossibleIPs.pop_back();
-		m_RemainingIPs--;
-		return true;
+		value = Feistel( static_cast< uint32_t >( value ) );
 	}
+	while ( value >= count );
+	return static_cast< uint32_t >( value );
 }
 
-int IPGenerator::GetRemaining() const
+uint32_t IPGenerator::Feistel( uint32_t value ) const
 {
-	return m_RemainingIPs;
+	uint32_t left = ( value >> m_HalfBits ) & m_HalfMask;
+	uint32_t right = value & m_HalfMask;
+	for ( uint32_t key : m_Keys )
+	{
+		// Round function: MurmurHash3's finaliser over the right half and the round key.
+		uint32_t f = right ^ key;
+		f ^= f >> 16;
+		f *= 0x85EBCA6B;
+		f ^= f >> 13;
+		f *= 0xC2B2AE35;
+		f ^= f >> 16;
+
+		const uint32_t newRight = left ^ ( f & m_HalfMask );
+		left = right;
+		right = newRight;
+	}
+	return ( left << m_HalfBits ) | right;
 }
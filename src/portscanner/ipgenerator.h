@@ -15,24 +15,73 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <cstdint>
-#include <mutex>
 #include <vector>
 #include <network/network.h>
+#include "exclusionlist.h"
 
+//-----------------------------------------------------------------------------
+// IPGenerator
+// Visits every address in a CIDR block exactly once, in a pseudo-random order.
+// The order comes from a keyed Feistel network which permutes the offsets
+// within the block, so no per-address state is kept and any block size, up to
+// the whole IPv4 address space, costs the same few bytes.
+// Each worker walks its own Stride, a disjoint slice of the permutation,
+// which requires no locking.
+// Alternatively, the generator can visit a list of /24 networks. These are
+// shuffled and scanned a window of cWindowNetworks at a time, the addresses
+// within a window being permuted the same way. Networks are then finished
+// steadily throughout the scan rather than all at the very end, so progress
+// can be recorded per network. Networks which are entirely excluded are
+// dropped up front, and only those which are partly excluded have their
+// addresses checked as they are generated.
+// The whole sequence can be visited several times over, in consecutive passes,
+// such as once per port when scanning in port-major order.
+//-----------------------------------------------------------------------------
 class IPGenerator
 {
 public:
-	IPGenerator() {}
-	IPGenerator( const Network::IPAddress& address );
+	IPGenerator( uint32_t baseAddress, unsigned int prefixLength );
+	IPGenerator( const std::vector< uint32_t >& networks24, const ExclusionList* pExclusions = nullptr );
 
-	bool GetNext( Network::IPAddress& address );
-	int GetRemaining() const;
+	static constexpr uint32_t cWindowNetworks = 16;
+
+	struct Stride
+	{
+		uint64_t next;
+		uint64_t step;
+	};
+
+	// Worker "worker" out of "workerCount" visits the permutation indices
+	// worker, worker + workerCount, worker + 2 * workerCount, etc.
+	Stride GetStride( unsigned int worker, unsigned int workerCount ) const;
+	bool GetNext( Stride& stride, Network::IPAddress& address );
+	bool GetNext( Stride& stride, Network::IPAddress& address, unsigned int& pass );
+
+	// Must be called before any address is generated.
+	void SetPassCount( unsigned int passes );
+
+	// How many addresses are visited, across all the passes.
+	uint64_t GetCount() const;
+	int64_t GetRemaining() const;
 
 private:
-	std::mutex m_Mutex;
-	using PossibleIPs = std::vector< uint32_t >;
-	PossibleIPs m_PossibleIPs;
-	std::atomic_int m_RemainingIPs;
+	void Initialise( uint32_t baseAddress, unsigned int prefixLength );
+	void InitialiseKeys( unsigned int bits );
+	uint32_t GetAddress( uint64_t index ) const;
+	uint32_t Permute( uint32_t index, uint64_t count ) const;
+	uint32_t Feistel( uint32_t value ) const;
+
+	static constexpr size_t cRounds = 4;
+	uint32_t m_BaseAddress;
+	std::vector< uint32_t > m_Networks; // Shuffled /24 networks, if scanning a list of them.
+	ExclusionList m_Exclusions; // Only the excluded addresses within partly excluded networks.
+	uint64_t m_Count; // In a single pass.
+	unsigned int m_Passes;
+	unsigned int m_HalfBits;
+	uint32_t m_HalfMask;
+	std::array< uint32_t, cRounds > m_Keys;
+	std::atomic< int64_t > m_RemainingIPs;
 };
@@ -0,0 +1,321 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdio>
+#include "leaseclient.h"
+
+LeaseClient::LeaseClient() :
+m_Stop( false ),
+m_Connected( false ),
+m_Socket( -1 ),
+m_LeaseWanted( false ),
+m_Exhausted( false )
+{
+
+}
+
+LeaseClient::~LeaseClient()
+{
+	Stop();
+}
+
+void LeaseClient::Start( const Network::IPAddress& coordinator, std::vector< unsigned char > coverage )
+{
+	Stop();
+
+	m_Coordinator = coordinator;
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Coverage = std::move( coverage );
+		m_LeaseWanted = false;
+		m_Exhausted = false;
+	}
+	m_Stop = false;
+	m_Thread = std::thread( &LeaseClient::ThreadMain, this );
+}
+
+void LeaseClient::Stop()
+{
+	m_Stop = true;
+	m_Condition.notify_all();
+	if ( m_Thread.joinable() )
+	{
+		m_Thread.join();
+	}
+}
+
+bool LeaseClient::IsRunning() const
+{
+	return m_Thread.joinable();
+}
+
+LeaseClient::LeaseResult LeaseClient::GetLease( Lease& lease )
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	if ( m_Granted.empty() == false )
+	{
+		lease = m_Granted.front();
+		m_Granted.pop_front();
+		return LeaseResult::Granted;
+	}
+	else if ( m_Exhausted )
+	{
+		// Only said once, as leases which expire make blocks available again.
+		m_Exhausted = false;
+		return LeaseResult::Exhausted;
+	}
+
+	m_LeaseWanted = true;
+	m_Condition.notify_all();
+	return LeaseResult::Pending;
+}
+
+void LeaseClient::Report( const Network::IPAddress& block, const LeaseMessage::NetworkBitmap& scanned, bool complete )
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_Reports.push_back( { block.GetHost(), scanned, complete } );
+	m_Condition.notify_all();
+}
+
+bool LeaseClient::IsConnected() const
+{
+	return m_Connected;
+}
+
+int LeaseClient::GetHeldLeaseCount() const
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	return static_cast< int >( m_Held.size() );
+}
+
+Network::IPAddress LeaseClient::GetCoordinator() const
+{
+	return m_Coordinator;
+}
+
+//-----------------------------------------------------------------------------
+// LeaseClient::ThreadMain()
+// Reports go first so that finished blocks are released as soon as possible,
+// then a lease is asked for if one is wanted, then any which are due are
+// renewed. If anything fails the connection is dropped and made again.
+//-----------------------------------------------------------------------------
+void LeaseClient::ThreadMain()
+{
+	while ( m_Stop == false )
+	{
+		if ( m_Connected == false && Connect() == false )
+		{
+			std::unique_lock< std::mutex > lock( m_Mutex );
+			m_Condition.wait_for( lock, cRetryInterval, [ this ]() { return m_Stop.load(); } );
+			continue;
+		}
+
+		if ( SendReports() == false || RequestLease() == false || RenewLeases() == false )
+		{
+			Disconnect();
+			continue;
+		}
+
+		std::unique_lock< std::mutex > lock( m_Mutex );
+		Clock::time_point wakeUp = Clock::now() + cRetryInterval;
+		for ( const HeldLease& held : m_Held )
+		{
+			wakeUp = std::min( wakeUp, held.renewal );
+		}
+		m_Condition.wait_until( lock, wakeUp, [ this ]() { return m_Stop || m_LeaseWanted || m_Reports.empty() == false; } );
+	}
+
+	// Leases which were granted but never picked up are given back along with the rest.
+	bool hasReports = false;
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		for ( const Lease& lease : m_Granted )
+		{
+			m_Reports.push_back( { lease.block.GetHost(), lease.scanned, false } );
+		}
+		m_Granted.clear();
+		m_LeaseWanted = false;
+		hasReports = ( m_Reports.empty() == false );
+	}
+
+	if ( hasReports && ( m_Connected || Connect() ) )
+	{
+		SendReports();
+	}
+	Disconnect();
+}
+
+bool LeaseClient::Connect()
+{
+	const Network::Result result = Network::ConnectTCP( m_Coordinator, cConnectTimeout, m_Socket );
+	if ( result != Network::Result::Success )
+	{
+		m_Socket = -1;
+		return false;
+	}
+	m_Received.clear();
+	m_Connected = true;
+
+	std::vector< unsigned char > coverage;
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		coverage.swap( m_Coverage );
+	}
+
+	if ( coverage.empty() == false )
+	{
+		LeaseMessage merge( LeaseMessage::Type::Merge );
+		merge.WriteBytes( coverage.data(), coverage.size() );
+		LeaseMessage reply;
+		if ( Exchange( merge, reply ) == false )
+		{
+			std::lock_guard< std::mutex > lock( m_Mutex );
+			m_Coverage.swap( coverage );
+			Disconnect();
+			return false;
+		}
+	}
+
+	printf( "Connected to lease coordinator %s.\n", m_Coordinator.ToString().c_str() );
+	return true;
+}
+
+void LeaseClient::Disconnect()
+{
+	if ( m_Socket != -1 )
+	{
+		Network::Close( m_Socket );
+		m_Socket = -1;
+	}
+	m_Received.clear();
+	m_Connected = false;
+}
+
+bool LeaseClient::Exchange( const LeaseMessage& request, LeaseMessage& reply )
+{
+	return request.Send( m_Socket, cReplyTimeout ) == Network::Result::Success &&
+		LeaseMessage::Receive( m_Socket, m_Received, reply, cReplyTimeout ) == Network::Result::Success;
+}
+
+bool LeaseClient::SendReports()
+{
+	while ( true )
+	{
+		PendingReport report;
+		{
+			std::lock_guard< std::mutex > lock( m_Mutex );
+			if ( m_Reports.empty() )
+			{
+				return true;
+			}
+			report = m_Reports.front();
+		}
+
+		LeaseMessage request( LeaseMessage::Type::Report );
+		request.Write32( report.block );
+		request.Write8( report.complete ? 1 : 0 );
+		request.WriteBitmap( report.scanned );
+		LeaseMessage reply;
+		if ( Exchange( request, reply ) == false )
+		{
+			return false;
+		}
+
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Reports.pop_front();
+		m_Held.erase( std::remove_if( m_Held.begin(), m_Held.end(), [ &report ]( const HeldLease& held ) { return held.block == report.block; } ), m_Held.end() );
+	}
+}
+
+bool LeaseClient::RequestLease()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		if ( m_LeaseWanted == false )
+		{
+			return true;
+		}
+	}
+
+	LeaseMessage reply;
+	if ( Exchange( LeaseMessage( LeaseMessage::Type::RequestLease ), reply ) == false )
+	{
+		return false;
+	}
+
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_LeaseWanted = false;
+	uint32_t block = 0;
+	uint32_t duration = 0;
+	Lease lease;
+	if ( reply.GetType() == LeaseMessage::Type::Lease && reply.Read32( block ) && reply.Read32( duration ) && reply.ReadBitmap( lease.scanned ) )
+	{
+		lease.block = Network::IPAddress( block, 0 );
+		lease.block.SetBlock( 16 );
+		m_Granted.push_back( lease );
+
+		const Clock::duration interval = std::chrono::milliseconds( duration / 3 );
+		m_Held.push_back( { block, interval, Clock::now() + interval } );
+	}
+	else if ( reply.GetType() == LeaseMessage::Type::NoLease )
+	{
+		m_Exhausted = true;
+	}
+	return true;
+}
+
+bool LeaseClient::RenewLeases()
+{
+	std::vector< uint32_t > dueBlocks;
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		const Clock::time_point now = Clock::now();
+		for ( const HeldLease& held : m_Held )
+		{
+			if ( held.renewal <= now )
+			{
+				dueBlocks.push_back( held.block );
+			}
+		}
+	}
+
+	for ( uint32_t block : dueBlocks )
+	{
+		LeaseMessage request( LeaseMessage::Type::RenewLease );
+		request.Write32( block );
+		LeaseMessage reply;
+		uint8_t renewed = 0;
+		if ( Exchange( request, reply ) == false )
+		{
+			return false;
+		}
+		else if ( reply.Read8( renewed ) == false || renewed == 0 )
+		{
+			// It's kept, as the coordinator gives it back if nobody else has taken it meanwhile.
+			printf( "Lease on %s/16 was lost, it may be scanned twice.\n", Network::IPAddress( block, 0 ).GetHostAsString().c_str() );
+		}
+
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		for ( HeldLease& held : m_Held )
+		{
+			if ( held.block == block )
+			{
+				held.renewal = Clock::now() + held.interval;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,116 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <network/network.h>
+
+#include "leasemessage.h"
+
+//-----------------------------------------------------------------------------
+// LeaseClient
+// Gets blocks to scan from a LeaseCoordinator rather than from the local
+// coverage. Talking to the coordinator happens on the client's own thread,
+// so the main thread only ever queues requests and picks up what came back.
+// Leases are renewed for as long as they're held, that is until the block
+// they're for is reported.
+//-----------------------------------------------------------------------------
+class LeaseClient
+{
+public:
+	struct Lease
+	{
+		Network::IPAddress block;
+		LeaseMessage::NetworkBitmap scanned; // Networks the coordinator already knows were scanned.
+	};
+
+	enum class LeaseResult
+	{
+		Granted,
+		Pending, // Asked for, try again later.
+		Exhausted // Every block is either scanned or leased by someone else.
+	};
+
+	LeaseClient();
+	~LeaseClient();
+
+	// The coverage, serialised, is merged into the coordinator's once connected.
+	void Start( const Network::IPAddress& coordinator, std::vector< unsigned char > coverage );
+
+	// Reports which are still queued are sent first, unless the coordinator can't be reached.
+	void Stop();
+	bool IsRunning() const;
+
+	// Called on the main thread.
+	LeaseResult GetLease( Lease& lease );
+	void Report( const Network::IPAddress& block, const LeaseMessage::NetworkBitmap& scanned, bool complete );
+
+	bool IsConnected() const;
+	int GetHeldLeaseCount() const;
+	Network::IPAddress GetCoordinator() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct HeldLease
+	{
+		uint32_t block;
+		Clock::duration interval; // A third of how long the coordinator leases blocks for.
+		Clock::time_point renewal; // When it is next due to be renewed.
+	};
+
+	struct PendingReport
+	{
+		uint32_t block;
+		LeaseMessage::NetworkBitmap scanned;
+		bool complete;
+	};
+
+	void ThreadMain();
+	bool Connect();
+	void Disconnect();
+	bool Exchange( const LeaseMessage& request, LeaseMessage& reply );
+	bool SendReports();
+	bool RequestLease();
+	bool RenewLeases();
+
+	static constexpr unsigned int cConnectTimeout = 2000; // In milliseconds.
+	static constexpr unsigned int cReplyTimeout = 5000;
+	static constexpr std::chrono::seconds cRetryInterval = std::chrono::seconds( 1 );
+
+	Network::IPAddress m_Coordinator;
+	std::thread m_Thread;
+	std::atomic_bool m_Stop;
+	std::atomic_bool m_Connected;
+	Network::TCPSocket m_Socket;
+	std::vector< unsigned char > m_Received;
+
+	// Shared with the main thread.
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::vector< unsigned char > m_Coverage; // Still to be merged.
+	bool m_LeaseWanted;
+	bool m_Exhausted;
+	std::deque< Lease > m_Granted;
+	std::deque< PendingReport > m_Reports;
+	std::vector< HeldLease > m_Held;
+};
@@ -0,0 +1,413 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <cstdio>
+#include "leasecoordinator.h"
+#include "mappedfile.h"
+
+static const std::string sCoordinatorFilePath( "plugins/portscanner/coordinator24" );
+static const std::string sExclusionsFilePath( "plugins/portscanner/exclusions.txt" );
+static const std::chrono::seconds sSaveInterval( 10 );
+
+LeaseCoordinator::LeaseCoordinator() :
+m_ListenSocket( -1 ),
+m_Stop( false ),
+m_Running( false ),
+m_FreeBlocks( cBlockCount ),
+m_MersenneTwister( std::random_device()() ),
+m_Changed( false ),
+m_ClientCount( 0 ),
+m_LeaseCount( 0 ),
+m_FreeBlockCount( 0 ),
+m_ScannedNetworkCount( 0 )
+{
+
+}
+
+LeaseCoordinator::~LeaseCoordinator()
+{
+	Stop();
+}
+
+bool LeaseCoordinator::Start( uint16_t port, bool loopbackOnly )
+{
+	if ( IsRunning() )
+	{
+		return true;
+	}
+
+	const Network::Result result = Network::ListenTCP( port, loopbackOnly, m_ListenSocket );
+	if ( result != Network::Result::Success )
+	{
+		printf( "Lease coordinator failed to listen on port %u: %s\n", static_cast< unsigned int >( port ), Network::ToString( result ).c_str() );
+		return false;
+	}
+
+	m_Stop = false;
+	m_Running = true;
+	m_Thread = std::thread( &LeaseCoordinator::ThreadMain, this );
+	return true;
+}
+
+void LeaseCoordinator::Stop()
+{
+	m_Stop = true;
+	if ( m_Thread.joinable() )
+	{
+		m_Thread.join();
+	}
+}
+
+bool LeaseCoordinator::IsRunning() const
+{
+	return m_Running;
+}
+
+int LeaseCoordinator::GetClientCount() const
+{
+	return m_ClientCount;
+}
+
+int LeaseCoordinator::GetLeaseCount() const
+{
+	return m_LeaseCount;
+}
+
+uint32_t LeaseCoordinator::GetFreeBlockCount() const
+{
+	return m_FreeBlockCount;
+}
+
+uint64_t LeaseCoordinator::GetScannedNetworkCount() const
+{
+	return m_ScannedNetworkCount;
+}
+
+//-----------------------------------------------------------------------------
+// LeaseCoordinator::ThreadMain()
+// Accepts connections, and in between expires leases and saves the coverage.
+// Clients which have gone away are cleaned up; their leases are kept until
+// they expire, in case they reconnect.
+//-----------------------------------------------------------------------------
+void LeaseCoordinator::ThreadMain()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		Load();
+	}
+
+	while ( m_Stop == false )
+	{
+		Network::TCPSocket socket;
+		Network::IPAddress address;
+		if ( Network::AcceptTCP( m_ListenSocket, cPollInterval, socket, address ) == Network::Result::Success )
+		{
+			ClientUniquePtr pClient = std::make_unique< Client >();
+			pClient->socket = socket;
+			pClient->address = address;
+			pClient->done = false;
+			pClient->thread = std::thread( &LeaseCoordinator::ClientThreadMain, this, pClient.get() );
+			m_Clients.push_back( std::move( pClient ) );
+		}
+
+		for ( std::vector< ClientUniquePtr >::iterator it = m_Clients.begin(); it != m_Clients.end(); )
+		{
+			if ( ( *it )->done )
+			{
+				( *it )->thread.join();
+				it = m_Clients.erase( it );
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		ExpireLeases();
+		if ( m_Changed && Clock::now() - m_LastSave >= sSaveInterval )
+		{
+			Save();
+		}
+
+		m_ClientCount = static_cast< int >( m_Clients.size() );
+		m_LeaseCount = static_cast< int >( m_Leases.size() );
+		m_FreeBlockCount = m_FreeBlocks.GetSize();
+		m_ScannedNetworkCount = m_ScannedNetworks.GetCardinality();
+	}
+
+	for ( ClientUniquePtr& pClient : m_Clients )
+	{
+		pClient->thread.join();
+	}
+	m_Clients.clear();
+
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	if ( m_Changed )
+	{
+		Save();
+	}
+	m_Leases.clear();
+	Network::Close( m_ListenSocket );
+	m_ListenSocket = -1;
+	m_Running = false;
+}
+
+// Answers the client's requests until it goes away or the coordinator stops.
+void LeaseCoordinator::ClientThreadMain( Client* pClient )
+{
+	std::vector< unsigned char > received;
+	while ( m_Stop == false )
+	{
+		LeaseMessage request;
+		const Network::Result result = LeaseMessage::Receive( pClient->socket, received, request, cPollInterval );
+		if ( result == Network::Result::Timeout )
+		{
+			continue;
+		}
+		else if ( result != Network::Result::Success )
+		{
+			if ( result == Network::Result::Invalid )
+			{
+				printf( "Lease coordinator received an invalid message from %s.\n", pClient->address.ToString().c_str() );
+			}
+			break;
+		}
+
+		LeaseMessage reply( LeaseMessage::Type::Acknowledged );
+		{
+			std::lock_guard< std::mutex > lock( m_Mutex );
+			OnMessage( request, reply );
+		}
+
+		if ( reply.Send( pClient->socket, cReplyTimeout ) != Network::Result::Success )
+		{
+			break;
+		}
+	}
+
+	Network::Close( pClient->socket );
+	pClient->done = true;
+}
+
+void LeaseCoordinator::OnMessage( LeaseMessage& request, LeaseMessage& reply )
+{
+	switch ( request.GetType() )
+	{
+	case LeaseMessage::Type::RequestLease:
+		OnRequestLease( reply );
+		break;
+	case LeaseMessage::Type::RenewLease:
+		OnRenewLease( request, reply );
+		break;
+	case LeaseMessage::Type::Report:
+		OnReport( request );
+		break;
+	case LeaseMessage::Type::Merge:
+		OnMerge( request );
+		break;
+	default:
+		break;
+	}
+}
+
+void LeaseCoordinator::OnRequestLease( LeaseMessage& reply )
+{
+	if ( m_FreeBlocks.IsEmpty() )
+	{
+		reply = LeaseMessage( LeaseMessage::Type::NoLease );
+		return;
+	}
+
+	const uint16_t block = static_cast< uint16_t >( m_FreeBlocks.Get( m_MersenneTwister() % m_FreeBlocks.GetSize() ) );
+	m_FreeBlocks.Remove( block );
+	m_Leases[ block ] = Clock::now() + std::chrono::milliseconds( cLeaseDuration );
+
+	reply = LeaseMessage( LeaseMessage::Type::Lease );
+	reply.Write32( static_cast< uint32_t >( block ) << 16 );
+	reply.Write32( cLeaseDuration );
+	reply.WriteBitmap( GetScannedNetworks( block ) );
+}
+
+// A lease which has lapsed can still be renewed, as long as nobody else has been given the block since.
+void LeaseCoordinator::OnRenewLease( LeaseMessage& request, LeaseMessage& reply )
+{
+	uint32_t address = 0;
+	bool renewed = false;
+	if ( request.Read32( address ) )
+	{
+		const uint16_t block = static_cast< uint16_t >( address >> 16 );
+		if ( m_Leases.find( block ) != m_Leases.end() || m_FreeBlocks.Contains( block ) )
+		{
+			m_FreeBlocks.Remove( block );
+			m_Leases[ block ] = Clock::now() + std::chrono::milliseconds( cLeaseDuration );
+			renewed = true;
+		}
+	}
+
+	reply = LeaseMessage( LeaseMessage::Type::Renewed );
+	reply.Write8( renewed ? 1 : 0 );
+}
+
+void LeaseCoordinator::OnReport( LeaseMessage& request )
+{
+	uint32_t address = 0;
+	uint8_t complete = 0;
+	LeaseMessage::NetworkBitmap scanned;
+	if ( request.Read32( address ) == false || request.Read8( complete ) == false || request.ReadBitmap( scanned ) == false )
+	{
+		return;
+	}
+
+	const uint16_t block = static_cast< uint16_t >( address >> 16 );
+	const uint32_t firstNetwork = static_cast< uint32_t >( block ) * cNetworksPerBlock;
+	for ( uint32_t i = 0; i < cNetworksPerBlock; ++i )
+	{
+		if ( complete != 0 || scanned[ i ] )
+		{
+			m_ScannedNetworks.Add( firstNetwork + i );
+		}
+	}
+
+	m_Leases.erase( block );
+	ReleaseBlock( block );
+	m_Changed = true;
+}
+
+void LeaseCoordinator::OnMerge( LeaseMessage& request )
+{
+	size_t size = 0;
+	const unsigned char* pData = request.GetRemaining( size );
+	RoaringBitmap scannedNetworks;
+	if ( scannedNetworks.Deserialise( pData, size ) == false )
+	{
+		printf( "Lease coordinator received invalid coverage to merge.\n" );
+		return;
+	}
+
+	scannedNetworks.ForEach( [ this ]( uint32_t network ) { m_ScannedNetworks.Add( network ); } );
+	for ( uint32_t block = 0; block < cBlockCount; ++block )
+	{
+		if ( m_FreeBlocks.Contains( block ) && IsBlockScanned( static_cast< uint16_t >( block ) ) )
+		{
+			m_FreeBlocks.Remove( block );
+		}
+	}
+	m_Changed = true;
+}
+
+void LeaseCoordinator::ExpireLeases()
+{
+	const Clock::time_point now = Clock::now();
+	for ( std::unordered_map< uint16_t, Clock::time_point >::iterator it = m_Leases.begin(); it != m_Leases.end(); )
+	{
+		if ( it->second <= now )
+		{
+			const uint16_t block = it->first;
+			it = m_Leases.erase( it );
+			ReleaseBlock( block );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+// Makes a block which is no longer leased available again, unless there's nothing left to scan in it.
+void LeaseCoordinator::ReleaseBlock( uint16_t block )
+{
+	if ( m_ExcludedBlocks[ block ] == false && IsBlockScanned( block ) == false && m_FreeBlocks.Contains( block ) == false )
+	{
+		m_FreeBlocks.Insert( block );
+	}
+}
+
+LeaseMessage::NetworkBitmap LeaseCoordinator::GetScannedNetworks( uint16_t block ) const
+{
+	uint64_t words[ cNetworksPerBlock / 64 ];
+	m_ScannedNetworks.GetWords( static_cast< uint32_t >( block ) * cNetworksPerBlock, cNetworksPerBlock / 64, words );
+
+	LeaseMessage::NetworkBitmap scanned;
+	for ( uint32_t i = 0; i < cNetworksPerBlock; ++i )
+	{
+		scanned[ i ] = ( words[ i / 64 ] >> ( i % 64 ) ) & 1;
+	}
+	return scanned;
+}
+
+bool LeaseCoordinator::IsBlockScanned( uint16_t block ) const
+{
+	const uint64_t firstNetwork = static_cast< uint64_t >( block ) * cNetworksPerBlock;
+	return m_ScannedNetworks.GetCardinality( firstNetwork, firstNetwork + cNetworksPerBlock ) == cNetworksPerBlock;
+}
+
+// Blocks made up entirely of excluded addresses are never handed out, the same as with Coverage.
+void LeaseCoordinator::Load()
+{
+	m_Exclusions.Clear();
+	m_Exclusions.AddReserved();
+	m_Exclusions.Load( sExclusionsFilePath );
+
+	m_ScannedNetworks.Clear();
+	MappedFile file;
+	if ( file.OpenForReading( sCoordinatorFilePath ) )
+	{
+		if ( m_ScannedNetworks.Deserialise( file.GetData(), file.GetSize() ) == false )
+		{
+			printf( "Coordinator coverage file '%s' is corrupt, ignoring it.\n", sCoordinatorFilePath.c_str() );
+			m_ScannedNetworks.Clear();
+		}
+		file.Close();
+	}
+
+	m_FreeBlocks.Fill();
+	for ( uint32_t block = 0; block < cBlockCount; ++block )
+	{
+		const uint32_t first = block << 16;
+		m_ExcludedBlocks[ block ] = ( m_Exclusions.GetExcludedCount( first, first | 0xFFFF ) == 0x10000 );
+		if ( m_ExcludedBlocks[ block ] || IsBlockScanned( static_cast< uint16_t >( block ) ) )
+		{
+			m_FreeBlocks.Remove( block );
+		}
+	}
+	m_Changed = false;
+	m_LastSave = Clock::now();
+}
+
+// Written to a temporary file first, which then replaces the previous one. A
+// failed save is tried again after the usual interval.
+void LeaseCoordinator::Save()
+{
+	m_LastSave = Clock::now();
+	const std::string temporaryFilePath = sCoordinatorFilePath + ".tmp";
+	MappedFile file;
+	if ( file.Create( temporaryFilePath, m_ScannedNetworks.GetSerialisedSize() ) == false )
+	{
+		printf( "Failed to create coordinator coverage file '%s'.\n", temporaryFilePath.c_str() );
+		return;
+	}
+
+	m_ScannedNetworks.Serialise( file.GetData() );
+	const bool flushed = file.Flush();
+	file.Close();
+
+	if ( flushed == false || MappedFile::Replace( temporaryFilePath, sCoordinatorFilePath ) == false )
+	{
+		printf( "Failed to write coordinator coverage file '%s'.\n", sCoordinatorFilePath.c_str() );
+		return;
+	}
+	m_Changed = false;
+}
@@ -0,0 +1,121 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <network/network.h>
+
+#include "exclusionlist.h"
+#include "freeset.h"
+#include "leasemessage.h"
+#include "roaringbitmap.h"
+
+//-----------------------------------------------------------------------------
+// LeaseCoordinator
+// Hands out /16 blocks to scanners on several hosts, so that they share one
+// coverage and never scan the same block at the same time. A block is leased
+// for a limited time, which the scanner renews while it works on it; blocks
+// whose lease runs out go back to being free, so a scanner which disappears
+// only delays its blocks.
+// Scanners report which of a block's networks they scanned once they're done
+// with it, and can merge whatever coverage they had beforehand. The merged
+// coverage is saved periodically, in the same format as Coverage's snapshots.
+// Every client is served by a thread of its own, as there are only ever a
+// handful, and another accepts connections and expires leases.
+//-----------------------------------------------------------------------------
+class LeaseCoordinator
+{
+public:
+	static constexpr uint16_t cDefaultPort = 27960;
+	static constexpr unsigned int cLeaseDuration = 60000; // In milliseconds.
+
+	LeaseCoordinator();
+	~LeaseCoordinator();
+
+	bool Start( uint16_t port, bool loopbackOnly );
+	void Stop();
+	bool IsRunning() const;
+
+	// Can be called from any thread.
+	int GetClientCount() const;
+	int GetLeaseCount() const;
+	uint32_t GetFreeBlockCount() const;
+	uint64_t GetScannedNetworkCount() const;
+
+private:
+	struct Client
+	{
+		Network::TCPSocket socket;
+		Network::IPAddress address;
+		std::thread thread;
+		std::atomic_bool done;
+	};
+	using ClientUniquePtr = std::unique_ptr< Client >;
+
+	using Clock = std::chrono::steady_clock;
+
+	void ThreadMain();
+	void ClientThreadMain( Client* pClient );
+	void OnMessage( LeaseMessage& request, LeaseMessage& reply );
+	void OnRequestLease( LeaseMessage& reply );
+	void OnRenewLease( LeaseMessage& request, LeaseMessage& reply );
+	void OnReport( LeaseMessage& request );
+	void OnMerge( LeaseMessage& request );
+	void ExpireLeases();
+	void ReleaseBlock( uint16_t block );
+	LeaseMessage::NetworkBitmap GetScannedNetworks( uint16_t block ) const;
+	bool IsBlockScanned( uint16_t block ) const;
+	void Load();
+	void Save();
+
+	static constexpr size_t cBlockCount = 256 * 256;
+	static constexpr uint32_t cNetworksPerBlock = 256;
+	static constexpr unsigned int cReplyTimeout = 2000; // In milliseconds.
+	static constexpr unsigned int cPollInterval = 100; // How often waiting threads check whether to stop.
+
+	Network::TCPSocket m_ListenSocket;
+	std::thread m_Thread;
+	std::atomic_bool m_Stop;
+	std::atomic_bool m_Running;
+	std::vector< ClientUniquePtr > m_Clients; // Only touched by the accepting thread.
+
+	// Shared by every thread, under m_Mutex.
+	std::mutex m_Mutex;
+	RoaringBitmap m_ScannedNetworks; // Indexed by the top 24 bits of each /24 network.
+	FreeSet m_FreeBlocks; // Neither fully scanned, excluded nor leased.
+	ExclusionList m_Exclusions;
+	std::bitset< cBlockCount > m_ExcludedBlocks;
+	std::unordered_map< uint16_t, Clock::time_point > m_Leases; // Block to its expiry.
+	std::mt19937 m_MersenneTwister;
+	bool m_Changed;
+	Clock::time_point m_LastSave;
+
+	// Copies for the UI.
+	std::atomic_int m_ClientCount;
+	std::atomic_int m_LeaseCount;
+	std::atomic_uint32_t m_FreeBlockCount;
+	std::atomic< uint64_t > m_ScannedNetworkCount;
+};
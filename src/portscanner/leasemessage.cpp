@@ -0,0 +1,181 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include "leasemessage.h"
+
+LeaseMessage::LeaseMessage( Type type ) :
+m_Type( type ),
+m_ReadPosition( 0 )
+{
+
+}
+
+LeaseMessage::Type LeaseMessage::GetType() const
+{
+	return m_Type;
+}
+
+void LeaseMessage::Write8( uint8_t value )
+{
+	m_Payload.push_back( value );
+}
+
+void LeaseMessage::Write32( uint32_t value )
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		m_Payload.push_back( static_cast< unsigned char >( value >> ( i * 8 ) ) );
+	}
+}
+
+void LeaseMessage::WriteBitmap( const NetworkBitmap& bitmap )
+{
+	for ( size_t i = 0; i < bitmap.size(); i += 8 )
+	{
+		unsigned char byte = 0;
+		for ( size_t bit = 0; bit < 8; ++bit )
+		{
+			byte |= bitmap[ i + bit ] ? ( 1 << bit ) : 0;
+		}
+		m_Payload.push_back( byte );
+	}
+}
+
+void LeaseMessage::WriteBytes( const unsigned char* pData, size_t size )
+{
+	m_Payload.insert( m_Payload.end(), pData, pData + size );
+}
+
+bool LeaseMessage::Read8( uint8_t& value )
+{
+	if ( m_ReadPosition + 1 > m_Payload.size() )
+	{
+		return false;
+	}
+	value = m_Payload[ m_ReadPosition++ ];
+	return true;
+}
+
+bool LeaseMessage::Read32( uint32_t& value )
+{
+	if ( m_ReadPosition + 4 > m_Payload.size() )
+	{
+		return false;
+	}
+
+	value = 0;
+	for ( int i = 0; i < 4; ++i )
+	{
+		value |= static_cast< uint32_t >( m_Payload[ m_ReadPosition++ ] ) << ( i * 8 );
+	}
+	return true;
+}
+
+bool LeaseMessage::ReadBitmap( NetworkBitmap& bitmap )
+{
+	if ( m_ReadPosition + bitmap.size() / 8 > m_Payload.size() )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < bitmap.size(); i += 8 )
+	{
+		const unsigned char byte = m_Payload[ m_ReadPosition++ ];
+		for ( size_t bit = 0; bit < 8; ++bit )
+		{
+			bitmap[ i + bit ] = ( byte >> bit ) & 1;
+		}
+	}
+	return true;
+}
+
+const unsigned char* LeaseMessage::GetRemaining( size_t& size ) const
+{
+	size = m_Payload.size() - m_ReadPosition;
+	return m_Payload.data() + m_ReadPosition;
+}
+
+// Sent in one go, as a header sent on its own would have the payload wait for it to be acknowledged.
+Network::Result LeaseMessage::Send( Network::TCPSocket socket, unsigned int timeout ) const
+{
+	const uint32_t size = static_cast< uint32_t >( m_Payload.size() );
+	std::vector< unsigned char > frame =
+	{
+		static_cast< unsigned char >( size ), static_cast< unsigned char >( size >> 8 ), static_cast< unsigned char >( size >> 16 ), static_cast< unsigned char >( size >> 24 ),
+		static_cast< unsigned char >( m_Type )
+	};
+	frame.insert( frame.end(), m_Payload.begin(), m_Payload.end() );
+	return Network::Send( socket, frame.data(), frame.size(), timeout );
+}
+
+bool LeaseMessage::Extract( std::vector< unsigned char >& received, LeaseMessage& message, bool& isValid )
+{
+	isValid = true;
+	if ( received.size() < cHeaderSize )
+	{
+		return false;
+	}
+
+	const uint32_t size = received[ 0 ] | received[ 1 ] << 8 | received[ 2 ] << 16 | static_cast< uint32_t >( received[ 3 ] ) << 24;
+	const uint8_t type = received[ 4 ];
+	if ( size > cMaxPayloadSize || type >= static_cast< uint8_t >( Type::Count ) )
+	{
+		isValid = false;
+		return false;
+	}
+	else if ( received.size() < cHeaderSize + size )
+	{
+		return false;
+	}
+
+	message.m_Type = static_cast< Type >( type );
+	message.m_Payload.assign( received.begin() + cHeaderSize, received.begin() + cHeaderSize + size );
+	message.m_ReadPosition = 0;
+	received.erase( received.begin(), received.begin() + cHeaderSize + size );
+	return true;
+}
+
+Network::Result LeaseMessage::Receive( Network::TCPSocket socket, std::vector< unsigned char >& received, LeaseMessage& message, unsigned int timeout )
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	unsigned char buffer[ 4096 ];
+	while ( true )
+	{
+		bool isValid = true;
+		if ( Extract( received, message, isValid ) )
+		{
+			return Network::Result::Success;
+		}
+		else if ( isValid == false )
+		{
+			return Network::Result::Invalid;
+		}
+
+		const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count();
+		size_t bytesReceived = 0;
+		const Network::Result result = Network::Receive( socket, buffer, sizeof( buffer ), static_cast< unsigned int >( std::max< long long >( 0, remaining ) ), bytesReceived );
+		if ( result != Network::Result::Success )
+		{
+			return result;
+		}
+		else if ( bytesReceived == 0 )
+		{
+			return Network::Result::NotConnected;
+		}
+		received.insert( received.end(), buffer, buffer + bytesReceived );
+	}
+}
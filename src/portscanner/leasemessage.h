@@ -0,0 +1,86 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <network/network.h>
+
+//-----------------------------------------------------------------------------
+// LeaseMessage
+// What lease clients and the coordinator send each other. On the wire, each
+// message is its payload's size (32 bits), its type (8 bits) and the payload,
+// all little endian. Every request gets exactly one reply, so a client never
+// has more than one request outstanding.
+//-----------------------------------------------------------------------------
+class LeaseMessage
+{
+public:
+	// Which of a /16 block's /24 networks have been scanned, by third octet.
+	using NetworkBitmap = std::bitset< 256 >;
+
+	enum class Type : uint8_t
+	{
+		// Client to coordinator.
+		RequestLease,	// Empty.
+		RenewLease,		// Block (32).
+		Report,			// Block (32), whether it is complete (8), its scanned networks (256).
+		Merge,			// Scanned networks, as a serialised RoaringBitmap of /24s.
+
+		// Coordinator to client.
+		Lease,			// Block (32), milliseconds until it expires (32), its scanned networks (256).
+		NoLease,		// Empty. Every block is either scanned or leased.
+		Renewed,		// Whether the lease was still held (8).
+		Acknowledged,	// Empty.
+
+		Count
+	};
+
+	static constexpr uint32_t cMaxPayloadSize = 64 * 1024 * 1024;
+
+	LeaseMessage( Type type = Type::Acknowledged );
+
+	Type GetType() const;
+
+	void Write8( uint8_t value );
+	void Write32( uint32_t value );
+	void WriteBitmap( const NetworkBitmap& bitmap );
+	void WriteBytes( const unsigned char* pData, size_t size );
+
+	// Reads go through the payload in order, and fail once it runs out.
+	bool Read8( uint8_t& value );
+	bool Read32( uint32_t& value );
+	bool ReadBitmap( NetworkBitmap& bitmap );
+	const unsigned char* GetRemaining( size_t& size ) const;
+
+	Network::Result Send( Network::TCPSocket socket, unsigned int timeout ) const;
+
+	// Takes the first complete message out of the bytes received so far. Returns
+	// false if there isn't one yet, clearing "isValid" if the bytes can't be a message.
+	static bool Extract( std::vector< unsigned char >& received, LeaseMessage& message, bool& isValid );
+
+	// Waits at most "timeout" milliseconds for a whole message to arrive.
+	static Network::Result Receive( Network::TCPSocket socket, std::vector< unsigned char >& received, LeaseMessage& message, unsigned int timeout );
+
+private:
+	static constexpr size_t cHeaderSize = 5;
+
+	Type m_Type;
+	std::vector< unsigned char > m_Payload;
+	size_t m_ReadPosition;
+};
@@ -0,0 +1,279 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include "mappedfile.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+m_pData( nullptr ),
+m_Size( 0 ),
+m_Writable( false ),
+m_File( INVALID_HANDLE_VALUE ),
+m_Mapping( nullptr )
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::OpenForReading( const std::string& path )
+{
+	Close();
+
+	m_File = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( m_File == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( GetFileSizeEx( m_File, &size ) == FALSE || size.QuadPart == 0 )
+	{
+		Close();
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingA( m_File, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( m_Mapping == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = reinterpret_cast< unsigned char* >( MapViewOfFile( m_Mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	if ( m_pData == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	m_Size = static_cast< size_t >( size.QuadPart );
+	m_Writable = false;
+	return true;
+}
+
+bool MappedFile::Create( const std::string& path, size_t size )
+{
+	Close();
+
+	m_File = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( m_File == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	const DWORD sizeHigh = static_cast< DWORD >( static_cast< uint64_t >( size ) >> 32 );
+	const DWORD sizeLow = static_cast< DWORD >( size & 0xFFFFFFFF );
+	m_Mapping = CreateFileMappingA( m_File, nullptr, PAGE_READWRITE, sizeHigh, sizeLow, nullptr );
+	if ( m_Mapping == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = reinterpret_cast< unsigned char* >( MapViewOfFile( m_Mapping, FILE_MAP_WRITE, 0, 0, size ) );
+	if ( m_pData == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	m_Size = size;
+	m_Writable = true;
+	return true;
+}
+
+bool MappedFile::Flush()
+{
+	if ( m_pData == nullptr || m_Writable == false )
+	{
+		return true;
+	}
+	return FlushViewOfFile( m_pData, m_Size ) != FALSE && FlushFileBuffers( m_File ) != FALSE;
+}
+
+void MappedFile::Close()
+{
+	if ( m_pData != nullptr )
+	{
+		Flush();
+		UnmapViewOfFile( m_pData );
+		m_pData = nullptr;
+	}
+
+	if ( m_Mapping != nullptr )
+	{
+		CloseHandle( m_Mapping );
+		m_Mapping = nullptr;
+	}
+
+	if ( m_File != INVALID_HANDLE_VALUE )
+	{
+		CloseHandle( m_File );
+		m_File = INVALID_HANDLE_VALUE;
+	}
+
+	m_Size = 0;
+	m_Writable = false;
+}
+
+bool MappedFile::Replace( const std::string& from, const std::string& to )
+{
+	return MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != FALSE;
+}
+
+#else
+
+MappedFile::MappedFile() :
+m_pData( nullptr ),
+m_Size( 0 ),
+m_Writable( false ),
+m_File( -1 )
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::OpenForReading( const std::string& path )
+{
+	Close();
+
+	m_File = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+	if ( m_File == -1 )
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if ( fstat( m_File, &fileStat ) == -1 || fileStat.st_size == 0 )
+	{
+		Close();
+		return false;
+	}
+
+	void* pData = mmap( nullptr, static_cast< size_t >( fileStat.st_size ), PROT_READ, MAP_PRIVATE, m_File, 0 );
+	if ( pData == MAP_FAILED )
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = reinterpret_cast< unsigned char* >( pData );
+	m_Size = static_cast< size_t >( fileStat.st_size );
+	m_Writable = false;
+	return true;
+}
+
+bool MappedFile::Create( const std::string& path, size_t size )
+{
+	Close();
+
+	m_File = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	if ( m_File == -1 )
+	{
+		return false;
+	}
+
+	if ( ftruncate( m_File, static_cast< off_t >( size ) ) == -1 )
+	{
+		Close();
+		return false;
+	}
+
+	void* pData = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0 );
+	if ( pData == MAP_FAILED )
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = reinterpret_cast< unsigned char* >( pData );
+	m_Size = size;
+	m_Writable = true;
+	return true;
+}
+
+bool MappedFile::Flush()
+{
+	if ( m_pData == nullptr || m_Writable == false )
+	{
+		return true;
+	}
+	return msync( m_pData, m_Size, MS_SYNC ) == 0 && fsync( m_File ) == 0;
+}
+
+void MappedFile::Close()
+{
+	if ( m_pData != nullptr )
+	{
+		Flush();
+		munmap( m_pData, m_Size );
+		m_pData = nullptr;
+	}
+
+	if ( m_File != -1 )
+	{
+		close( m_File );
+		m_File = -1;
+	}
+
+	m_Size = 0;
+	m_Writable = false;
+}
+
+bool MappedFile::Replace( const std::string& from, const std::string& to )
+{
+	return rename( from.c_str(), to.c_str() ) == 0;
+}
+
+#endif
+
+bool MappedFile::IsOpen() const
+{
+	return m_pData != nullptr;
+}
+
+unsigned char* MappedFile::GetData() const
+{
+	return m_pData;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return m_Size;
+}
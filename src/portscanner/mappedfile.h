@@ -0,0 +1,61 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// MappedFile
+// Maps a whole file into memory, either read only or, when creating it, read
+// write at a fixed size. The mapping is flushed and released on Close() or
+// destruction.
+//-----------------------------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	bool OpenForReading( const std::string& path );
+
+	// Creates or truncates the file to "size" bytes.
+	bool Create( const std::string& path, size_t size );
+
+	// Writes any changes back to disk, returning once they are durable.
+	bool Flush();
+	void Close();
+
+	bool IsOpen() const;
+	unsigned char* GetData() const;
+	size_t GetSize() const;
+
+	// Atomically replaces "to" with "from".
+	static bool Replace( const std::string& from, const std::string& to );
+
+private:
+	unsigned char* m_pData;
+	size_t m_Size;
+	bool m_Writable;
+#ifdef _WIN32
+	void* m_File;
+	void* m_Mapping;
+#else
+	int m_File;
+#endif
+};
@@ -0,0 +1,114 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+// MPSCRing
+// Bounded lock-free queue with any number of producers and a single consumer.
+// Every slot carries a sequence number which tells whether it is free for the
+// producer claiming that position or holds a value ready for the consumer, so
+// producers only contend on claiming a position and never on each other's
+// writes. The capacity is rounded up to a power of two.
+//-----------------------------------------------------------------------------
+template< typename T >
+class MPSCRing
+{
+public:
+	MPSCRing( size_t capacity )
+	{
+		size_t size = 1;
+		while ( size < capacity )
+		{
+			size <<= 1;
+		}
+
+		m_pSlots = std::make_unique< Slot[] >( size );
+		for ( size_t i = 0; i < size; ++i )
+		{
+			m_pSlots[ i ].sequence.store( i, std::memory_order_relaxed );
+		}
+		m_Mask = size - 1;
+		m_Head = 0;
+		m_Tail = 0;
+	}
+
+	MPSCRing( const MPSCRing& ) = delete;
+	MPSCRing& operator=( const MPSCRing& ) = delete;
+
+	// Can be called from any thread. Returns false if the ring is full.
+	bool TryPush( const T& value )
+	{
+		size_t position = m_Head.load( std::memory_order_relaxed );
+		while ( true )
+		{
+			Slot& slot = m_pSlots[ position & m_Mask ];
+			const size_t sequence = slot.sequence.load( std::memory_order_acquire );
+			const intptr_t difference = static_cast< intptr_t >( sequence ) - static_cast< intptr_t >( position );
+			if ( difference == 0 )
+			{
+				if ( m_Head.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+				{
+					slot.value = value;
+					slot.sequence.store( position + 1, std::memory_order_release );
+					return true;
+				}
+			}
+			else if ( difference < 0 )
+			{
+				// The consumer hasn't got round to this slot since it was last used.
+				return false;
+			}
+			else
+			{
+				position = m_Head.load( std::memory_order_relaxed );
+			}
+		}
+	}
+
+	// Must only be called from the consumer's thread.
+	bool TryPop( T& value )
+	{
+		Slot& slot = m_pSlots[ m_Tail & m_Mask ];
+		if ( slot.sequence.load( std::memory_order_acquire ) != m_Tail + 1 )
+		{
+			return false;
+		}
+
+		// Moved out, so the slot doesn't hold on to anything it owns until it's reused.
+		value = std::move( slot.value );
+		slot.sequence.store( m_Tail + m_Mask + 1, std::memory_order_release );
+		m_Tail++;
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic< size_t > sequence;
+		T value;
+	};
+
+	std::unique_ptr< Slot[] > m_pSlots;
+	size_t m_Mask;
+	alignas( 64 ) std::atomic< size_t > m_Head; // Next position to be claimed by a producer.
+	alignas( 64 ) size_t m_Tail; // Next position to be read by the consumer.
+};
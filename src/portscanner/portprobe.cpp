@@ -13,23 +13,247 @@
 // You should have received a copy of the GNU General Public License
 // along with watcher. If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <string>
 #include <sstream>
+#include <chrono>
+#include <thread>
 #include <SDL.h>
+#include "httpbanner.h"
 #include "portprobe.h"
+#include "rttestimator.h"
+#include "scanrecorder.h"
+#include "socketbudget.h"
+
+PortProbe::PortProbe( RTTEstimator* pEstimator, SocketBudget* pBudget ) :
+m_pEstimator( pEstimator ),
+m_pBudget( pBudget ),
+m_ClosingCount( 0 ),
+m_pRecorder( nullptr ),
+m_GrabBanners( false )
+{
+
+}
+
+PortProbe::~PortProbe()
+{
+	Release( 0, true );
+}
 
 PortProbe::Result PortProbe::Probe( const Network::IPAddress& address )
 {
-	using namespace Network;
+	return Probe( address, GetTimeout( address ) );
+}
 
+PortProbe::Result PortProbe::Probe( const Network::IPAddress& address, unsigned int timeout )
+{
 	SDL_assert( address.GetPort() != 0 );
-	TCPSocket socket;
-	Network::Result result = ConnectTCP( address, 2500, socket );
+	m_Banners.resize( 1 );
+	m_Banners[ 0 ].clear();
+	if ( Acquire( 1 ) == false )
+	{
+		return Result::OutOfSockets;
+	}
+
+	m_Requests.resize( 1 );
+	Network::ConnectRequest& request = m_Requests[ 0 ];
+	request.address = address;
+	Connect( request, timeout );
+	const bool isHeld = Retry( request, timeout );
+	const Result result = Finish( request, 0 );
+	Release( isHeld ? 1 : 0 );
+	return result;
+}
+
+void PortProbe::Probe( const Network::IPAddress& address, const Network::PortVector& ports, Results& results )
+{
+	m_Requests.resize( ports.size() );
+	for ( size_t i = 0; i < ports.size(); ++i )
+	{
+		SDL_assert( ports[ i ] != 0 );
+		m_Requests[ i ].address = address;
+		m_Requests[ i ].address.SetPort( ports[ i ] );
+	}
+
+	results.resize( ports.size() );
+	m_Banners.resize( ports.size() );
+	if ( Acquire( static_cast< unsigned int >( ports.size() ) ) == false )
+	{
+		results.assign( ports.size(), Result::OutOfSockets );
+		m_Banners.assign( ports.size(), std::string() );
+		return;
+	}
+
+	// Every port is on the same address, so they all share the same timeout.
+	const unsigned int timeout = GetTimeout( address );
+	Network::ConnectTCP( m_Requests, timeout );
+
+	// Attempts which ran out of descriptors are only retried once every other
+	// socket is closed, so a probe never holds on to some while waiting for more.
+	unsigned int finished = 0;
+	for ( size_t i = 0; i < ports.size(); ++i )
+	{
+		if ( IsOutOfSockets( m_Requests[ i ].result ) == false )
+		{
+			results[ i ] = Finish( m_Requests[ i ], i );
+			finished++;
+		}
+	}
+	Release( finished );
+
+	for ( size_t i = 0; i < ports.size(); ++i )
+	{
+		if ( IsOutOfSockets( m_Requests[ i ].result ) )
+		{
+			const bool isHeld = Retry( m_Requests[ i ], timeout );
+			results[ i ] = Finish( m_Requests[ i ], i );
+			Release( isHeld ? 1 : 0 );
+		}
+	}
+}
+
+void PortProbe::SetGrabBanners( bool grabBanners )
+{
+	m_GrabBanners = grabBanners;
+}
+
+void PortProbe::SetRecorder( ScanRecorder* pRecorder )
+{
+	m_pRecorder = pRecorder;
+}
+
+const std::string& PortProbe::GetBanner( size_t index ) const
+{
+	SDL_assert( index < m_Banners.size() );
+	return m_Banners[ index ];
+}
+
+void PortProbe::Connect( Network::ConnectRequest& request, unsigned int timeout )
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	request.result = Network::ConnectTCP( request.address, timeout, request.socket );
+	const auto elapsed = std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now() - start );
+	request.time = static_cast< unsigned int >( elapsed.count() );
+}
+
+// Tries again for as long as an attempt fails for lack of descriptors, giving its
+// slot back while waiting for the budget to have room for it.
+// Returns false if the budget was interrupted, in which case the slot is gone.
+bool PortProbe::Retry( Network::ConnectRequest& request, unsigned int timeout )
+{
+	if ( m_pBudget == nullptr )
+	{
+		return true;
+	}
+
+	while ( IsOutOfSockets( request.result ) )
+	{
+		// Backs off briefly too, as even the smallest budget might be more than the
+		// rest of the process leaves available.
+		m_pBudget->OnExhausted();
+		Release( 1, true );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		if ( Acquire( 1 ) == false )
+		{
+			return false;
+		}
+		Connect( request, timeout );
+	}
+	return true;
+}
 
+// Records the outcome of an attempt and closes its socket. Its slot in the budget
+// is only given back by Release().
+PortProbe::Result PortProbe::Finish( const Network::ConnectRequest& request, size_t index )
+{
+	m_Banners[ index ].clear();
+	if ( request.result == Network::Result::Success )
+	{
+		OnOpen( request.address, request.socket, index );
+	}
+
+	if ( m_pEstimator != nullptr && IsRoundTrip( request.result ) )
+	{
+		m_pEstimator->AddSample( request.address, request.time );
+	}
+
+	if ( m_pRecorder != nullptr )
+	{
+		m_pRecorder->Record( request.result, request.time );
+	}
+
+	return ToResult( request.result );
+}
+
+// Takes slots in the budget for "count" more sockets. When the budget is short,
+// the slots still held for deferred closes are freed up first.
+bool PortProbe::Acquire( unsigned int count )
+{
+	if ( m_pBudget == nullptr || m_pBudget->TryAcquire( count ) )
+	{
+		return true;
+	}
+
+	Release( 0, true );
+	return m_pBudget->Acquire( count );
+}
+
+// Gives back the slots of "count" sockets which have been closed. The backend may
+// defer closing them, and they would still be open while the budget no longer
+// counted them, so as many slots as there are deferred closes are held on to
+// until those have happened. They normally complete alongside the next batch of
+// connections, and "flush" waits for them instead.
+void PortProbe::Release( unsigned int count, bool flush )
+{
+	if ( m_pBudget == nullptr )
+	{
+		return;
+	}
+
+	if ( flush && m_ClosingCount > 0 )
+	{
+		Network::FlushCloses();
+	}
+
+	const unsigned int held = m_ClosingCount + count;
+	m_ClosingCount = std::min( held, Network::GetDeferredCloseCount() );
+	if ( held > m_ClosingCount )
+	{
+		m_pBudget->Release( held - m_ClosingCount );
+	}
+}
+
+// The connection is only closed once the banner has been grabbed, if it is wanted.
+void PortProbe::OnOpen( const Network::IPAddress& address, Network::TCPSocket socket, size_t index )
+{
+	if ( m_GrabBanners )
+	{
+		HTTPBanner::Grab( socket, address, m_Banners[ index ] );
+	}
+	Network::Close( socket );
+}
+
+unsigned int PortProbe::GetTimeout( const Network::IPAddress& address ) const
+{
+	return ( m_pEstimator == nullptr ) ? cTimeout : m_pEstimator->GetTimeout( address );
+}
+
+bool PortProbe::IsRoundTrip( Network::Result result )
+{
+	return result == Network::Result::Success || result == Network::Result::ConnectionRefused;
+}
+
+bool PortProbe::IsOutOfSockets( Network::Result result )
+{
+	return result == Network::Result::PerProcessLimitReached || result == Network::Result::SystemLimitReached;
+}
+
+// Maps the outcome of a connection attempt to the result of the probe.
+PortProbe::Result PortProbe::ToResult( Network::Result result )
+{
 	if ( result == Network::Result::Success )
 	{
-		Close( socket );
-		return Result::Open;
+		return PortProbe::Result::Open;
 	}
 	else if ( result == Network::Result::Timeout || result == Network::Result::HostUnreachable )
 	{
@@ -39,9 +263,13 @@ PortProbe::Result PortProbe::Probe( const Network::IPAddress& address )
 	{
 		return PortProbe::Result::Closed;
 	}
+	else if ( IsOutOfSockets( result ) )
+	{
+		return PortProbe::Result::OutOfSockets;
+	}
 	else
 	{
-		printf("ConnectTCP error: %s\n", ToString(result).c_str());
+		printf("ConnectTCP error: %s\n", Network::ToString(result).c_str());
 		return PortProbe::Result::Timeout;
 	}
 }
@@ -60,6 +288,10 @@ std::string ToString( PortProbe::Result result )
 	{
 		return "Timeout";
 	}
+	else if ( result == PortProbe::Result::OutOfSockets )
+	{
+		return "Out of sockets";
+	}
 	else
 	{
 		return "Unknown";
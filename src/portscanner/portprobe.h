@@ -17,8 +17,13 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <network/network.h>
 
+class RTTEstimator;
+class ScanRecorder;
+class SocketBudget;
+
 class PortProbe
 {
 public:
@@ -26,10 +31,65 @@ public:
 	{
 		Open,
 		Closed,
-		Timeout
+		Timeout,
+		OutOfSockets // The probe couldn't be made, and says nothing about the host.
 	};
 
+	static constexpr unsigned int cTimeout = 2500; // In milliseconds.
+
+	using Results = std::vector< Result >;
+
+	// Without an estimator every probe waits for cTimeout. With one, timeouts come
+	// from the round trip times measured so far and every probe which gets an
+	// answer is fed back to it.
+	// With a budget, every socket is accounted for in it, and probes which run out
+	// of descriptors wait for room and try again. They only result in
+	// Result::OutOfSockets if the budget is interrupted meanwhile.
+	PortProbe( RTTEstimator* pEstimator = nullptr, SocketBudget* pBudget = nullptr );
+	~PortProbe();
+
 	Result Probe( const Network::IPAddress& address );
+
+	// As above, but waits for at most "timeout" milliseconds rather than what the estimator suggests.
+	Result Probe( const Network::IPAddress& address, unsigned int timeout );
+
+	// Probes every port in "ports" on the given address at once.
+	void Probe( const Network::IPAddress& address, const Network::PortVector& ports, Results& results );
+
+	// When enabled, open ports are sent a "GET /" before their connection is closed,
+	// and the start of the response is kept as their banner.
+	void SetGrabBanners( bool grabBanners );
+
+	// Every connection attempt is recorded in it, if there is one.
+	void SetRecorder( ScanRecorder* pRecorder );
+
+	// Banner of the n-th port of the last probe. Empty unless it was open and banners are grabbed.
+	const std::string& GetBanner( size_t index ) const;
+
+	static Result ToResult( Network::Result result );
+
+	// Whether a connection attempt with this outcome measured a full round trip.
+	static bool IsRoundTrip( Network::Result result );
+
+	// Whether a connection attempt failed because the process or system ran out of descriptors.
+	static bool IsOutOfSockets( Network::Result result );
+
+private:
+	unsigned int GetTimeout( const Network::IPAddress& address ) const;
+	static void Connect( Network::ConnectRequest& request, unsigned int timeout );
+	bool Retry( Network::ConnectRequest& request, unsigned int timeout );
+	Result Finish( const Network::ConnectRequest& request, size_t index );
+	bool Acquire( unsigned int count );
+	void Release( unsigned int count, bool flush = false );
+	void OnOpen( const Network::IPAddress& address, Network::TCPSocket socket, size_t index );
+
+	RTTEstimator* m_pEstimator;
+	SocketBudget* m_pBudget;
+	unsigned int m_ClosingCount; // Slots still held for sockets whose close the backend deferred.
+	ScanRecorder* m_pRecorder;
+	Network::ConnectRequests m_Requests;
+	bool m_GrabBanners;
+	std::vector< std::string > m_Banners;
 };
 
 std::string ToString( PortProbe::Result result );
\ No newline at end of file
@@ -13,21 +13,68 @@
 // You should have received a copy of the GNU General Public License
 // along with watcher. If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <ctime>
 #include <iostream>
+#include <thread>
 #include <stdio.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <imgui/imgui.h>
+#include "connectengine.h"
 #include "ipgenerator.h"
 #include "portprobe.h"
 #include "portscanner.h"
 
 IMPLEMENT_PLUGIN(PortScanner)
 
-PortScanner::PortScanner()
+PortScanner::PortScanner() :
+m_Hits(cHitCapacity),
+m_RateLimiter(100, 10),
+m_RTTEstimator(500, PortProbe::cTimeout)
 {
 	m_WantedThreads = 100;
-	m_BlockIPsToScan = 0;
+	m_WantedInFlight = 512;
+	m_WantedShards = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+#ifdef __linux__
+	m_UseEngine = true;
+	m_UseIOUring = true;
+#else
+	m_UseEngine = false;
+	m_UseIOUring = false;
+#endif
 	m_ActiveThreads = 0;
 	m_Stop = false;
+	m_WantedRate = static_cast<int>(m_RateLimiter.GetRate());
+	m_WantedBurst = static_cast<int>(m_RateLimiter.GetBurst());
+	m_RateChanged = false;
+	m_ConfiguredPorts = { 80, 81, 8080 };
+	m_WantedMinimumTimeout = static_cast<int>(m_RTTEstimator.GetMinimumTimeout());
+	m_WantedMaximumTimeout = static_cast<int>(m_RTTEstimator.GetMaximumTimeout());
+	m_TimeoutsChanged = false;
+	m_NextSequence = 0;
+	m_NoMoreBlocks = false;
+	m_WorkerCount = 0;
+	m_WantedBlocksInFlight = 2;
+	m_PortMajor = false;
+	m_SkipSilentHosts = true;
+	m_UseLivenessStage = false;
+	m_LivenessPort = 80;
+	m_LivenessTimeout = 250;
+	m_WantedProbeThreads = 50;
+	m_ReportLivenessPort = false;
+	m_ActiveWorkers = 0;
+	m_LivenessProbes = 0;
+	m_LiveHostCount = 0;
+	m_FullProbes = 0;
+	m_GrabBanners = true;
+	m_CoordinatorPort = LeaseCoordinator::cDefaultPort;
+	m_CoordinatorLoopbackOnly = false;
+	m_UseCoordinator = false;
+	snprintf(m_CoordinatorAddress, sizeof(m_CoordinatorAddress), "127.0.0.1:%u", static_cast<unsigned int>(LeaseCoordinator::cDefaultPort));
+	m_UsingLeases = false;
 }
 
 PortScanner::~PortScanner()
@@ -41,51 +88,540 @@ PortScanner::~PortScanner()
 			thread.join();
 		}
 	}
+	m_Threads.clear();
+
+	// Keeps the progress made on any unfinished blocks.
+	UpdateBlocks();
+	BroadcastHits();
 }
 
-void PortScanner::ThreadMain(PortScanner* pPortScanner)
+void PortScanner::ThreadMain(PortScanner* pPortScanner, unsigned int worker, unsigned int workerCount)
 {
-	PortProbe probe;
+	PortProbe probe(&pPortScanner->m_RTTEstimator, &pPortScanner->m_SocketBudget);
+	probe.SetGrabBanners(pPortScanner->m_GrabBanners);
+	probe.SetRecorder(pPortScanner->m_Metrics.CreateRecorder());
+	BannerArena* pBannerArena = pPortScanner->CreateBannerArena();
+	PortProbe::Results results;
 	Network::IPAddress address;
-	while (pPortScanner->m_pIPGenerator->GetNext(address))
+	const Network::PortVector& ports = pPortScanner->m_Ports;
+	uint64_t sequence = 0;
+	ScanBlockSharedPtr pBlock;
+	while ((pBlock = pPortScanner->GetBlock(sequence, true)) != nullptr)
 	{
-		for (uint16_t port : pPortScanner->m_Ports)
+		sequence = pBlock->sequence + 1;
+		IPGenerator::Stride stride = pBlock->pGenerator->GetStride(worker, workerCount);
+		unsigned int pass = 0;
+		while (pBlock->pGenerator->GetNext(stride, address, pass))
 		{
-			address.SetPort(port);
-			if (probe.Probe(address) == PortProbe::Result::Open && pPortScanner->IsStopping() == false)
+			if (pPortScanner->m_UseLivenessStage)
 			{
-				pPortScanner->OnHTTPServerFound(address);
+				// Only the liveness port, with a short timeout. The rest is up to the full probe threads.
+				if (pPortScanner->m_RateLimiter.Acquire() == false)
+				{
+					pPortScanner->OnWorkerExited();
+					return;
+				}
+				address.SetPort(static_cast<uint16_t>(pPortScanner->m_LivenessPort));
+				const PortProbe::Result result = probe.Probe(address, static_cast<unsigned int>(pPortScanner->m_LivenessTimeout));
+
+				if (pPortScanner->IsStopping())
+				{
+					pPortScanner->OnWorkerExited();
+					return;
+				}
+
+				if (result == PortProbe::Result::Open && pPortScanner->m_ReportLivenessPort)
+				{
+					pPortScanner->OnHTTPServerFound(pBannerArena, address, probe.GetBanner(0));
+				}
+				pPortScanner->OnLivenessProbed(pBlock, address, result != PortProbe::Result::Timeout);
+				continue;
 			}
 
+			if (pPortScanner->m_PortMajor)
+			{
+				// A single port per visit, the pass telling which.
+				const bool skip = pass > 0 && pPortScanner->m_SkipSilentHosts && IsHostSilent(*pBlock, address);
+				if (skip == false)
+				{
+					if (pPortScanner->m_RateLimiter.Acquire() == false)
+					{
+						pPortScanner->OnWorkerExited();
+						return;
+					}
+					address.SetPort(ports[pass]);
+					const PortProbe::Result result = probe.Probe(address);
+					if (result == PortProbe::Result::Open)
+					{
+						pPortScanner->OnHTTPServerFound(pBannerArena, address, probe.GetBanner(0));
+					}
+					else if (result == PortProbe::Result::Timeout && pass == 0 && pPortScanner->m_SkipSilentHosts)
+					{
+						SetHostSilent(*pBlock, address);
+					}
+				}
+
+				if (pPortScanner->IsStopping())
+				{
+					pPortScanner->OnWorkerExited();
+					return;
+				}
+
+				OnProbed(*pBlock, address, 1);
+				continue;
+			}
+
+			if (pPortScanner->m_RateLimiter.Acquire(static_cast<unsigned int>(ports.size())) == false)
+			{
+				pPortScanner->OnWorkerExited();
+				return;
+			}
+
+			// All the ports are probed at once, which the network backend can batch together.
+			probe.Probe(address, ports, results);
+
 			if (pPortScanner->IsStopping())
 			{
-				pPortScanner->m_ActiveThreads--;
+				pPortScanner->OnWorkerExited();
 				return;
 			}
+
+			for (size_t i = 0; i < ports.size(); ++i)
+			{
+				if (results[i] == PortProbe::Result::Open)
+				{
+					address.SetPort(ports[i]);
+					pPortScanner->OnHTTPServerFound(pBannerArena, address, probe.GetBanner(i));
+				}
+			}
+
+			OnProbed(*pBlock, address, static_cast<int>(ports.size()));
+		}
+
+		// Rather than waiting for the other workers, move on to the next block.
+		pBlock->workers--;
+	}
+
+	pPortScanner->OnWorkerExited();
+}
+
+#ifdef __linux__
+// Alternative to ThreadMain(): rather than blocking on every probe, each shard keeps
+// its share of m_WantedInFlight connection attempts in flight through its own
+// ConnectEngine. There is one shard per core, each pinned to it, and like the
+// blocking workers each only probes its own stride of every block.
+// Once every address in a block has been submitted the engine starts on the next
+// one, and the block is only done once its last attempt has completed.
+void PortScanner::EngineThreadMain(PortScanner* pPortScanner, unsigned int shard, unsigned int shardCount)
+{
+	PinToCore(shard);
+
+	struct EngineBlock
+	{
+		ScanBlockSharedPtr pBlock;
+		int inFlight;
+	};
+	std::vector<EngineBlock> blocks; // The last one is the block addresses are taken from.
+	std::deque<Network::IPAddress> retries; // Attempts which ran out of descriptors, still in flight as far as their block is concerned.
+
+	const unsigned int inFlight = static_cast<unsigned int>(std::max(1, pPortScanner->m_WantedInFlight / static_cast<int>(shardCount)));
+	ScanRecorder* pRecorder = pPortScanner->m_Metrics.CreateRecorder();
+	BannerArena* pBannerArena = pPortScanner->CreateBannerArena();
+	ConnectEngine engine(inFlight, [pPortScanner, pRecorder, pBannerArena, &blocks, &retries](const Network::IPAddress& address, Network::Result result, unsigned int time, const std::string& banner)
+	{
+		pRecorder->Record(result, time);
+		pPortScanner->m_SocketBudget.Release(1);
+		if (PortProbe::IsOutOfSockets(result))
+		{
+			pPortScanner->m_SocketBudget.OnExhausted();
+			retries.push_back(address);
+			return;
+		}
+
+		// Coverage blocks are /16s.
+		const uint32_t blockHost = address.GetHost() & 0xFFFF0000;
+		for (EngineBlock& block : blocks)
+		{
+			if (block.pBlock->address.GetHost() == blockHost)
+			{
+				block.inFlight--;
+				if (pPortScanner->m_UseLivenessStage)
+				{
+					pPortScanner->OnLivenessProbed(block.pBlock, address, PortProbe::IsRoundTrip(result));
+					break;
+				}
+
+				OnProbed(*block.pBlock, address, 1);
+
+				if (pPortScanner->m_PortMajor && pPortScanner->m_SkipSilentHosts && address.GetPort() == pPortScanner->m_Ports[0] &&
+					PortProbe::ToResult(result) == PortProbe::Result::Timeout)
+				{
+					SetHostSilent(*block.pBlock, address);
+				}
+				break;
+			}
 		}
+
+		if (PortProbe::IsRoundTrip(result))
+		{
+			pPortScanner->m_RTTEstimator.AddSample(address, time);
+		}
+
+		const bool isScannedPort = pPortScanner->m_UseLivenessStage == false || pPortScanner->m_ReportLivenessPort;
+		if (PortProbe::ToResult(result) == PortProbe::Result::Open && isScannedPort && pPortScanner->IsStopping() == false)
+		{
+			pPortScanner->OnHTTPServerFound(pBannerArena, address, banner);
+		}
+	});
+	engine.SetGrabBanners(pPortScanner->m_GrabBanners);
+
+	if (engine.IsValid() == false)
+	{
+		printf("Failed to create connect engine, falling back to a blocking probe.\n");
+		ThreadMain(pPortScanner, shard, shardCount);
+		return;
+	}
+
+	const Network::PortVector& ports = pPortScanner->m_Ports;
+	IPGenerator::Stride stride;
+	Network::IPAddress address;
+	size_t portIndex = 0;
+	size_t portEnd = 0;
+	uint64_t sequence = 0;
+	bool generating = false;
+	while (pPortScanner->IsStopping() == false)
+	{
+		if (generating == false)
+		{
+			// Only block waiting for the next block if there's nothing else to do.
+			const bool isIdle = (engine.GetInFlight() == 0 && retries.empty());
+			ScanBlockSharedPtr pBlock = pPortScanner->GetBlock(sequence, isIdle);
+			if (pBlock != nullptr)
+			{
+				sequence = pBlock->sequence + 1;
+				stride = pBlock->pGenerator->GetStride(shard, shardCount);
+				portIndex = portEnd = 0;
+				blocks.push_back({ pBlock, 0 });
+				generating = true;
+			}
+			else if (isIdle)
+			{
+				break;
+			}
+		}
+
+		// Every socket needs room in the budget, and attempts which ran out of
+		// descriptors regardless go first once there is some.
+		// Those which fail yet again are left for the next time round, and nothing new
+		// is started until they're all through.
+		size_t retryCount = retries.size();
+		while (retryCount > 0 && engine.CanSubmit() && pPortScanner->m_SocketBudget.TryAcquire(1))
+		{
+			const Network::IPAddress retry = retries.front();
+			retries.pop_front();
+			retryCount--;
+			const unsigned int timeout = pPortScanner->m_UseLivenessStage ? static_cast<unsigned int>(pPortScanner->m_LivenessTimeout) : pPortScanner->m_RTTEstimator.GetTimeout(retry);
+			engine.Submit(retry, timeout);
+		}
+		bool starved = (retries.empty() == false);
+
+		bool throttled = false;
+		while (engine.CanSubmit() && generating && starved == false)
+		{
+			EngineBlock& block = blocks.back();
+			if (portIndex == portEnd)
+			{
+				unsigned int pass = 0;
+				if (block.pBlock->pGenerator->GetNext(stride, address, pass) == false)
+				{
+					generating = false;
+					break;
+				}
+
+				// In port-major order each visit is for a single port, otherwise for all of them.
+				// With the liveness stage, it is for the liveness port only.
+				if (pPortScanner->m_UseLivenessStage)
+				{
+					portIndex = 0;
+					portEnd = 1;
+				}
+				else if (pPortScanner->m_PortMajor == false)
+				{
+					portIndex = 0;
+					portEnd = ports.size();
+				}
+				else if (pass > 0 && pPortScanner->m_SkipSilentHosts && IsHostSilent(*block.pBlock, address))
+				{
+					OnProbed(*block.pBlock, address, 1);
+					continue;
+				}
+				else
+				{
+					portIndex = pass;
+					portEnd = pass + 1;
+				}
+			}
+
+			if (pPortScanner->m_SocketBudget.TryAcquire(1) == false)
+			{
+				starved = true;
+				break;
+			}
+			else if (pPortScanner->m_RateLimiter.TryAcquire() == false)
+			{
+				pPortScanner->m_SocketBudget.Release(1);
+				throttled = true;
+				break;
+			}
+
+			// Counted before submitting, as the attempt might complete straight away.
+			if (pPortScanner->m_UseLivenessStage)
+			{
+				address.SetPort(static_cast<uint16_t>(pPortScanner->m_LivenessPort));
+				portIndex++;
+				block.inFlight++;
+				engine.Submit(address, static_cast<unsigned int>(pPortScanner->m_LivenessTimeout));
+			}
+			else
+			{
+				address.SetPort(ports[portIndex++]);
+				block.inFlight++;
+				engine.Submit(address, pPortScanner->m_RTTEstimator.GetTimeout(address));
+			}
+		}
+
+		for (size_t i = 0; i < blocks.size();)
+		{
+			const bool isGenerating = generating && i == blocks.size() - 1;
+			if (isGenerating == false && blocks[i].inFlight == 0)
+			{
+				blocks[i].pBlock->workers--;
+				blocks.erase(blocks.begin() + i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		// When throttled, only wait until the next token is available. When out of
+		// sockets, check again shortly as other shards are releasing theirs.
+		std::chrono::milliseconds waitTime(PortProbe::cTimeout);
+		if (throttled)
+		{
+			waitTime = std::max(std::chrono::milliseconds(1), std::chrono::duration_cast<std::chrono::milliseconds>(pPortScanner->m_RateLimiter.GetWaitTime()));
+		}
+		else if (starved)
+		{
+			waitTime = std::chrono::milliseconds(1);
+		}
+
+		if (engine.GetInFlight() == 0)
+		{
+			// Otherwise we're done with the current block and go straight to the next one.
+			if (throttled || starved)
+			{
+				std::this_thread::sleep_for(waitTime);
+			}
+		}
+		else
+		{
+			engine.Poll(static_cast<unsigned int>(waitTime.count()));
+		}
+	}
+
+	// Cancelled attempts aren't reported, so their sockets are given back here.
+	pPortScanner->m_SocketBudget.Release(static_cast<unsigned int>(engine.GetInFlight()));
+	engine.Cancel();
+	pPortScanner->OnWorkerExited();
+}
+
+// Pins the calling thread to the n-th core it is allowed to run on, wrapping around
+// if there are more shards than cores.
+void PortScanner::PinToCore(unsigned int core)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+	{
+		return;
+	}
+
+	unsigned int n = core % static_cast<unsigned int>(CPU_COUNT(&allowed));
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	{
+		if (CPU_ISSET(cpu, &allowed) && n-- == 0)
+		{
+			cpu_set_t pinned;
+			CPU_ZERO(&pinned);
+			CPU_SET(cpu, &pinned);
+			if (pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) != 0)
+			{
+				printf("Failed to pin shard %u to core %d.\n", core, cpu);
+			}
+			return;
+		}
+	}
+}
+#endif
+
+// Second stage of the liveness pipeline: probes the remaining ports on every host
+// which answered the first stage.
+void PortScanner::ProbeThreadMain(PortScanner* pPortScanner)
+{
+	PortProbe probe(&pPortScanner->m_RTTEstimator, &pPortScanner->m_SocketBudget);
+	probe.SetGrabBanners(pPortScanner->m_GrabBanners);
+	probe.SetRecorder(pPortScanner->m_Metrics.CreateRecorder());
+	BannerArena* pBannerArena = pPortScanner->CreateBannerArena();
+	PortProbe::Results results;
+	const Network::PortVector& ports = pPortScanner->m_RemainingPorts;
+	LiveHost liveHost;
+	while (pPortScanner->GetLiveHost(liveHost))
+	{
+		Network::IPAddress address = liveHost.address;
+		if (ports.empty() == false)
+		{
+			if (pPortScanner->m_RateLimiter.Acquire(static_cast<unsigned int>(ports.size())) == false)
+			{
+				break;
+			}
+			probe.Probe(address, ports, results);
+
+			if (pPortScanner->IsStopping())
+			{
+				break;
+			}
+
+			for (size_t i = 0; i < ports.size(); ++i)
+			{
+				if (results[i] == PortProbe::Result::Open)
+				{
+					address.SetPort(ports[i]);
+					pPortScanner->OnHTTPServerFound(pBannerArena, address, probe.GetBanner(i));
+				}
+			}
+		}
+
+		// The liveness probe is accounted for here too, so the host's network can't be
+		// recorded as scanned before its last port has been probed.
+		OnProbed(*liveHost.pBlock, address, static_cast<int>(pPortScanner->m_Ports.size()));
+		liveHost.pBlock->pendingHosts--;
+		liveHost.pBlock.reset();
+		pPortScanner->m_FullProbes++;
 	}
 
 	pPortScanner->m_ActiveThreads--;
-	pPortScanner->OnThreadCompleted();
 }
 
-bool PortScanner::Initialise(PluginMessageCallback pMessageCallback)
+// Called from the first stage's workers once an address has had its liveness probe.
+void PortScanner::OnLivenessProbed(const ScanBlockSharedPtr& pBlock, const Network::IPAddress& address, bool isLive)
+{
+	m_LivenessProbes++;
+	if (isLive == false)
+	{
+		// None of the other ports are worth trying.
+		OnProbed(*pBlock, address, static_cast<int>(m_Ports.size()));
+		return;
+	}
+
+	// Counted before it is queued, so the block can't be retired while the host is waiting.
+	m_LiveHostCount++;
+	pBlock->pendingHosts++;
+	{
+		std::lock_guard<std::mutex> lock(m_LiveHostsMutex);
+		m_LiveHosts.push_back({ pBlock, address });
+	}
+	m_LiveHostsCondition.notify_one();
+}
+
+// Waits for the next live host. Returns false once the scan is stopping, or once
+// the first stage is done and every host it found has been handed out.
+bool PortScanner::GetLiveHost(LiveHost& liveHost)
+{
+	std::unique_lock<std::mutex> lock(m_LiveHostsMutex);
+	m_LiveHostsCondition.wait(lock, [this]() { return IsStopping() || m_LiveHosts.empty() == false || m_ActiveWorkers == 0; });
+	if (IsStopping() || m_LiveHosts.empty())
+	{
+		return false;
+	}
+
+	liveHost = std::move(m_LiveHosts.front());
+	m_LiveHosts.pop_front();
+	return true;
+}
+
+// Called by each of the first stage's threads as it exits.
+void PortScanner::OnWorkerExited()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_LiveHostsMutex);
+		m_ActiveWorkers--;
+	}
+	m_LiveHostsCondition.notify_all();
+	m_ActiveThreads--;
+}
+
+static constexpr MessageType cConfigurationMessage = GetMessageType("configuration");
+
+bool PortScanner::Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions)
 {
 	m_pMessageCallback = pMessageCallback;
+
+	// The plugin links its own copy of the network library, so the backend the
+	// watcher picked doesn't apply here.
+	m_UseIOUring = (Network::SetBackend(m_UseIOUring ? Network::Backend::IOUring : Network::Backend::Sockets) == Network::Backend::IOUring);
+	subscriptions.Add(cConfigurationMessage);
+	subscriptions.Add<UpdateMessage>();
+	m_SocketBudget.Initialise();
 	m_Coverage.Read();
 	return true;
 }
 
-void PortScanner::OnMessageReceived(const nlohmann::json& message)
+void PortScanner::OnMessage(const Message& message)
 {
+	if (message.GetType() == cConfigurationMessage)
+	{
+		const json& configuration = *message.GetJson();
+		json::const_iterator it = configuration.find("web_scanner_rate");
+		if (it != configuration.end() && it->is_number_integer())
+		{
+			m_WantedRate = std::max(0, it->get<int>());
+			m_RateLimiter.SetRate(static_cast<unsigned int>(m_WantedRate));
+		}
+
+		it = configuration.find("web_scanner_ports");
+		if (it != configuration.end() && it->is_array() && it->empty() == false)
+		{
+			m_ConfiguredPorts = it->get<Network::PortVector>();
+		}
+
+		it = configuration.find("web_scanner_timeout_min");
+		if (it != configuration.end() && it->is_number_integer())
+		{
+			m_WantedMinimumTimeout = std::max(1, it->get<int>());
+		}
 
+		it = configuration.find("web_scanner_timeout_max");
+		if (it != configuration.end() && it->is_number_integer())
+		{
+			m_WantedMaximumTimeout = std::max(m_WantedMinimumTimeout, it->get<int>());
+		}
+
+		m_RTTEstimator.SetTimeoutBounds(static_cast<unsigned int>(m_WantedMinimumTimeout), static_cast<unsigned int>(m_WantedMaximumTimeout));
+	}
+	else if (message.As<UpdateMessage>() != nullptr)
+	{
+		UpdateBlocks();
+		m_Metrics.Update();
+		BroadcastHits();
+	}
 }
 
 void PortScanner::StartPortscan()
 {
 	if (IsScanning() == false)
 	{
-		ScanNextBlock();
+		Go(m_ConfiguredPorts);
 	}
 }
 
@@ -97,43 +633,259 @@ void PortScanner::StopPortscan()
 	}
 }
 
-void PortScanner::ScanNextBlock()
+// Must be MT safe, as it gets called from the worker threads.
+void PortScanner::OnProbed(ScanBlock& block, const Network::IPAddress& address, int probes)
+{
+	block.remaining[(address.GetHost() >> 8) & 0xFF] -= probes;
+}
+
+// Hosts are indexed by their offset in the /16 block.
+bool PortScanner::IsHostSilent(const ScanBlock& block, const Network::IPAddress& address)
+{
+	const uint32_t host = address.GetHost() & 0xFFFF;
+	return (block.silentHosts[host / 64].load(std::memory_order_relaxed) & (1ull << (host % 64))) != 0;
+}
+
+void PortScanner::SetHostSilent(ScanBlock& block, const Network::IPAddress& address)
+{
+	const uint32_t host = address.GetHost() & 0xFFFF;
+	block.silentHosts[host / 64].fetch_or(1ull << (host % 64), std::memory_order_relaxed);
+}
+
+// Returns the first block at or after "sequence" which is in flight. If there
+// isn't one yet, optionally waits for the main thread to hand one out.
+// Returns nullptr once the scan is stopping or there are no blocks left.
+PortScanner::ScanBlockSharedPtr PortScanner::GetBlock(uint64_t sequence, bool wait)
 {
-	if (m_Coverage.GetNextBlock(m_Block))
+	std::unique_lock<std::mutex> lock(m_BlocksMutex);
+	while (true)
 	{
-		m_BlockIPsToScan = Go(m_Block, Network::PortVector{ 80, 81, 8080 });
+		for (ScanBlockSharedPtr& pBlock : m_Blocks)
+		{
+			if (pBlock->sequence >= sequence)
+			{
+				return pBlock;
+			}
+		}
+
+		if (wait == false || IsStopping() || m_NoMoreBlocks)
+		{
+			return nullptr;
+		}
+
+		m_BlocksCondition.wait(lock);
 	}
 }
 
-// Must be MT safe, as it gets called from the worker threads.
-void PortScanner::OnHTTPServerFound(const Network::IPAddress& address)
+// Called on the main thread. Networks which have been fully probed are recorded
+// in the coverage as they finish, blocks which every worker is done with are
+// marked as scanned, and new ones are handed out to keep m_WantedBlocksInFlight
+// in flight. Once the workers have exited, any blocks left unfinished are given back.
+void PortScanner::UpdateBlocks()
 {
-	std::string url = "http://" + address.ToString();
-	std::string logText = "Found HTTP server: " + url;
-	json message =
+	if (m_Threads.empty() == false && m_ActiveThreads == 0)
 	{
-		{ "type", "log" },
-		{ "level", "info" },
-		{ "plugin", "portscanner" },
-		{ "message", logText }
-	};
-	m_pMessageCallback(message);
+		for (auto& thread : m_Threads)
+		{
+			thread.join();
+		}
+		m_Threads.clear();
+
+		// Hosts left over by a stopped scan.
+		std::lock_guard<std::mutex> lock(m_LiveHostsMutex);
+		m_LiveHosts.clear();
+	}
 
-	message =
+	bool blocksRetired = false;
+	std::unique_lock<std::mutex> lock(m_BlocksMutex);
+	for (ScanBlockVector::iterator it = m_Blocks.begin(); it != m_Blocks.end(); )
 	{
-		{ "type", "http_server_found" },
-		{ "ip_address", address.GetHostAsString() },
-		{ "port", address.GetPort() },
-		{ "url", url }
-	};
-	m_pMessageCallback(message);
+		ScanBlockSharedPtr& pBlock = *it;
+		for (size_t i = 0; i < pBlock->remaining.size(); ++i)
+		{
+			if (pBlock->recorded[i] == false && pBlock->remaining[i] <= 0)
+			{
+				m_Coverage.SetNetworkScanned(Network::IPAddress(pBlock->address.GetHost() + static_cast<uint32_t>(i << 8), 0));
+				pBlock->recorded[i] = true;
+			}
+		}
+
+		if (pBlock->workers == 0 && pBlock->pendingHosts == 0)
+		{
+			m_Coverage.SetBlockState(pBlock->address, Coverage::BlockState::Scanned);
+			if (m_UsingLeases)
+			{
+				m_LeaseClient.Report(pBlock->address, pBlock->recorded, true);
+			}
+			blocksRetired = true;
+			it = m_Blocks.erase(it);
+		}
+		else if (IsScanning() == false)
+		{
+			m_Coverage.ReleaseBlock(pBlock->address);
+			if (m_UsingLeases)
+			{
+				m_LeaseClient.Report(pBlock->address, pBlock->recorded, false);
+			}
+			blocksRetired = true;
+			it = m_Blocks.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	while (IsScanning() && IsStopping() == false && m_NoMoreBlocks == false && static_cast<int>(m_Blocks.size()) < m_WantedBlocksInFlight)
+	{
+		Network::IPAddress address;
+		if (m_UsingLeases)
+		{
+			LeaseClient::Lease lease;
+			const LeaseClient::LeaseResult result = m_LeaseClient.GetLease(lease);
+			if (result == LeaseClient::LeaseResult::Pending)
+			{
+				break;
+			}
+			else if (result == LeaseClient::LeaseResult::Exhausted)
+			{
+				m_NoMoreBlocks = true;
+				break;
+			}
+
+			// Whatever other hosts have scanned in the block is merged into the local coverage.
+			address = lease.block;
+			for (size_t i = 0; i < lease.scanned.size(); ++i)
+			{
+				if (lease.scanned[i])
+				{
+					m_Coverage.SetNetworkScanned(Network::IPAddress(address.GetHost() + static_cast<uint32_t>(i << 8), 0));
+				}
+			}
+		}
+		else if (m_Coverage.GetNextBlock(address) == false)
+		{
+			m_NoMoreBlocks = true;
+			break;
+		}
+
+		m_Coverage.SetBlockState(address, Coverage::BlockState::InProgress);
+		ScanBlockSharedPtr pBlock = std::make_shared<ScanBlock>();
+		pBlock->address = address;
+		pBlock->sequence = m_NextSequence++;
+		pBlock->workers = m_WorkerCount;
+		pBlock->pendingHosts = 0;
+
+		// Networks which were scanned before the block was last interrupted are skipped,
+		// as are excluded addresses, which the generator never hands out.
+		const ExclusionList& exclusions = m_Coverage.GetExclusions();
+		std::vector<uint32_t> networks;
+		for (size_t i = 0; i < pBlock->remaining.size(); ++i)
+		{
+			const Network::IPAddress network(address.GetHost() + static_cast<uint32_t>(i << 8), 0);
+			const int excluded = static_cast<int>(exclusions.GetExcludedCount(network.GetHost(), network.GetHost() + 0xFF));
+			const bool isScanned = m_Coverage.IsNetworkScanned(network) || excluded == 256;
+			pBlock->remaining[i] = isScanned ? 0 : (256 - excluded) * static_cast<int>(m_Ports.size());
+			pBlock->recorded[i] = isScanned;
+			if (isScanned == false)
+			{
+				networks.push_back(network.GetHost());
+			}
+		}
+		pBlock->pGenerator = std::make_unique<IPGenerator>(networks, &exclusions);
+		const bool isPortMajor = m_PortMajor && m_UseLivenessStage == false;
+		pBlock->pGenerator->SetPassCount(isPortMajor ? static_cast<unsigned int>(m_Ports.size()) : 1u);
+		for (std::atomic<uint64_t>& silentHosts : pBlock->silentHosts)
+		{
+			silentHosts = 0;
+		}
+		m_Blocks.push_back(pBlock);
+	}
+	lock.unlock();
+	m_BlocksCondition.notify_all();
+
+	// Finished networks are journaled as they come in, retired blocks are made durable straight away.
+	m_Coverage.Sync(blocksRetired);
 }
 
-void PortScanner::OnThreadCompleted()
+// Called from the worker threads. If the main thread has fallen so far behind that
+// the ring or the worker's arena is full, waits for it to catch up rather than
+// losing the hit.
+void PortScanner::OnHTTPServerFound(BannerArena* pBannerArena, const Network::IPAddress& address, const std::string& banner)
 {
-	if (m_ActiveThreads == 0 && !m_Stop)
+	Hit hit = { address.GetHost(), address.GetPort(), pBannerArena, {} };
+	while (pBannerArena->TryWrite(banner, hit.banner) == false)
 	{
-		ScanNextBlock();
+		if (IsStopping())
+		{
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	while (m_Hits.TryPush(hit) == false)
+	{
+		if (IsStopping())
+		{
+			return;
+		}
+		std::this_thread::yield();
+	}
+}
+
+// Can be called from any thread. The arena lasts until the next scan starts.
+BannerArena* PortScanner::CreateBannerArena()
+{
+	std::lock_guard<std::mutex> lock(m_BannerArenasMutex);
+	m_BannerArenas.push_back(std::make_unique<BannerArena>());
+	return m_BannerArenas.back().get();
+}
+
+// Called on the main thread, on every update.
+// The servers' URLs are written one after the other into the text which gets
+// logged, and the message refers to them there.
+void PortScanner::BroadcastHits()
+{
+	static const std::string sPrefix = "Found HTTP servers: ";
+
+	m_BroadcastHits.clear();
+	m_BroadcastText = sPrefix;
+	Hit hit;
+	while (m_Hits.TryPop(hit))
+	{
+		char address[Network::IPAddress::cMaxStringSize];
+		m_BroadcastText += m_BroadcastHits.empty() ? "http://" : ", http://";
+		m_BroadcastText.append(address, Network::IPAddress(hit.host, hit.port).ToChars(address));
+		m_BroadcastHits.push_back(hit);
+	}
+
+	if (m_BroadcastHits.empty())
+	{
+		return;
+	}
+	else if (m_BroadcastHits.size() == 1)
+	{
+		m_BroadcastText.erase(sPrefix.size() - 3, 1); // "servers: " becomes "server: ".
+	}
+
+	// The banner saves the detector from connecting again just to read the page's title.
+	m_BroadcastServers.clear();
+	const std::string_view text(m_BroadcastText);
+	size_t start = text.find("http://");
+	for (const Hit& broadcastHit : m_BroadcastHits)
+	{
+		const size_t end = std::min(text.find(", ", start), text.size());
+		m_BroadcastServers.push_back({ text.substr(start, end - start), broadcastHit.host, broadcastHit.port, broadcastHit.pBannerArena->Read(broadcastHit.banner) });
+		start = end + 2;
+	}
+
+	m_pMessageCallback(LogMessage(LogMessage::Level::Info, "portscanner", text));
+	m_pMessageCallback(HTTPServersFoundMessage(m_BroadcastServers.data(), m_BroadcastServers.size()));
+
+	// Messages are delivered before the callback returns, so the banners are no longer needed.
+	for (const Hit& broadcastHit : m_BroadcastHits)
+	{
+		broadcastHit.pBannerArena->Release(broadcastHit.banner);
 	}
 }
 
@@ -143,13 +895,31 @@ void PortScanner::DrawUI(ImGuiContext* pContext)
 
 	if (ImGui::CollapsingHeader("Port scanner", ImGuiTreeNodeFlags_DefaultOpen))
 	{
+		DrawRateUI();
+		DrawTimeoutUI();
+		ImGui::SliderInt("Blocks in flight", &m_WantedBlocksInFlight, 1, 16);
+
 		if (IsScanning())
 		{
-			float r = 1.0f - static_cast<float>(GetRemaining()) / static_cast<float>(m_BlockIPsToScan);
+			DrawBlocksUI();
+
+			if (m_UseLivenessStage)
+			{
+				DrawLivenessUI();
+			}
 
-			std::string text = "Block completion (" + m_Block.ToString() + "/8):";
-			ImGui::Text(text.c_str());
-			ImGui::ProgressBar(r);
+			DrawSocketsUI();
+			DrawDistributedUI();
+
+			if (ImGui::TreeNode("Telemetry"))
+			{
+				m_Metrics.DrawUI();
+				if (ImGui::Button("Dump metrics"))
+				{
+					DumpMetrics();
+				}
+				ImGui::TreePop();
+			}
 
 			if (ImGui::Button("Stop scan"))
 			{
@@ -158,30 +928,332 @@ void PortScanner::DrawUI(ImGuiContext* pContext)
 		}
 		else
 		{
-			ImGui::SliderInt("Threads", &m_WantedThreads, 20, 200);    
+#ifdef __linux__
+			ImGui::Checkbox("Event-driven engine", &m_UseEngine);
+#endif
+			if (m_UseEngine)
+			{
+				ImGui::SliderInt("Shards", &m_WantedShards, 1, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+				ImGui::SliderInt("Connections in flight", &m_WantedInFlight, 64, 65536);
+			}
+			else
+			{
+				ImGui::SliderInt("Threads", &m_WantedThreads, 20, 200);
+#ifdef __linux__
+				ImGui::Checkbox("Use io_uring", &m_UseIOUring);
+#endif
+			}
+
+			ImGui::Checkbox("Grab HTTP banners", &m_GrabBanners);
+
+			// Both prune hosts which don't answer, so only one of them can be used at a time.
+			if (ImGui::Checkbox("Liveness pre-pass", &m_UseLivenessStage) && m_UseLivenessStage)
+			{
+				m_PortMajor = false;
+			}
+
+			if (m_UseLivenessStage)
+			{
+				ImGui::InputInt("Liveness port", &m_LivenessPort);
+				m_LivenessPort = std::max(1, std::min(m_LivenessPort, 65535));
+				ImGui::SliderInt("Liveness timeout (ms)", &m_LivenessTimeout, 10, 2000);
+				ImGui::SliderInt("Full probe threads", &m_WantedProbeThreads, 1, 200);
+			}
+			else
+			{
+				ImGui::Checkbox("Port-major order", &m_PortMajor);
+				if (m_PortMajor)
+				{
+					ImGui::Checkbox("Skip hosts silent on the first port", &m_SkipSilentHosts);
+				}
+			}
+
+			DrawDistributedUI();
+
 			if (ImGui::Button("Begin scan"))
 			{
-				ScanNextBlock();
+				StartPortscan();
 			}
 		}
 	}
 }
 
-int PortScanner::Go(Network::IPAddress block, const Network::PortVector& ports)
+// The rate can be changed while scanning. The new value is only sent to be saved
+// in the configuration once the user lets go of the slider.
+void PortScanner::DrawRateUI()
+{
+	if (ImGui::SliderInt("Rate (probes/s)", &m_WantedRate, 0, 100000, m_WantedRate == 0 ? "Unlimited" : "%d"))
+	{
+		m_RateLimiter.SetRate(static_cast<unsigned int>(m_WantedRate));
+		m_RateChanged = true;
+	}
+
+	if (m_RateChanged && ImGui::IsItemActive() == false)
+	{
+		json message =
+		{
+			{ "type", "set_configuration" },
+			{ "web_scanner_rate", m_WantedRate }
+		};
+		m_pMessageCallback(JsonMessage(message));
+		m_RateChanged = false;
+	}
+
+	if (ImGui::SliderInt("Burst (probes)", &m_WantedBurst, 1, 10000))
+	{
+		m_RateLimiter.SetBurst(static_cast<unsigned int>(m_WantedBurst));
+	}
+}
+
+// Like the rate, the bounds apply immediately but are only sent to be saved once
+// the user is done editing them.
+void PortScanner::DrawTimeoutUI()
 {
-	//SDL_assert( m_ActiveThreads == 0 );
-	m_ActiveThreads = m_WantedThreads;
+	if (ImGui::SliderInt("Minimum timeout (ms)", &m_WantedMinimumTimeout, 10, 5000))
+	{
+		m_WantedMaximumTimeout = std::max(m_WantedMaximumTimeout, m_WantedMinimumTimeout);
+		m_TimeoutsChanged = true;
+	}
+
+	if (ImGui::SliderInt("Maximum timeout (ms)", &m_WantedMaximumTimeout, 10, 10000))
+	{
+		m_WantedMinimumTimeout = std::min(m_WantedMinimumTimeout, m_WantedMaximumTimeout);
+		m_TimeoutsChanged = true;
+	}
+
+	if (m_TimeoutsChanged)
+	{
+		m_RTTEstimator.SetTimeoutBounds(static_cast<unsigned int>(m_WantedMinimumTimeout), static_cast<unsigned int>(m_WantedMaximumTimeout));
+
+		if (ImGui::IsAnyItemActive() == false)
+		{
+			json message =
+			{
+				{ "type", "set_configuration" },
+				{ "web_scanner_timeout_min", m_WantedMinimumTimeout },
+				{ "web_scanner_timeout_max", m_WantedMaximumTimeout }
+			};
+			m_pMessageCallback(JsonMessage(message));
+			m_TimeoutsChanged = false;
+		}
+	}
+
+	const unsigned int smoothedRTT = m_RTTEstimator.GetSmoothedRTT();
+	if (smoothedRTT > 0)
+	{
+		ImGui::Text("Smoothed round trip time: %.1f ms", static_cast<float>(smoothedRTT) / 1000.0f);
+	}
+}
+
+void PortScanner::DrawBlocksUI()
+{
+	std::lock_guard<std::mutex> lock(m_BlocksMutex);
+	for (const ScanBlockSharedPtr& pBlock : m_Blocks)
+	{
+		const IPGenerator& generator = *pBlock->pGenerator;
+		float r = 1.0f - static_cast<float>(generator.GetRemaining()) / static_cast<float>(generator.GetCount());
+
+		std::string text = "Block completion (" + pBlock->address.ToString() + "/16):";
+		ImGui::Text(text.c_str());
+		ImGui::ProgressBar(r);
+	}
+}
+
+void PortScanner::DrawSocketsUI()
+{
+	ImGui::Text("Backend: %s", (Network::GetBackend() == Network::Backend::IOUring) ? "io_uring" : "sockets");
+	ImGui::Text("Sockets: %d in use, budget of %d (descriptor limit %d)", m_SocketBudget.GetInUse(), m_SocketBudget.GetCapacity(), m_SocketBudget.GetLimit());
+
+	const uint64_t exhaustedCount = m_SocketBudget.GetExhaustedCount();
+	if (exhaustedCount > 0)
+	{
+		ImGui::Text("Ran out of descriptors %llu times, probes were retried", static_cast<unsigned long long>(exhaustedCount));
+	}
+}
+
+void PortScanner::DrawDistributedUI()
+{
+	if (ImGui::TreeNode("Distributed scanning") == false)
+	{
+		return;
+	}
+
+	bool serveLeases = m_LeaseCoordinator.IsRunning();
+	if (ImGui::Checkbox("Run lease coordinator", &serveLeases))
+	{
+		if (serveLeases)
+		{
+			m_LeaseCoordinator.Start(static_cast<uint16_t>(m_CoordinatorPort), m_CoordinatorLoopbackOnly);
+		}
+		else
+		{
+			m_LeaseCoordinator.Stop();
+		}
+	}
+
+	if (m_LeaseCoordinator.IsRunning())
+	{
+		ImGui::Text("Clients: %d, leases: %d, free blocks: %u, networks scanned: %llu", m_LeaseCoordinator.GetClientCount(), m_LeaseCoordinator.GetLeaseCount(),
+			m_LeaseCoordinator.GetFreeBlockCount(), static_cast<unsigned long long>(m_LeaseCoordinator.GetScannedNetworkCount()));
+	}
+	else
+	{
+		ImGui::InputInt("Coordinator port", &m_CoordinatorPort);
+		m_CoordinatorPort = std::max(1, std::min(m_CoordinatorPort, 65535));
+		ImGui::Checkbox("Loopback only", &m_CoordinatorLoopbackOnly);
+	}
+
+	if (IsScanning())
+	{
+		if (m_UsingLeases)
+		{
+			ImGui::Text("Leasing blocks from %s (%s), %d held", m_LeaseClient.GetCoordinator().ToString().c_str(),
+				m_LeaseClient.IsConnected() ? "connected" : "not connected", m_LeaseClient.GetHeldLeaseCount());
+		}
+	}
+	else
+	{
+		ImGui::Checkbox("Lease blocks from a coordinator", &m_UseCoordinator);
+		if (m_UseCoordinator)
+		{
+			ImGui::InputText("Coordinator address", m_CoordinatorAddress, sizeof(m_CoordinatorAddress));
+			if (Network::IPAddress::IsValid(m_CoordinatorAddress) == false || Network::IPAddress(m_CoordinatorAddress).GetPort() == 0)
+			{
+				ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Expected an address and port, such as 127.0.0.1:%u", static_cast<unsigned int>(LeaseCoordinator::cDefaultPort));
+			}
+		}
+	}
+
+	ImGui::TreePop();
+}
+
+// Written next to the coverage, with everything which affects the scan's speed
+// so that runs with different settings can be told apart.
+void PortScanner::DumpMetrics()
+{
+	json configuration = {
+		{ "engine", m_UseEngine },
+		{ "backend", (Network::GetBackend() == Network::Backend::IOUring) ? "io_uring" : "sockets" },
+		{ "shards", m_WantedShards },
+		{ "threads", m_WantedThreads },
+		{ "in_flight", m_WantedInFlight },
+		{ "rate", m_WantedRate },
+		{ "burst", m_WantedBurst },
+		{ "timeout_min", m_WantedMinimumTimeout },
+		{ "timeout_max", m_WantedMaximumTimeout },
+		{ "ports", m_Ports },
+		{ "liveness_prepass", m_UseLivenessStage },
+		{ "port_major", m_PortMajor },
+		{ "grab_banners", m_GrabBanners },
+		{ "socket_budget", m_SocketBudget.GetCapacity() }
+	};
+
+	const std::string path = "plugins/portscanner/metrics_" + std::to_string(static_cast<long long>(std::time(nullptr))) + ".json";
+	if (m_Metrics.Dump(path, configuration))
+	{
+		printf("Scan metrics written to '%s'.\n", path.c_str());
+	}
+}
+
+void PortScanner::DrawLivenessUI()
+{
+	const uint64_t probes = m_LivenessProbes;
+	const uint64_t liveHosts = m_LiveHostCount;
+	size_t queued = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_LiveHostsMutex);
+		queued = m_LiveHosts.size();
+	}
+
+	const float liveRatio = (probes > 0) ? 100.0f * static_cast<float>(liveHosts) / static_cast<float>(probes) : 0.0f;
+	ImGui::Text("Liveness probes: %llu, live hosts: %llu (%.1f%%)", static_cast<unsigned long long>(probes), static_cast<unsigned long long>(liveHosts), liveRatio);
+	ImGui::Text("Live hosts queued: %llu, fully probed: %llu", static_cast<unsigned long long>(queued), static_cast<unsigned long long>(m_FullProbes.load()));
+}
+
+// Starts the workers, which keep scanning blocks until they run out or are stopped.
+void PortScanner::Go(const Network::PortVector& ports)
+{
+	// Clean up after the previous scan, if its workers haven't been collected yet.
+	UpdateBlocks();
+
+	// Whatever the previous scan's workers found refers to their arenas.
+	BroadcastHits();
+	m_BannerArenas.clear();
+
 	m_Stop = false;
+	m_SocketBudget.Resume();
+	m_RateLimiter.Resume();
+	m_UseIOUring = (Network::SetBackend(m_UseIOUring ? Network::Backend::IOUring : Network::Backend::Sockets) == Network::Backend::IOUring);
 	m_Ports = ports;
-	m_pIPGenerator = std::make_unique<IPGenerator>(block);
-	int remaining = m_pIPGenerator->GetRemaining();
+	m_NoMoreBlocks = false;
 
-	for (int i = 0; i < m_WantedThreads; ++i)
+	// The liveness port is only reported if it is one of the ports being scanned.
+	m_RemainingPorts.clear();
+	m_ReportLivenessPort = false;
+	for (unsigned short port : m_Ports)
 	{
-		m_Threads.emplace_back(&PortScanner::ThreadMain, this);
+		if (port == m_LivenessPort)
+		{
+			m_ReportLivenessPort = true;
+		}
+		else
+		{
+			m_RemainingPorts.push_back(port);
+		}
 	}
+	m_LivenessProbes = 0;
+	m_LiveHostCount = 0;
+	m_FullProbes = 0;
+	m_Metrics.Reset();
 
-	return remaining;
+	// The local coverage is merged into the coordinator's whenever the client connects to a new one.
+	m_UsingLeases = false;
+	if (m_UseCoordinator && Network::IPAddress::IsValid(m_CoordinatorAddress))
+	{
+		const Network::IPAddress coordinator(m_CoordinatorAddress);
+		if (coordinator.GetPort() != 0)
+		{
+			if (m_LeaseClient.IsRunning() == false || m_LeaseClient.GetCoordinator().ToString() != coordinator.ToString())
+			{
+				m_LeaseClient.Start(coordinator, m_Coverage.GetSnapshot());
+			}
+			m_UsingLeases = true;
+		}
+	}
+	else if (m_LeaseClient.IsRunning())
+	{
+		m_LeaseClient.Stop();
+	}
+
+	int workerCount = m_WantedThreads;
+#ifdef __linux__
+	if (m_UseEngine)
+	{
+		workerCount = std::max(1, m_WantedShards);
+	}
+#endif
+	const int probeThreadCount = m_UseLivenessStage ? std::max(1, m_WantedProbeThreads) : 0;
+
+	m_WorkerCount = workerCount;
+	m_ActiveWorkers = workerCount;
+	m_ActiveThreads = workerCount + probeThreadCount;
+	UpdateBlocks();
+	for (int i = 0; i < workerCount; ++i)
+	{
+#ifdef __linux__
+		if (m_UseEngine)
+		{
+			m_Threads.emplace_back(&PortScanner::EngineThreadMain, this, i, workerCount);
+			continue;
+		}
+#endif
+		m_Threads.emplace_back(&PortScanner::ThreadMain, this, i, workerCount);
+	}
+
+	for (int i = 0; i < probeThreadCount; ++i)
+	{
+		m_Threads.emplace_back(&PortScanner::ProbeThreadMain, this);
+	}
 }
 
 bool PortScanner::IsScanning() const
@@ -191,7 +1263,16 @@ bool PortScanner::IsScanning() const
 
 void PortScanner::Stop()
 {
-	m_Stop = true;
+	{
+		std::lock_guard<std::mutex> lock(m_BlocksMutex);
+		m_Stop = true;
+		m_BlocksCondition.notify_all();
+	}
+	m_SocketBudget.Interrupt();
+	m_RateLimiter.Interrupt();
+
+	std::lock_guard<std::mutex> lock(m_LiveHostsMutex);
+	m_LiveHostsCondition.notify_all();
 }
 
 bool PortScanner::IsStopping() const
@@ -199,7 +1280,3 @@ bool PortScanner::IsStopping() const
 	return m_Stop;
 }
 
-int PortScanner::GetRemaining() const
-{
-	return m_pIPGenerator ? m_pIPGenerator->GetRemaining() : 0;
-}
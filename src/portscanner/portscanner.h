@@ -15,14 +15,29 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include "../watcher/plugin.h"
 #include "network/network.h"
+#include "bannerarena.h"
 #include "coverage.h"
+#include "leaseclient.h"
+#include "leasecoordinator.h"
+#include "mpscring.h"
+#include "ratelimiter.h"
+#include "rttestimator.h"
+#include "scanmetrics.h"
+#include "socketbudget.h"
 
 using CURL = void;
 class IPGenerator;
@@ -34,36 +49,187 @@ class PortScanner : public Plugin
 public:
 	PortScanner();
 	virtual ~PortScanner();
-	virtual bool Initialise(PluginMessageCallback pMessageCallback) override;
-	virtual void OnMessageReceived(const nlohmann::json& message) override;
+	virtual bool Initialise(PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions) override;
+	virtual void OnMessage(const Message& message) override;
 	virtual void DrawUI(ImGuiContext* pContext) override;
 
-	void ScanNextBlock();
-
-	int Go(Network::IPAddress block, const Network::PortVector& ports);
+	void Go(const Network::PortVector& ports);
 	void Stop();
 	bool IsStopping() const;
 	bool IsScanning() const;
-	int GetRemaining() const;
 
 private:
-	static void ThreadMain(PortScanner* pPortScanner);
-	void OnHTTPServerFound(const Network::IPAddress& address);
-	void OnThreadCompleted();
+	// A /16 block being scanned. Several blocks are in flight at once, so workers
+	// which are done with their share of one move straight on to the next while
+	// the slower ones are still finishing theirs.
+	struct ScanBlock
+	{
+		Network::IPAddress address;
+		uint64_t sequence;
+		IPGeneratorUniquePtr pGenerator;
+		std::atomic_int workers; // How many workers haven't finished their share yet.
+
+		// Probes left in each of the block's /24 networks, indexed by the third octet,
+		// and which of those networks have been recorded as scanned (main thread only).
+		std::array<std::atomic_int, 256> remaining;
+		std::bitset<256> recorded;
+
+		// In port-major order, the hosts which didn't answer on the first port.
+		std::array<std::atomic<uint64_t>, 65536 / 64> silentHosts;
+
+		// With the liveness stage, hosts which answered but haven't had all their ports probed yet.
+		std::atomic_int pendingHosts;
+	};
+	using ScanBlockSharedPtr = std::shared_ptr<ScanBlock>;
+	using ScanBlockVector = std::vector<ScanBlockSharedPtr>;
+
+	// A host which answered the liveness probe, waiting for the full probe.
+	struct LiveHost
+	{
+		ScanBlockSharedPtr pBlock;
+		Network::IPAddress address;
+	};
+
+	// An open port, as handed from the workers to the main thread. The banner
+	// stays in the worker's arena until the hit has been broadcast.
+	struct Hit
+	{
+		uint32_t host;
+		uint16_t port;
+		BannerArena* pBannerArena;
+		BannerArena::Entry banner;
+	};
+
+	static void ThreadMain(PortScanner* pPortScanner, unsigned int worker, unsigned int workerCount);
+#ifdef __linux__
+	static void EngineThreadMain(PortScanner* pPortScanner, unsigned int shard, unsigned int shardCount);
+	static void PinToCore(unsigned int core);
+#endif
+	static void ProbeThreadMain(PortScanner* pPortScanner);
+	void OnLivenessProbed(const ScanBlockSharedPtr& pBlock, const Network::IPAddress& address, bool isLive);
+	bool GetLiveHost(LiveHost& liveHost);
+	void OnWorkerExited();
+	void OnHTTPServerFound(BannerArena* pBannerArena, const Network::IPAddress& address, const std::string& banner);
+	BannerArena* CreateBannerArena();
+	void BroadcastHits();
+	static void OnProbed(ScanBlock& block, const Network::IPAddress& address, int probes);
+	static bool IsHostSilent(const ScanBlock& block, const Network::IPAddress& address);
+	static void SetHostSilent(ScanBlock& block, const Network::IPAddress& address);
+
+	ScanBlockSharedPtr GetBlock(uint64_t sequence, bool wait);
+	void UpdateBlocks();
 
 	void StartPortscan();
 	void StopPortscan();
+	void DrawRateUI();
+	void DrawTimeoutUI();
+	void DrawBlocksUI();
+	void DrawLivenessUI();
+	void DrawSocketsUI();
+	void DrawDistributedUI();
+	void DumpMetrics();
 
 	PluginMessageCallback m_pMessageCallback;
 	Coverage m_Coverage;
-	int m_BlockIPsToScan;
-	Network::IPAddress m_Block;
 
 	using ThreadVector = std::vector< std::thread >;
 	ThreadVector m_Threads;
 	std::atomic_int m_ActiveThreads;
 	std::atomic_bool m_Stop;
-	IPGeneratorUniquePtr m_pIPGenerator;
 	Network::PortVector m_Ports;
 	int m_WantedThreads;
+	int m_WantedInFlight; // Across all the shards.
+	int m_WantedShards;
+	bool m_UseEngine;
+	bool m_UseIOUring; // For the blocking workers, which connect and close through Network.
+
+	// In port-major order, every address in a block is visited for the first port
+	// before any is visited for the second, and so on. Hosts which didn't answer on
+	// the first port can then be skipped for the others.
+	bool m_PortMajor;
+	bool m_SkipSilentHosts;
+
+	// With the liveness stage, the workers only try a single port on every address
+	// with a short timeout. Hosts which answer, whether the port is open or not, are
+	// queued for a separate pool of threads which probe all the other ports.
+	// Addresses with nothing behind them, which are most of them, never cost more
+	// than one short probe.
+	bool m_UseLivenessStage;
+	int m_LivenessPort;
+	int m_LivenessTimeout; // In milliseconds.
+	int m_WantedProbeThreads;
+	Network::PortVector m_RemainingPorts; // Those which are probed once a host is known to be live.
+	bool m_ReportLivenessPort; // Whether the liveness port is one of the scanned ones.
+	std::atomic_int m_ActiveWorkers; // First stage threads which haven't exited yet.
+	std::mutex m_LiveHostsMutex;
+	std::condition_variable m_LiveHostsCondition;
+	std::deque<LiveHost> m_LiveHosts;
+	std::atomic<uint64_t> m_LivenessProbes;
+	std::atomic<uint64_t> m_LiveHostCount;
+	std::atomic<uint64_t> m_FullProbes;
+
+	// Workers push what they find here, and the main thread broadcasts it all in a
+	// single message on every update. The message callback is never called from
+	// the workers.
+	static constexpr size_t cHitCapacity = 65536;
+	static_assert(std::is_trivially_copyable<Hit>::value, "Hits are copied into the ring on the workers, which must not allocate.");
+	MPSCRing<Hit> m_Hits;
+
+	// One per worker, for as long as the scan lasts.
+	std::mutex m_BannerArenasMutex;
+	std::vector<std::unique_ptr<BannerArena>> m_BannerArenas;
+
+	// Scratch space for BroadcastHits(), kept from one update to the next so
+	// that nothing is allocated once it has grown.
+	std::vector<Hit> m_BroadcastHits;
+	std::vector<HTTPServersFoundMessage::Server> m_BroadcastServers;
+	std::string m_BroadcastText;
+
+	// Open ports are sent a "GET /" on the connection which found them, and the
+	// start of the response is broadcast along with them. See HTTPBanner.
+	bool m_GrabBanners;
+
+	// Blocks are handed out and retired on the main thread, on every update.
+	// Workers walk them in sequence, waiting on m_BlocksCondition for the next one.
+	std::mutex m_BlocksMutex;
+	std::condition_variable m_BlocksCondition;
+	ScanBlockVector m_Blocks;
+	uint64_t m_NextSequence;
+	bool m_NoMoreBlocks;
+	int m_WorkerCount;
+	int m_WantedBlocksInFlight;
+
+	// Shared by all the workers. The rate comes from the application's configuration
+	// and changes made in the UI are sent back so they get saved.
+	RateLimiter m_RateLimiter;
+	int m_WantedRate;
+	int m_WantedBurst;
+	bool m_RateChanged;
+	Network::PortVector m_ConfiguredPorts;
+
+	// Probe timeouts adapt to the measured round trip times, within bounds which
+	// are also part of the configuration.
+	RTTEstimator m_RTTEstimator;
+	int m_WantedMinimumTimeout;
+	int m_WantedMaximumTimeout;
+	bool m_TimeoutsChanged;
+
+	// Every socket the workers open is accounted for here, so a scan with many
+	// connections in flight waits for descriptors rather than running out of them.
+	SocketBudget m_SocketBudget;
+
+	// Outcome counts and latencies of every probe, recorded by the workers.
+	ScanMetrics m_Metrics;
+
+	// Distributed scanning. Blocks can be leased from a coordinator shared with
+	// other hosts, rather than picked from the local coverage, and this instance
+	// can run the coordinator itself. The client is declared last so that its
+	// remaining reports are sent before a local coordinator shuts down.
+	LeaseCoordinator m_LeaseCoordinator;
+	int m_CoordinatorPort;
+	bool m_CoordinatorLoopbackOnly;
+	bool m_UseCoordinator;
+	char m_CoordinatorAddress[64];
+	bool m_UsingLeases; // Whether the current scan's blocks are leased.
+	LeaseClient m_LeaseClient;
 };
\ No newline at end of file
@@ -0,0 +1,229 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <array>
+#include "progressjournal.h"
+
+static constexpr uint32_t cChecksumSeed = 0x57524A31; // "WRJ1"
+
+ProgressJournal::ProgressJournal( const std::string& path ) :
+m_Path( path ),
+m_RotatedPath( path + ".old" ),
+m_pFile( nullptr ),
+m_Size( 0 )
+{
+
+}
+
+ProgressJournal::~ProgressJournal()
+{
+	Flush( true );
+	Close();
+}
+
+uint32_t ProgressJournal::GetChecksum( const Record& record )
+{
+	// 32 bit finaliser from MurmurHash3, which is enough to tell a torn or zeroed record apart.
+	uint32_t h = cChecksumSeed ^ record.first;
+	h ^= ( static_cast< uint32_t >( record.count ) << 16 | static_cast< uint32_t >( record.operation ) ) * 0x9E3779B1;
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+bool ProgressJournal::Replay( Records& records ) const
+{
+	const bool rotatedValid = Replay( m_RotatedPath, records );
+	const bool currentValid = Replay( m_Path, records );
+	return rotatedValid && currentValid;
+}
+
+//-----------------------------------------------------------------------------
+// ProgressJournal::Replay()
+// Records are written as little endian { first (32), count (16), operation (16),
+// checksum (32) }. Reading stops at the first record which fails to validate, as
+// anything after it can't be trusted.
+//-----------------------------------------------------------------------------
+bool ProgressJournal::Replay( const std::string& path, Records& records )
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+	if ( pFile == nullptr )
+	{
+		return true;
+	}
+
+	bool valid = true;
+	std::array< unsigned char, cRecordSize > buffer;
+	while ( true )
+	{
+		const size_t bytesRead = fread( buffer.data(), 1, cRecordSize, pFile );
+		if ( bytesRead < cRecordSize )
+		{
+			valid = ( bytesRead == 0 );
+			break;
+		}
+
+		Record record;
+		record.first = buffer[ 0 ] | buffer[ 1 ] << 8 | buffer[ 2 ] << 16 | static_cast< uint32_t >( buffer[ 3 ] ) << 24;
+		record.count = static_cast< uint16_t >( buffer[ 4 ] | buffer[ 5 ] << 8 );
+		record.operation = static_cast< Operation >( buffer[ 6 ] | buffer[ 7 ] << 8 );
+		const uint32_t checksum = buffer[ 8 ] | buffer[ 9 ] << 8 | buffer[ 10 ] << 16 | static_cast< uint32_t >( buffer[ 11 ] ) << 24;
+		if ( record.count == 0 || record.operation > Operation::Remove || checksum != GetChecksum( record ) )
+		{
+			valid = false;
+			break;
+		}
+		records.push_back( record );
+	}
+
+	fclose( pFile );
+	return valid;
+}
+
+void ProgressJournal::Append( uint32_t first, uint16_t count, Operation operation )
+{
+	const Record record = { first, count, operation };
+	const uint32_t checksum = GetChecksum( record );
+	const uint16_t op = static_cast< uint16_t >( operation );
+	const unsigned char encoded[ cRecordSize ] =
+	{
+		static_cast< unsigned char >( first ), static_cast< unsigned char >( first >> 8 ), static_cast< unsigned char >( first >> 16 ), static_cast< unsigned char >( first >> 24 ),
+		static_cast< unsigned char >( count ), static_cast< unsigned char >( count >> 8 ),
+		static_cast< unsigned char >( op ), static_cast< unsigned char >( op >> 8 ),
+		static_cast< unsigned char >( checksum ), static_cast< unsigned char >( checksum >> 8 ), static_cast< unsigned char >( checksum >> 16 ), static_cast< unsigned char >( checksum >> 24 )
+	};
+	m_Pending.insert( m_Pending.end(), encoded, encoded + cRecordSize );
+}
+
+bool ProgressJournal::Flush( bool sync )
+{
+	if ( m_Pending.empty() == false )
+	{
+		if ( Open() == false )
+		{
+			return false;
+		}
+
+		// Records which couldn't be written are kept, and retried on the next flush.
+		if ( fwrite( m_Pending.data(), 1, m_Pending.size(), m_pFile ) != m_Pending.size() || fflush( m_pFile ) != 0 )
+		{
+			printf( "Failed to write progress journal '%s'.\n", m_Path.c_str() );
+			Close();
+			return false;
+		}
+		m_Size += m_Pending.size();
+		m_Pending.clear();
+	}
+
+	if ( sync && m_pFile != nullptr )
+	{
+#ifdef _WIN32
+		return _commit( _fileno( m_pFile ) ) == 0;
+#else
+		return fsync( fileno( m_pFile ) ) == 0;
+#endif
+	}
+	return true;
+}
+
+size_t ProgressJournal::GetSize() const
+{
+	return m_Size + m_Pending.size();
+}
+
+bool ProgressJournal::HasRotated() const
+{
+	FILE* pFile = fopen( m_RotatedPath.c_str(), "rb" );
+	if ( pFile == nullptr )
+	{
+		return false;
+	}
+	fclose( pFile );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// ProgressJournal::Rotate()
+// Sets the current journal aside, so that its records survive until the
+// snapshot which includes them is durable. Only one journal can be set aside
+// at a time.
+//-----------------------------------------------------------------------------
+bool ProgressJournal::Rotate()
+{
+	if ( HasRotated() || Open() == false || Flush( true ) == false )
+	{
+		return false;
+	}
+
+	Close();
+	if ( rename( m_Path.c_str(), m_RotatedPath.c_str() ) != 0 )
+	{
+		return false;
+	}
+	m_Size = 0;
+	return true;
+}
+
+void ProgressJournal::DiscardRotated()
+{
+	remove( m_RotatedPath.c_str() );
+}
+
+void ProgressJournal::Clear()
+{
+	Close();
+	remove( m_Path.c_str() );
+	DiscardRotated();
+	m_Pending.clear();
+	m_Size = 0;
+}
+
+bool ProgressJournal::Open()
+{
+	if ( m_pFile != nullptr )
+	{
+		return true;
+	}
+
+	m_pFile = fopen( m_Path.c_str(), "ab" );
+	if ( m_pFile == nullptr )
+	{
+		printf( "Failed to open progress journal '%s'.\n", m_Path.c_str() );
+		return false;
+	}
+
+	fseek( m_pFile, 0, SEEK_END );
+	const long size = ftell( m_pFile );
+	m_Size = ( size > 0 ) ? static_cast< size_t >( size ) : 0;
+	return true;
+}
+
+void ProgressJournal::Close()
+{
+	if ( m_pFile != nullptr )
+	{
+		fclose( m_pFile );
+		m_pFile = nullptr;
+	}
+}
@@ -0,0 +1,87 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// ProgressJournal
+// Append-only log of changes made to the coverage since its last snapshot.
+// Appending a record is cheap, so progress can be recorded as it happens and
+// only needs the records written since the last flush to be replayed after a
+// crash. Every record carries a checksum, so a torn write at the end of the
+// journal is detected and ignored.
+// Once the journal grows large it is rotated: new records go to a fresh
+// journal while the old one is kept until a snapshot containing all of its
+// changes has been written, after which it is discarded.
+//-----------------------------------------------------------------------------
+class ProgressJournal
+{
+public:
+	enum class Operation : uint16_t
+	{
+		Add,
+		Remove
+	};
+
+	// Adds or removes "count" consecutive values, starting at "first".
+	struct Record
+	{
+		uint32_t first;
+		uint16_t count;
+		Operation operation;
+	};
+	using Records = std::vector< Record >;
+
+	ProgressJournal( const std::string& path );
+	~ProgressJournal();
+
+	// Reads every valid record, from the rotated journal and then the current one.
+	// Returns false if either of them ended with a damaged record.
+	bool Replay( Records& records ) const;
+
+	void Append( uint32_t first, uint16_t count, Operation operation );
+
+	// Writes the records appended so far. If "sync" is set, only returns once
+	// they are durable.
+	bool Flush( bool sync );
+
+	// Size of the current journal, in bytes.
+	size_t GetSize() const;
+
+	bool HasRotated() const;
+	bool Rotate();
+	void DiscardRotated();
+
+	// Discards both journals, once a snapshot containing everything has been written.
+	void Clear();
+
+private:
+	static uint32_t GetChecksum( const Record& record );
+	static bool Replay( const std::string& path, Records& records );
+	bool Open();
+	void Close();
+
+	static constexpr size_t cRecordSize = 12;
+	std::string m_Path;
+	std::string m_RotatedPath;
+	FILE* m_pFile;
+	std::vector< unsigned char > m_Pending;
+	size_t m_Size;
+};
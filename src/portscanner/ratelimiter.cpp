@@ -0,0 +1,132 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "ratelimiter.h"
+
+RateLimiter::RateLimiter( unsigned int rate, unsigned int burst ) :
+m_TheoreticalArrivalTime( 0 ),
+m_Interval( 0 ),
+m_Tolerance( 0 ),
+m_Rate( 0 ),
+m_Burst( 1 ),
+m_Interrupted( false )
+{
+	SetBurst( burst );
+	SetRate( rate );
+}
+
+void RateLimiter::SetRate( unsigned int rate )
+{
+	m_Rate = rate;
+	m_Interval = ( rate == 0 ) ? 0 : 1000000000ll / rate;
+	UpdateTolerance();
+
+	// Otherwise going from a very low rate to a high one would still have to wait
+	// for tokens scheduled at the old rate.
+	m_TheoreticalArrivalTime = GetNow();
+	m_Condition.notify_all();
+}
+
+unsigned int RateLimiter::GetRate() const
+{
+	return m_Rate;
+}
+
+void RateLimiter::SetBurst( unsigned int burst )
+{
+	m_Burst = std::max( 1u, burst );
+	UpdateTolerance();
+}
+
+unsigned int RateLimiter::GetBurst() const
+{
+	return m_Burst;
+}
+
+// A burst of N tokens means the Nth token can be taken (N - 1) intervals early.
+void RateLimiter::UpdateTolerance()
+{
+	m_Tolerance = m_Interval * static_cast< int64_t >( m_Burst - 1 );
+}
+
+bool RateLimiter::TryAcquire( unsigned int count )
+{
+	const int64_t interval = m_Interval.load( std::memory_order_relaxed );
+	if ( interval == 0 )
+	{
+		return true;
+	}
+
+	const int64_t tolerance = m_Tolerance.load( std::memory_order_relaxed );
+	const int64_t now = GetNow();
+	int64_t arrivalTime = m_TheoreticalArrivalTime.load( std::memory_order_relaxed );
+	int64_t newArrivalTime;
+	do
+	{
+		const int64_t base = std::max( arrivalTime, now );
+		if ( base - now > tolerance )
+		{
+			return false;
+		}
+		newArrivalTime = base + interval * count;
+	}
+	while ( m_TheoreticalArrivalTime.compare_exchange_weak( arrivalTime, newArrivalTime, std::memory_order_relaxed ) == false );
+
+	return true;
+}
+
+// Waits on the condition rather than sleeping, so that Interrupt() doesn't have
+// to wait for the next token, which at low rates can be a long way off.
+bool RateLimiter::Acquire( unsigned int count )
+{
+	while ( TryAcquire( count ) == false )
+	{
+		std::unique_lock< std::mutex > lock( m_Mutex );
+		if ( m_Condition.wait_for( lock, GetWaitTime(), [ this ]() { return m_Interrupted.load(); } ) )
+		{
+			return false;
+		}
+	}
+	return m_Interrupted == false;
+}
+
+void RateLimiter::Interrupt()
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_Interrupted = true;
+	m_Condition.notify_all();
+}
+
+void RateLimiter::Resume()
+{
+	m_Interrupted = false;
+}
+
+std::chrono::microseconds RateLimiter::GetWaitTime() const
+{
+	if ( m_Interval.load( std::memory_order_relaxed ) == 0 )
+	{
+		return std::chrono::microseconds( 0 );
+	}
+
+	const int64_t wait = m_TheoreticalArrivalTime.load( std::memory_order_relaxed ) - m_Tolerance.load( std::memory_order_relaxed ) - GetNow();
+	return std::chrono::microseconds( std::max( wait, static_cast< int64_t >( 0 ) ) / 1000 );
+}
+
+int64_t RateLimiter::GetNow() const
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now().time_since_epoch() ).count();
+}
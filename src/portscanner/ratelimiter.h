@@ -0,0 +1,72 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+//-----------------------------------------------------------------------------
+// RateLimiter
+// Token bucket shared by every scan worker, limiting how many probes are sent
+// per second while allowing short bursts.
+// Implemented as a generic cell rate algorithm: the only state is the
+// theoretical arrival time of the next token, which is updated with a single
+// compare-and-swap, so the limiter is lock free and can be adjusted live.
+// A rate of 0 disables the limiter.
+//-----------------------------------------------------------------------------
+class RateLimiter
+{
+public:
+	RateLimiter( unsigned int rate, unsigned int burst );
+
+	void SetRate( unsigned int rate );
+	unsigned int GetRate() const;
+	void SetBurst( unsigned int burst );
+	unsigned int GetBurst() const;
+
+	// Takes "count" tokens if they are available.
+	bool TryAcquire( unsigned int count = 1 );
+
+	// Takes "count" tokens, sleeping until they become available if necessary.
+	// Returns false if interrupted.
+	bool Acquire( unsigned int count = 1 );
+
+	// Makes every pending and future Acquire() fail, until Resume().
+	void Interrupt();
+	void Resume();
+
+	// How long until a token becomes available.
+	std::chrono::microseconds GetWaitTime() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+	int64_t GetNow() const;
+	void UpdateTolerance();
+
+	std::atomic< int64_t > m_TheoreticalArrivalTime; // In nanoseconds.
+	std::atomic< int64_t > m_Interval; // Nanoseconds between tokens.
+	std::atomic< int64_t > m_Tolerance; // How far ahead of time tokens can be taken.
+	std::atomic< unsigned int > m_Rate;
+	std::atomic< unsigned int > m_Burst;
+	std::atomic_bool m_Interrupted;
+
+	// Only used by workers which have to wait.
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+};
@@ -0,0 +1,533 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <string.h>
+#include "roaringbitmap.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static uint32_t PopCount( uint64_t value )
+{
+#ifdef _MSC_VER
+	return static_cast< uint32_t >( __popcnt64( value ) );
+#else
+	return static_cast< uint32_t >( __builtin_popcountll( value ) );
+#endif
+}
+
+// Mask covering bits [begin, end) of a 64 bit word, with end <= 64.
+static uint64_t GetWordMask( uint32_t begin, uint32_t end )
+{
+	const uint64_t high = ( end == 64 ) ? ~0ull : ( ( 1ull << end ) - 1ull );
+	return high & ~( ( 1ull << begin ) - 1ull );
+}
+
+template< typename T >
+static void Write( unsigned char*& pBuffer, T value )
+{
+	memcpy( pBuffer, &value, sizeof( T ) );
+	pBuffer += sizeof( T );
+}
+
+template< typename T >
+static T Read( const unsigned char*& pBuffer )
+{
+	T value;
+	memcpy( &value, pBuffer, sizeof( T ) );
+	pBuffer += sizeof( T );
+	return value;
+}
+
+//-----------------------------------------------------------------------------
+// Container
+//-----------------------------------------------------------------------------
+
+bool RoaringBitmap::Container::Contains( uint16_t value ) const
+{
+	if ( IsBitmap() )
+	{
+		return ( bitmap[ value >> 6 ] & ( 1ull << ( value & 63 ) ) ) != 0;
+	}
+	else
+	{
+		return std::binary_search( array.begin(), array.end(), value );
+	}
+}
+
+bool RoaringBitmap::Container::Add( uint16_t value )
+{
+	if ( IsBitmap() == false )
+	{
+		std::vector< uint16_t >::iterator it = std::lower_bound( array.begin(), array.end(), value );
+		if ( it != array.end() && *it == value )
+		{
+			return false;
+		}
+
+		if ( cardinality < cMaxArraySize )
+		{
+			array.insert( it, value );
+			cardinality++;
+			return true;
+		}
+
+		// The array is full, switch over to a bitmap.
+		bitmap.assign( cBitmapWords, 0ull );
+		for ( uint16_t v : array )
+		{
+			bitmap[ v >> 6 ] |= 1ull << ( v & 63 );
+		}
+		array.clear();
+		array.shrink_to_fit();
+	}
+
+	uint64_t& word = bitmap[ value >> 6 ];
+	const uint64_t bit = 1ull << ( value & 63 );
+	if ( word & bit )
+	{
+		return false;
+	}
+	word |= bit;
+	cardinality++;
+	return true;
+}
+
+bool RoaringBitmap::Container::Remove( uint16_t value )
+{
+	if ( IsBitmap() == false )
+	{
+		std::vector< uint16_t >::iterator it = std::lower_bound( array.begin(), array.end(), value );
+		if ( it == array.end() || *it != value )
+		{
+			return false;
+		}
+		array.erase( it );
+		cardinality--;
+		return true;
+	}
+
+	uint64_t& word = bitmap[ value >> 6 ];
+	const uint64_t bit = 1ull << ( value & 63 );
+	if ( ( word & bit ) == 0 )
+	{
+		return false;
+	}
+	word &= ~bit;
+	cardinality--;
+
+	// Back to an array once it becomes the smaller representation again.
+	if ( cardinality <= cMaxArraySize )
+	{
+		array.reserve( cardinality );
+		for ( uint32_t v = 0; v < 65536; ++v )
+		{
+			if ( bitmap[ v >> 6 ] & ( 1ull << ( v & 63 ) ) )
+			{
+				array.push_back( static_cast< uint16_t >( v ) );
+			}
+		}
+		bitmap.clear();
+		bitmap.shrink_to_fit();
+	}
+	return true;
+}
+
+uint32_t RoaringBitmap::Container::GetCardinality( uint32_t begin, uint32_t end ) const
+{
+	if ( begin >= end )
+	{
+		return 0;
+	}
+	else if ( begin == 0 && end == 65536 )
+	{
+		return cardinality;
+	}
+
+	if ( IsBitmap() == false )
+	{
+		std::vector< uint16_t >::const_iterator first = std::lower_bound( array.begin(), array.end(), begin );
+		std::vector< uint16_t >::const_iterator last = std::lower_bound( first, array.end(), end );
+		return static_cast< uint32_t >( last - first );
+	}
+
+	const uint32_t firstWord = begin >> 6;
+	const uint32_t lastWord = ( end - 1 ) >> 6;
+	if ( firstWord == lastWord )
+	{
+		return PopCount( bitmap[ firstWord ] & GetWordMask( begin & 63, ( ( end - 1 ) & 63 ) + 1 ) );
+	}
+
+	uint32_t count = PopCount( bitmap[ firstWord ] & GetWordMask( begin & 63, 64 ) );
+	for ( uint32_t word = firstWord + 1; word < lastWord; ++word )
+	{
+		count += PopCount( bitmap[ word ] );
+	}
+	count += PopCount( bitmap[ lastWord ] & GetWordMask( 0, ( ( end - 1 ) & 63 ) + 1 ) );
+	return count;
+}
+
+// A run starts at every value whose predecessor isn't in the set.
+uint32_t RoaringBitmap::Container::GetRunCount() const
+{
+	uint32_t runs = 0;
+	if ( IsBitmap() )
+	{
+		uint64_t carry = 0;
+		for ( uint64_t word : bitmap )
+		{
+			runs += PopCount( word & ~( ( word << 1 ) | carry ) );
+			carry = word >> 63;
+		}
+	}
+	else
+	{
+		for ( size_t i = 0; i < array.size(); ++i )
+		{
+			if ( i == 0 || array[ i ] != array[ i - 1 ] + 1 )
+			{
+				runs++;
+			}
+		}
+	}
+	return runs;
+}
+
+//-----------------------------------------------------------------------------
+// RoaringBitmap
+//-----------------------------------------------------------------------------
+
+void RoaringBitmap::Clear()
+{
+	m_Containers.clear();
+}
+
+bool RoaringBitmap::Contains( uint32_t value ) const
+{
+	const Container* pContainer = FindContainer( static_cast< uint16_t >( value >> 16 ) );
+	return pContainer != nullptr && pContainer->Contains( static_cast< uint16_t >( value & 0xFFFF ) );
+}
+
+void RoaringBitmap::Add( uint32_t value )
+{
+	const uint16_t key = static_cast< uint16_t >( value >> 16 );
+	Container* pContainer = FindContainer( key );
+	if ( pContainer == nullptr )
+	{
+		std::vector< Container >::iterator it = std::lower_bound( m_Containers.begin(), m_Containers.end(), key,
+			[]( const Container& container, uint16_t key ) { return container.key < key; } );
+		Container container;
+		container.key = key;
+		container.cardinality = 0;
+		pContainer = &*m_Containers.insert( it, std::move( container ) );
+	}
+	pContainer->Add( static_cast< uint16_t >( value & 0xFFFF ) );
+}
+
+void RoaringBitmap::Remove( uint32_t value )
+{
+	Container* pContainer = FindContainer( static_cast< uint16_t >( value >> 16 ) );
+	if ( pContainer != nullptr && pContainer->Remove( static_cast< uint16_t >( value & 0xFFFF ) ) && pContainer->cardinality == 0 )
+	{
+		m_Containers.erase( m_Containers.begin() + ( pContainer - m_Containers.data() ) );
+	}
+}
+
+uint64_t RoaringBitmap::GetCardinality( uint64_t begin, uint64_t end ) const
+{
+	if ( begin >= end || begin > 0xFFFFFFFFull )
+	{
+		return 0;
+	}
+
+	uint64_t count = 0;
+	std::vector< Container >::const_iterator it = std::lower_bound( m_Containers.begin(), m_Containers.end(), static_cast< uint16_t >( begin >> 16 ),
+		[]( const Container& container, uint16_t key ) { return container.key < key; } );
+	for ( ; it != m_Containers.end(); ++it )
+	{
+		const Container& container = *it;
+		const uint64_t containerBegin = static_cast< uint64_t >( container.key ) << 16;
+		const uint64_t containerEnd = containerBegin + 65536;
+		if ( containerBegin >= end )
+		{
+			break;
+		}
+
+		const uint32_t localBegin = static_cast< uint32_t >( std::max( begin, containerBegin ) - containerBegin );
+		const uint32_t localEnd = static_cast< uint32_t >( std::min( end, containerEnd ) - containerBegin );
+		count += container.GetCardinality( localBegin, localEnd );
+	}
+	return count;
+}
+
+uint64_t RoaringBitmap::GetCardinality() const
+{
+	uint64_t count = 0;
+	for ( const Container& container : m_Containers )
+	{
+		count += container.cardinality;
+	}
+	return count;
+}
+
+void RoaringBitmap::GetWords( uint32_t begin, size_t wordCount, uint64_t* pWords ) const
+{
+	memset( pWords, 0, wordCount * sizeof( uint64_t ) );
+
+	const uint64_t end = std::min< uint64_t >( static_cast< uint64_t >( begin ) + wordCount * 64, 0x100000000ull );
+	std::vector< Container >::const_iterator it = std::lower_bound( m_Containers.begin(), m_Containers.end(), static_cast< uint16_t >( begin >> 16 ),
+		[]( const Container& container, uint16_t key ) { return container.key < key; } );
+	for ( ; it != m_Containers.end(); ++it )
+	{
+		const Container& container = *it;
+		const uint64_t containerBegin = static_cast< uint64_t >( container.key ) << 16;
+		if ( containerBegin >= end )
+		{
+			break;
+		}
+
+		const uint32_t localBegin = static_cast< uint32_t >( std::max< uint64_t >( begin, containerBegin ) - containerBegin );
+		const uint32_t localEnd = static_cast< uint32_t >( std::min( end, containerBegin + 65536 ) - containerBegin );
+		uint64_t* pContainerWords = pWords + ( containerBegin + localBegin - begin ) / 64;
+		if ( container.IsBitmap() )
+		{
+			memcpy( pContainerWords, &container.bitmap[ localBegin / 64 ], ( localEnd - localBegin ) / 64 * sizeof( uint64_t ) );
+		}
+		else
+		{
+			std::vector< uint16_t >::const_iterator value = std::lower_bound( container.array.begin(), container.array.end(), localBegin );
+			for ( ; value != container.array.end() && *value < localEnd; ++value )
+			{
+				const uint32_t offset = *value - localBegin;
+				pContainerWords[ offset / 64 ] |= 1ull << ( offset % 64 );
+			}
+		}
+	}
+}
+
+const RoaringBitmap::Container* RoaringBitmap::FindContainer( uint16_t key ) const
+{
+	std::vector< Container >::const_iterator it = std::lower_bound( m_Containers.begin(), m_Containers.end(), key,
+		[]( const Container& container, uint16_t key ) { return container.key < key; } );
+	return ( it != m_Containers.end() && it->key == key ) ? &*it : nullptr;
+}
+
+RoaringBitmap::Container* RoaringBitmap::FindContainer( uint16_t key )
+{
+	return const_cast< Container* >( static_cast< const RoaringBitmap* >( this )->FindContainer( key ) );
+}
+
+//-----------------------------------------------------------------------------
+// Serialisation
+// Native byte order:
+//     "WRB1", container count (uint32)
+//     For every container: key (uint16), type (uint16), count (uint32)
+//     For every container, its payload:
+//         Array:  "count" values (uint16)
+//         Bitmap: 1024 words (uint64), "count" being the cardinality
+//         Run:    "count" pairs of start and length - 1 (uint16)
+//-----------------------------------------------------------------------------
+static const char sMagic[ 4 ] = { 'W', 'R', 'B', '1' };
+static constexpr size_t cHeaderSize = sizeof( sMagic ) + sizeof( uint32_t );
+static constexpr size_t cDescriptorSize = sizeof( uint16_t ) * 2 + sizeof( uint32_t );
+
+RoaringBitmap::ContainerType RoaringBitmap::GetSerialisedType( const Container& container, uint32_t& count )
+{
+	const uint32_t runs = container.GetRunCount();
+	const size_t runSize = GetPayloadSize( ContainerType::Run, runs );
+	const size_t arraySize = GetPayloadSize( ContainerType::Array, container.cardinality );
+	const size_t bitmapSize = GetPayloadSize( ContainerType::Bitmap, container.cardinality );
+	if ( runSize < arraySize && runSize < bitmapSize )
+	{
+		count = runs;
+		return ContainerType::Run;
+	}
+
+	count = container.cardinality;
+	return ( arraySize <= bitmapSize ) ? ContainerType::Array : ContainerType::Bitmap;
+}
+
+size_t RoaringBitmap::GetPayloadSize( ContainerType type, uint32_t count )
+{
+	if ( type == ContainerType::Array )
+	{
+		return count * sizeof( uint16_t );
+	}
+	else if ( type == ContainerType::Bitmap )
+	{
+		return cBitmapWords * sizeof( uint64_t );
+	}
+	else
+	{
+		return count * sizeof( uint16_t ) * 2;
+	}
+}
+
+size_t RoaringBitmap::GetSerialisedSize() const
+{
+	size_t size = cHeaderSize;
+	for ( const Container& container : m_Containers )
+	{
+		uint32_t count;
+		const ContainerType type = GetSerialisedType( container, count );
+		size += cDescriptorSize + GetPayloadSize( type, count );
+	}
+	return size;
+}
+
+// The buffer must be at least GetSerialisedSize() bytes.
+void RoaringBitmap::Serialise( unsigned char* pBuffer ) const
+{
+	memcpy( pBuffer, sMagic, sizeof( sMagic ) );
+	pBuffer += sizeof( sMagic );
+	Write< uint32_t >( pBuffer, static_cast< uint32_t >( m_Containers.size() ) );
+
+	std::vector< ContainerType > types;
+	types.reserve( m_Containers.size() );
+	for ( const Container& container : m_Containers )
+	{
+		uint32_t count;
+		types.push_back( GetSerialisedType( container, count ) );
+		Write< uint16_t >( pBuffer, container.key );
+		Write< uint16_t >( pBuffer, static_cast< uint16_t >( types.back() ) );
+		Write< uint32_t >( pBuffer, count );
+	}
+
+	for ( size_t i = 0; i < m_Containers.size(); ++i )
+	{
+		const Container& container = m_Containers[ i ];
+		if ( types[ i ] == ContainerType::Bitmap )
+		{
+			std::vector< uint64_t > bitmap( cBitmapWords, 0ull );
+			container.ForEach( [ &bitmap ]( uint16_t v ) { bitmap[ v >> 6 ] |= 1ull << ( v & 63 ); } );
+			memcpy( pBuffer, bitmap.data(), cBitmapWords * sizeof( uint64_t ) );
+			pBuffer += cBitmapWords * sizeof( uint64_t );
+		}
+		else if ( types[ i ] == ContainerType::Array )
+		{
+			container.ForEach( [ &pBuffer ]( uint16_t v ) { Write< uint16_t >( pBuffer, v ); } );
+		}
+		else
+		{
+			uint32_t runStart = 0;
+			uint32_t runEnd = 0; // One past the last value of the current run.
+			container.ForEach( [ &pBuffer, &runStart, &runEnd ]( uint16_t v )
+			{
+				if ( v != runEnd || runEnd == 0 )
+				{
+					if ( runEnd != 0 )
+					{
+						Write< uint16_t >( pBuffer, static_cast< uint16_t >( runStart ) );
+						Write< uint16_t >( pBuffer, static_cast< uint16_t >( runEnd - runStart - 1 ) );
+					}
+					runStart = v;
+				}
+				runEnd = v + 1u;
+			} );
+			Write< uint16_t >( pBuffer, static_cast< uint16_t >( runStart ) );
+			Write< uint16_t >( pBuffer, static_cast< uint16_t >( runEnd - runStart - 1 ) );
+		}
+	}
+}
+
+bool RoaringBitmap::Deserialise( const unsigned char* pBuffer, size_t size )
+{
+	Clear();
+
+	if ( size < cHeaderSize || memcmp( pBuffer, sMagic, sizeof( sMagic ) ) != 0 )
+	{
+		return false;
+	}
+
+	const unsigned char* pEnd = pBuffer + size;
+	pBuffer += sizeof( sMagic );
+	const uint32_t containerCount = Read< uint32_t >( pBuffer );
+	if ( containerCount > 65536 || static_cast< size_t >( pEnd - pBuffer ) < containerCount * cDescriptorSize )
+	{
+		return false;
+	}
+
+	const unsigned char* pPayload = pBuffer + containerCount * cDescriptorSize;
+	m_Containers.resize( containerCount );
+	for ( uint32_t i = 0; i < containerCount; ++i )
+	{
+		Container& container = m_Containers[ i ];
+		container.key = Read< uint16_t >( pBuffer );
+		const ContainerType type = static_cast< ContainerType >( Read< uint16_t >( pBuffer ) );
+		const uint32_t count = Read< uint32_t >( pBuffer );
+		if ( ( i > 0 && container.key <= m_Containers[ i - 1 ].key ) ||
+			type > ContainerType::Run || count > 65536 ||
+			static_cast< size_t >( pEnd - pPayload ) < GetPayloadSize( type, count ) )
+		{
+			Clear();
+			return false;
+		}
+
+		container.cardinality = 0;
+		if ( type == ContainerType::Array )
+		{
+			for ( uint32_t j = 0; j < count; ++j )
+			{
+				container.Add( Read< uint16_t >( pPayload ) );
+			}
+		}
+		else if ( type == ContainerType::Bitmap )
+		{
+			container.bitmap.resize( cBitmapWords );
+			memcpy( container.bitmap.data(), pPayload, cBitmapWords * sizeof( uint64_t ) );
+			pPayload += cBitmapWords * sizeof( uint64_t );
+			for ( uint64_t word : container.bitmap )
+			{
+				container.cardinality += PopCount( word );
+			}
+		}
+		else
+		{
+			// Runs are expanded into a bitmap, which is turned back into an array if sparse enough.
+			container.bitmap.assign( cBitmapWords, 0ull );
+			for ( uint32_t j = 0; j < count; ++j )
+			{
+				const uint32_t start = Read< uint16_t >( pPayload );
+				const uint32_t end = std::min( start + Read< uint16_t >( pPayload ) + 1u, 65536u );
+				for ( uint32_t v = start; v < end; ++v )
+				{
+					container.bitmap[ v >> 6 ] |= 1ull << ( v & 63 );
+				}
+			}
+
+			for ( uint64_t word : container.bitmap )
+			{
+				container.cardinality += PopCount( word );
+			}
+
+			if ( container.cardinality <= cMaxArraySize )
+			{
+				container.ForEach( [ &container ]( uint16_t v ) { container.array.push_back( v ); } );
+				container.bitmap.clear();
+				container.bitmap.shrink_to_fit();
+			}
+		}
+
+		if ( container.cardinality == 0 )
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
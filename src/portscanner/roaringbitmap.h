@@ -0,0 +1,119 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// RoaringBitmap
+// Compressed set of 32 bit values, following the layout of Roaring bitmaps:
+// values are split into containers by their top 16 bits, and each container
+// stores its bottom 16 bits either as a sorted array, while sparse, or as a
+// plain 8 KB bitmap once dense.
+// When serialised, containers made of long stretches of consecutive values
+// are stored as runs instead, so a fully scanned region costs a few bytes.
+//-----------------------------------------------------------------------------
+class RoaringBitmap
+{
+public:
+	void Clear();
+
+	bool Contains( uint32_t value ) const;
+	void Add( uint32_t value );
+	void Remove( uint32_t value );
+
+	// How many values in [begin, end) are in the set.
+	uint64_t GetCardinality( uint64_t begin, uint64_t end ) const;
+	uint64_t GetCardinality() const;
+
+	// Copies the set's bits for [begin, begin + 64 * wordCount) into pWords, the
+	// lowest value in the lowest bit. "begin" must be a multiple of 64.
+	void GetWords( uint32_t begin, size_t wordCount, uint64_t* pWords ) const;
+
+	// Calls f( value ) for every value in the set, in ascending order.
+	template< typename F > void ForEach( F f ) const
+	{
+		for ( const Container& container : m_Containers )
+		{
+			const uint32_t base = static_cast< uint32_t >( container.key ) << 16;
+			container.ForEach( [ base, &f ]( uint16_t value ) { f( base | value ); } );
+		}
+	}
+
+	size_t GetSerialisedSize() const;
+	void Serialise( unsigned char* pBuffer ) const;
+	bool Deserialise( const unsigned char* pBuffer, size_t size );
+
+private:
+	static constexpr uint32_t cMaxArraySize = 4096;
+	static constexpr uint32_t cBitmapWords = 65536 / 64;
+
+	struct Container
+	{
+		uint16_t key;
+		uint32_t cardinality;
+		std::vector< uint16_t > array; // Sorted, while the container is sparse.
+		std::vector< uint64_t > bitmap; // Otherwise.
+
+		bool IsBitmap() const { return bitmap.empty() == false; }
+		bool Contains( uint16_t value ) const;
+		bool Add( uint16_t value );
+		bool Remove( uint16_t value );
+		uint32_t GetCardinality( uint32_t begin, uint32_t end ) const;
+		uint32_t GetRunCount() const;
+
+		// Calls f( value ) for every value in the container, in ascending order.
+		template< typename F > void ForEach( F f ) const
+		{
+			if ( IsBitmap() )
+			{
+				for ( uint32_t word = 0; word < cBitmapWords; ++word )
+				{
+					for ( uint32_t bit = 0; bit < 64; ++bit )
+					{
+						if ( bitmap[ word ] & ( 1ull << bit ) )
+						{
+							f( static_cast< uint16_t >( word * 64 + bit ) );
+						}
+					}
+				}
+			}
+			else
+			{
+				for ( uint16_t value : array )
+				{
+					f( value );
+				}
+			}
+		}
+	};
+
+	enum class ContainerType : uint16_t
+	{
+		Array,
+		Bitmap,
+		Run
+	};
+
+	static ContainerType GetSerialisedType( const Container& container, uint32_t& count );
+	static size_t GetPayloadSize( ContainerType type, uint32_t count );
+	const Container* FindContainer( uint16_t key ) const;
+	Container* FindContainer( uint16_t key );
+
+	std::vector< Container > m_Containers; // Sorted by key.
+};
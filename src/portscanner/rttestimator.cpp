@@ -0,0 +1,128 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "rttestimator.h"
+
+static constexpr uint64_t cFieldBits = 28;
+static constexpr uint64_t cFieldMask = ( 1ull << cFieldBits ) - 1ull;
+
+static uint32_t GetTag( uint64_t estimate ) { return static_cast< uint32_t >( estimate >> ( cFieldBits * 2 ) ); }
+static uint32_t GetSmoothed( uint64_t estimate ) { return static_cast< uint32_t >( ( estimate >> cFieldBits ) & cFieldMask ); }
+static uint32_t GetVariation( uint64_t estimate ) { return static_cast< uint32_t >( estimate & cFieldMask ); }
+
+static uint64_t MakeEstimate( uint32_t tag, uint64_t smoothed, uint64_t variation )
+{
+	return ( static_cast< uint64_t >( tag ) << ( cFieldBits * 2 ) ) | ( std::min( smoothed, cFieldMask ) << cFieldBits ) | std::min( variation, cFieldMask );
+}
+
+RTTEstimator::RTTEstimator( unsigned int minimumTimeout, unsigned int maximumTimeout ) :
+m_Networks24( std::make_unique< Estimate[] >( cTableSize ) ),
+m_Networks16( std::make_unique< Estimate[] >( cTableSize ) ),
+m_Global( 0 )
+{
+	for ( size_t i = 0; i < cTableSize; ++i )
+	{
+		m_Networks24[ i ] = 0;
+		m_Networks16[ i ] = 0;
+	}
+
+	SetTimeoutBounds( minimumTimeout, maximumTimeout );
+}
+
+void RTTEstimator::AddSample( const Network::IPAddress& address, unsigned int rtt )
+{
+	// A smoothed round trip time of 0 marks an entry without samples.
+	rtt = std::max( rtt, 1u );
+
+	const uint32_t network24 = address.GetHost() >> 8;
+	Update( m_Networks24[ network24 & 0xFFFF ], network24 >> 16, rtt );
+	Update( m_Networks16[ address.GetHost() >> 16 ], 0, rtt );
+	Update( m_Global, 0, rtt );
+}
+
+unsigned int RTTEstimator::GetTimeout( const Network::IPAddress& address ) const
+{
+	const uint32_t network24 = address.GetHost() >> 8;
+	unsigned int timeout;
+	if ( GetTimeout( m_Networks24[ network24 & 0xFFFF ], network24 >> 16, timeout ) ||
+		GetTimeout( m_Networks16[ address.GetHost() >> 16 ], 0, timeout ) ||
+		GetTimeout( m_Global, 0, timeout ) )
+	{
+		return timeout;
+	}
+
+	// Nothing to go on yet, so allow as long as possible.
+	return GetMaximumTimeout();
+}
+
+unsigned int RTTEstimator::GetSmoothedRTT() const
+{
+	return GetSmoothed( m_Global.load( std::memory_order_relaxed ) );
+}
+
+void RTTEstimator::SetTimeoutBounds( unsigned int minimumTimeout, unsigned int maximumTimeout )
+{
+	m_MinimumTimeout = std::max( minimumTimeout, 1u );
+	m_MaximumTimeout = std::max( maximumTimeout, m_MinimumTimeout.load() );
+}
+
+unsigned int RTTEstimator::GetMinimumTimeout() const
+{
+	return m_MinimumTimeout;
+}
+
+unsigned int RTTEstimator::GetMaximumTimeout() const
+{
+	return m_MaximumTimeout;
+}
+
+// RFC 6298: the first sample initialises the estimate, after which
+// RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| and SRTT = 7/8 SRTT + 1/8 R.
+// An entry which belonged to a different network is simply taken over.
+void RTTEstimator::Update( Estimate& estimate, uint32_t tag, unsigned int rtt )
+{
+	uint64_t current = estimate.load( std::memory_order_relaxed );
+	uint64_t updated;
+	do
+	{
+		const uint64_t smoothed = GetSmoothed( current );
+		if ( smoothed == 0 || GetTag( current ) != tag )
+		{
+			updated = MakeEstimate( tag, rtt, rtt / 2 );
+		}
+		else
+		{
+			const uint64_t difference = ( smoothed > rtt ) ? smoothed - rtt : rtt - smoothed;
+			updated = MakeEstimate( tag, ( smoothed * 7 + rtt ) / 8, ( GetVariation( current ) * 3 + difference ) / 4 );
+		}
+	}
+	while ( estimate.compare_exchange_weak( current, updated, std::memory_order_relaxed ) == false );
+}
+
+// RTO = SRTT + 4 * RTTVAR, rounded up to the next millisecond.
+bool RTTEstimator::GetTimeout( const Estimate& estimate, uint32_t tag, unsigned int& timeout ) const
+{
+	const uint64_t current = estimate.load( std::memory_order_relaxed );
+	const uint64_t smoothed = GetSmoothed( current );
+	if ( smoothed == 0 || GetTag( current ) != tag )
+	{
+		return false;
+	}
+
+	const uint64_t rto = ( smoothed + GetVariation( current ) * 4 + 999 ) / 1000;
+	timeout = std::max( GetMinimumTimeout(), static_cast< unsigned int >( std::min< uint64_t >( rto, GetMaximumTimeout() ) ) );
+	return true;
+}
@@ -0,0 +1,67 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <network/network.h>
+
+//-----------------------------------------------------------------------------
+// RTTEstimator
+// Derives probe timeouts from the round trip times actually measured, rather
+// than waiting the same fixed amount for every address.
+// Keeps a smoothed round trip time and its variation, the same way TCP computes
+// its retransmission timeout (RFC 6298), for every /24 network. Networks we
+// haven't heard back from yet fall back to their /16, and then to the
+// estimate across all the addresses probed so far.
+// Only successful and refused connections are sampled, as both involve a full
+// round trip to the host. Shared by every scan worker and lock free.
+//-----------------------------------------------------------------------------
+class RTTEstimator
+{
+public:
+	RTTEstimator( unsigned int minimumTimeout, unsigned int maximumTimeout );
+
+	// Round trip time in microseconds.
+	void AddSample( const Network::IPAddress& address, unsigned int rtt );
+
+	// Timeout for a probe to this address, in milliseconds, clamped to the bounds.
+	unsigned int GetTimeout( const Network::IPAddress& address ) const;
+
+	// Smoothed round trip time across every address, in microseconds, or 0 without any samples.
+	unsigned int GetSmoothedRTT() const;
+
+	void SetTimeoutBounds( unsigned int minimumTimeout, unsigned int maximumTimeout );
+	unsigned int GetMinimumTimeout() const;
+	unsigned int GetMaximumTimeout() const;
+
+private:
+	// Every estimate is packed into 64 bits so it can be updated with a single
+	// compare-and-swap: the top 8 bits identify which network the entry currently
+	// belongs to, followed by 28 bits each for the smoothed round trip time and
+	// its variation, in microseconds.
+	using Estimate = std::atomic< uint64_t >;
+	static void Update( Estimate& estimate, uint32_t tag, unsigned int rtt );
+	bool GetTimeout( const Estimate& estimate, uint32_t tag, unsigned int& timeout ) const;
+
+	static constexpr size_t cTableSize = 65536;
+	std::unique_ptr< Estimate[] > m_Networks24; // Indexed by the middle 16 bits of the /24, tagged with the top 8.
+	std::unique_ptr< Estimate[] > m_Networks16;
+	Estimate m_Global;
+	std::atomic< unsigned int > m_MinimumTimeout;
+	std::atomic< unsigned int > m_MaximumTimeout;
+};
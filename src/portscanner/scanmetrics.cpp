@@ -0,0 +1,243 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <cfloat>
+#include <cstdio>
+#include <fstream>
+#include <imgui/imgui.h>
+#include "scanmetrics.h"
+
+ScanMetrics::ScanMetrics()
+{
+	Reset();
+}
+
+ScanRecorder* ScanMetrics::CreateRecorder()
+{
+	std::lock_guard< std::mutex > lock( m_RecordersMutex );
+	m_Recorders.push_back( std::make_unique< ScanRecorder >() );
+	return m_Recorders.back().get();
+}
+
+void ScanMetrics::Reset()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_RecordersMutex );
+		m_Recorders.clear();
+	}
+
+	m_StartTime = Clock::now();
+	m_LastSampleTime = m_StartTime;
+	m_Counts.fill( 0 );
+	m_Histogram.fill( 0 );
+	m_History.clear();
+}
+
+void ScanMetrics::Merge( Counts& counts, Histogram& histogram )
+{
+	counts.fill( 0 );
+	histogram.fill( 0 );
+
+	std::lock_guard< std::mutex > lock( m_RecordersMutex );
+	for ( const std::unique_ptr< ScanRecorder >& pRecorder : m_Recorders )
+	{
+		pRecorder->AddTo( counts, histogram );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ScanMetrics::Update()
+// Once a second, turns the difference between the merged counters and the
+// previous sample's into rates, and the latencies recorded in between into
+// percentiles, so that the plots show how the scan behaves now rather than
+// on average since it started.
+//-----------------------------------------------------------------------------
+void ScanMetrics::Update()
+{
+	const Clock::time_point now = Clock::now();
+	const std::chrono::duration< float > elapsed = now - m_LastSampleTime;
+	if ( elapsed.count() < 1.0f )
+	{
+		return;
+	}
+
+	Counts counts;
+	Histogram histogram;
+	Merge( counts, histogram );
+
+	uint64_t probes = 0;
+	for ( size_t i = 0; i < ScanRecorder::cResultCount; ++i )
+	{
+		probes += counts[ i ] - m_Counts[ i ];
+	}
+
+	Histogram window;
+	for ( size_t i = 0; i < ScanRecorder::cBucketCount; ++i )
+	{
+		window[ i ] = histogram[ i ] - m_Histogram[ i ];
+	}
+
+	const size_t success = static_cast< size_t >( Network::Result::Success );
+	const size_t timeout = static_cast< size_t >( Network::Result::Timeout );
+	Sample sample;
+	sample.probes = static_cast< float >( probes ) / elapsed.count();
+	sample.open = static_cast< float >( counts[ success ] - m_Counts[ success ] ) / elapsed.count();
+	sample.timeouts = static_cast< float >( counts[ timeout ] - m_Counts[ timeout ] ) / elapsed.count();
+	sample.latency50 = static_cast< float >( ScanRecorder::GetPercentile( window, 0.5 ) ) / 1000.0f;
+	sample.latency99 = static_cast< float >( ScanRecorder::GetPercentile( window, 0.99 ) ) / 1000.0f;
+
+	m_History.push_back( sample );
+	if ( m_History.size() > cHistorySize )
+	{
+		m_History.erase( m_History.begin() );
+	}
+
+	m_Counts = counts;
+	m_Histogram = histogram;
+	m_LastSampleTime = now;
+}
+
+void ScanMetrics::PlotHistory( const char* pLabel, float Sample::* pValue, const char* pFormat )
+{
+	m_PlotValues.clear();
+	for ( const Sample& sample : m_History )
+	{
+		m_PlotValues.push_back( sample.*pValue );
+	}
+
+	char overlay[ 32 ];
+	snprintf( overlay, sizeof( overlay ), pFormat, m_PlotValues.empty() ? 0.0f : m_PlotValues.back() );
+	ImGui::PlotLines( pLabel, m_PlotValues.data(), static_cast< int >( m_PlotValues.size() ), 0, overlay, 0.0f, FLT_MAX, ImVec2( 0.0f, 48.0f ) );
+}
+
+void ScanMetrics::DrawUI()
+{
+	Counts counts;
+	Histogram histogram;
+	Merge( counts, histogram );
+
+	uint64_t attempts = 0;
+	for ( uint64_t count : counts )
+	{
+		attempts += count;
+	}
+	const std::chrono::duration< float > duration = Clock::now() - m_StartTime;
+	ImGui::Text( "Attempts: %llu in %.0fs", static_cast< unsigned long long >( attempts ), duration.count() );
+
+	PlotHistory( "Probes/s", &Sample::probes, "%.0f" );
+	PlotHistory( "Open/s", &Sample::open, "%.1f" );
+	PlotHistory( "Timeouts/s", &Sample::timeouts, "%.0f" );
+	PlotHistory( "p50 (ms)", &Sample::latency50, "%.1f" );
+	PlotHistory( "p99 (ms)", &Sample::latency99, "%.1f" );
+
+	if ( attempts == 0 )
+	{
+		return;
+	}
+
+	ImGui::Text( "Outcomes:" );
+	for ( size_t i = 0; i < ScanRecorder::cResultCount; ++i )
+	{
+		if ( counts[ i ] > 0 )
+		{
+			const std::string name = Network::ToString( static_cast< Network::Result >( i ) );
+			ImGui::BulletText( "%s: %llu (%.2f%%)", name.c_str(), static_cast< unsigned long long >( counts[ i ] ), 100.0 * counts[ i ] / attempts );
+		}
+	}
+
+	size_t lastBucket = 0;
+	for ( size_t i = 0; i < ScanRecorder::cBucketCount; ++i )
+	{
+		if ( histogram[ i ] > 0 )
+		{
+			lastBucket = i;
+		}
+	}
+
+	ImGui::Text( "Round trip latency: p50 %.2fms, p90 %.2fms, p99 %.2fms, p99.9 %.2fms",
+		ScanRecorder::GetPercentile( histogram, 0.5 ) / 1000.0, ScanRecorder::GetPercentile( histogram, 0.9 ) / 1000.0,
+		ScanRecorder::GetPercentile( histogram, 0.99 ) / 1000.0, ScanRecorder::GetPercentile( histogram, 0.999 ) / 1000.0 );
+
+	m_PlotValues.clear();
+	for ( size_t i = 0; i <= lastBucket; ++i )
+	{
+		m_PlotValues.push_back( static_cast< float >( histogram[ i ] ) );
+	}
+	ImGui::PlotHistogram( "Latency", m_PlotValues.data(), static_cast< int >( m_PlotValues.size() ), 0, nullptr, 0.0f, FLT_MAX, ImVec2( 0.0f, 64.0f ) );
+}
+
+bool ScanMetrics::Dump( const std::string& path, const json& configuration )
+{
+	Counts counts;
+	Histogram histogram;
+	Merge( counts, histogram );
+
+	// Several results can share a name on some platforms, so they're summed.
+	json results = json::object();
+	for ( size_t i = 0; i < ScanRecorder::cResultCount; ++i )
+	{
+		if ( counts[ i ] > 0 )
+		{
+			const std::string name = Network::ToString( static_cast< Network::Result >( i ) );
+			results[ name ] = results.value( name, uint64_t( 0 ) ) + counts[ i ];
+		}
+	}
+
+	json buckets = json::array();
+	for ( size_t i = 0; i < ScanRecorder::cBucketCount; ++i )
+	{
+		if ( histogram[ i ] > 0 )
+		{
+			const uint64_t last = ( i + 1 < ScanRecorder::cBucketCount ) ? ScanRecorder::GetBucketLowerBound( i + 1 ) - 1 : UINT32_MAX;
+			buckets.push_back( { ScanRecorder::GetBucketLowerBound( i ), last, histogram[ i ] } );
+		}
+	}
+
+	json history = json::array();
+	for ( const Sample& sample : m_History )
+	{
+		history.push_back( {
+			{ "probes", sample.probes },
+			{ "open", sample.open },
+			{ "timeouts", sample.timeouts },
+			{ "latency_p50_ms", sample.latency50 },
+			{ "latency_p99_ms", sample.latency99 }
+		} );
+	}
+
+	const std::chrono::duration< double > duration = Clock::now() - m_StartTime;
+	json document = {
+		{ "configuration", configuration },
+		{ "duration_s", duration.count() },
+		{ "results", results },
+		{ "latency_us", {
+			{ "p50", ScanRecorder::GetPercentile( histogram, 0.5 ) },
+			{ "p90", ScanRecorder::GetPercentile( histogram, 0.9 ) },
+			{ "p99", ScanRecorder::GetPercentile( histogram, 0.99 ) },
+			{ "p99.9", ScanRecorder::GetPercentile( histogram, 0.999 ) },
+			{ "histogram", buckets }
+		} },
+		{ "per_second", history }
+	};
+
+	std::ofstream file( path );
+	if ( file.good() == false )
+	{
+		printf( "Failed to write metrics to '%s'.\n", path.c_str() );
+		return false;
+	}
+	file << document.dump( 1, '\t' );
+	return file.good();
+}
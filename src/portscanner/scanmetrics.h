@@ -0,0 +1,83 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../watcher/plugin.h"
+#include "scanrecorder.h"
+
+//-----------------------------------------------------------------------------
+// ScanMetrics
+// Outcomes and connect latencies of every connection attempt the scanner
+// makes. Each worker records into its own ScanRecorder, so recording never
+// contends. The main thread merges them once a second into a sliding window
+// of rates and latency percentiles, for the UI to plot and for Dump() to
+// write out so that runs can be compared offline.
+//-----------------------------------------------------------------------------
+class ScanMetrics
+{
+public:
+	using Counts = ScanRecorder::Counts;
+	using Histogram = ScanRecorder::Histogram;
+
+	ScanMetrics();
+
+	// Can be called from any thread. The recorder lasts until the next Reset().
+	ScanRecorder* CreateRecorder();
+
+	// Only while nothing is recording.
+	void Reset();
+
+	// Called on the main thread, on every update.
+	void Update();
+	void DrawUI();
+
+	// Writes everything as JSON, along with the scan's configuration.
+	bool Dump( const std::string& path, const json& configuration );
+
+private:
+	void Merge( Counts& counts, Histogram& histogram );
+
+	using Clock = std::chrono::steady_clock;
+
+	// One entry per second, the oldest first.
+	struct Sample
+	{
+		float probes; // Per second, as are the others.
+		float open;
+		float timeouts;
+		float latency50; // In milliseconds.
+		float latency99;
+	};
+	static constexpr size_t cHistorySize = 120;
+
+	void PlotHistory( const char* pLabel, float Sample::* pValue, const char* pFormat );
+
+	std::mutex m_RecordersMutex;
+	std::vector< std::unique_ptr< ScanRecorder > > m_Recorders;
+
+	Clock::time_point m_StartTime;
+	Clock::time_point m_LastSampleTime;
+	Counts m_Counts;
+	Histogram m_Histogram;
+	std::vector< Sample > m_History;
+	std::vector< float > m_PlotValues;
+};
@@ -0,0 +1,113 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include "scanrecorder.h"
+
+ScanRecorder::ScanRecorder()
+{
+	for ( std::atomic< uint64_t >& counter : m_Results )
+	{
+		counter.store( 0, std::memory_order_relaxed );
+	}
+	for ( std::atomic< uint64_t >& counter : m_Latencies )
+	{
+		counter.store( 0, std::memory_order_relaxed );
+	}
+}
+
+void ScanRecorder::Record( Network::Result result, unsigned int time )
+{
+	const size_t index = static_cast< size_t >( result );
+	Increment( m_Results[ index < cResultCount ? index : cResultCount - 1 ] );
+	if ( result == Network::Result::Success || result == Network::Result::ConnectionRefused )
+	{
+		Increment( m_Latencies[ GetBucket( time ) ] );
+	}
+}
+
+// Only the owning thread writes, so there's no need for a locked increment.
+void ScanRecorder::Increment( std::atomic< uint64_t >& counter )
+{
+	counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+void ScanRecorder::AddTo( Counts& counts, Histogram& histogram ) const
+{
+	for ( size_t i = 0; i < cResultCount; ++i )
+	{
+		counts[ i ] += m_Results[ i ].load( std::memory_order_relaxed );
+	}
+	for ( size_t i = 0; i < cBucketCount; ++i )
+	{
+		histogram[ i ] += m_Latencies[ i ].load( std::memory_order_relaxed );
+	}
+}
+
+size_t ScanRecorder::GetBucket( unsigned int time )
+{
+	if ( time < 2 * cSubBuckets )
+	{
+		return time;
+	}
+
+	unsigned int msb = 5;
+	while ( msb < 31 && ( time >> ( msb + 1 ) ) != 0 )
+	{
+		msb++;
+	}
+
+	// The four bits below the most significant one pick the sub-bucket.
+	const unsigned int shift = msb - 4;
+	return 2 * cSubBuckets + ( msb - 5 ) * cSubBuckets + ( ( time >> shift ) - cSubBuckets );
+}
+
+uint64_t ScanRecorder::GetBucketLowerBound( size_t bucket )
+{
+	if ( bucket < 2 * cSubBuckets )
+	{
+		return bucket;
+	}
+
+	const size_t magnitude = ( bucket - 2 * cSubBuckets ) / cSubBuckets;
+	const uint64_t subBucket = ( bucket - 2 * cSubBuckets ) % cSubBuckets + cSubBuckets;
+	return subBucket << ( magnitude + 1 );
+}
+
+uint64_t ScanRecorder::GetPercentile( const Histogram& histogram, double percentile )
+{
+	uint64_t total = 0;
+	for ( uint64_t count : histogram )
+	{
+		total += count;
+	}
+	if ( total == 0 )
+	{
+		return 0;
+	}
+
+	const uint64_t rank = std::max< uint64_t >( 1, static_cast< uint64_t >( std::ceil( percentile * total ) ) );
+	uint64_t cumulative = 0;
+	for ( size_t i = 0; i < cBucketCount; ++i )
+	{
+		cumulative += histogram[ i ];
+		if ( cumulative >= rank )
+		{
+			return GetBucketLowerBound( i );
+		}
+	}
+	return GetBucketLowerBound( cBucketCount - 1 );
+}
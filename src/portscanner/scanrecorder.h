@@ -0,0 +1,64 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <network/network.h>
+
+//-----------------------------------------------------------------------------
+// ScanRecorder
+// Counts the outcome of every connection attempt a worker makes, and how long
+// each round trip took. Only the owning worker writes to it, so recording
+// never contends; anyone can read it at any time.
+//-----------------------------------------------------------------------------
+class ScanRecorder
+{
+public:
+	static constexpr size_t cResultCount = static_cast< size_t >( Network::Result::Unknown ) + 1;
+
+	// Latencies are in microseconds, in buckets which are exact up to 32 and
+	// then split every power of two into 16, so every bucket is within about 6%
+	// of the values it holds. 27 powers of two take them up to the 32 bit limit.
+	static constexpr size_t cSubBuckets = 16;
+	static constexpr size_t cBucketCount = 2 * cSubBuckets + 27 * cSubBuckets;
+
+	using Counts = std::array< uint64_t, cResultCount >;
+	using Histogram = std::array< uint64_t, cBucketCount >;
+
+	ScanRecorder();
+
+	// Only round trips have their latency recorded, as the time taken by any
+	// other attempt says more about the timeout than the host.
+	void Record( Network::Result result, unsigned int time );
+
+	// Adds this recorder's counts to the given ones.
+	void AddTo( Counts& counts, Histogram& histogram ) const;
+
+	static size_t GetBucket( unsigned int time );
+	static uint64_t GetBucketLowerBound( size_t bucket );
+
+	// The lower bound of the bucket holding the given percentile, from 0 to 1.
+	static uint64_t GetPercentile( const Histogram& histogram, double percentile );
+
+private:
+	static void Increment( std::atomic< uint64_t >& counter );
+
+	alignas( 64 ) std::array< std::atomic< uint64_t >, cResultCount > m_Results;
+	std::array< std::atomic< uint64_t >, cBucketCount > m_Latencies;
+};
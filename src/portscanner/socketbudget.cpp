@@ -0,0 +1,168 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include "socketbudget.h"
+
+SocketBudget::SocketBudget() :
+m_Limit( 1024 ),
+m_MaximumCapacity( 1024 - cReserved ),
+m_Capacity( 1024 - cReserved ),
+m_InUse( 0 ),
+m_ReleasesSinceGrowth( 0 ),
+m_ExhaustedCount( 0 ),
+m_Interrupted( false ),
+m_Waiters( 0 )
+{
+
+}
+
+// Windows has no limit on descriptors as such, so the budget is only there to
+// cap how many sockets are open at once.
+void SocketBudget::Initialise()
+{
+#ifdef _WIN32
+	m_Limit = 16384;
+#else
+	rlimit limit;
+	if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 )
+	{
+		// The hard limit can be RLIM_INFINITY, or more than the kernel allows
+		// (fs.nr_open), in which case asking for all of it fails.
+		const rlim_t cLargest = 1 << 20;
+		const rlim_t wanted = std::min( limit.rlim_max, cLargest );
+		if ( limit.rlim_cur < wanted )
+		{
+			const rlim_t previous = limit.rlim_cur;
+			limit.rlim_cur = wanted;
+			if ( setrlimit( RLIMIT_NOFILE, &limit ) != 0 )
+			{
+				printf( "Failed to raise the limit on open descriptors from %llu.\n", static_cast< unsigned long long >( previous ) );
+				limit.rlim_cur = previous;
+			}
+		}
+
+		m_Limit = static_cast< int >( std::min( limit.rlim_cur, cLargest ) );
+	}
+#endif
+
+	m_MaximumCapacity = std::max( cMinimumCapacity, m_Limit - cReserved );
+	m_Capacity = m_MaximumCapacity;
+}
+
+bool SocketBudget::Acquire( unsigned int count )
+{
+	if ( TryAcquire( count ) )
+	{
+		return true;
+	}
+
+	// Releases only notify if someone is waiting, so don't rely on them alone.
+	std::unique_lock< std::mutex > lock( m_Mutex );
+	m_Waiters++;
+	bool acquired = false;
+	while ( m_Interrupted == false && ( acquired = TryAcquire( count ) ) == false )
+	{
+		m_Condition.wait_for( lock, std::chrono::milliseconds( 10 ) );
+	}
+	m_Waiters--;
+	return acquired;
+}
+
+bool SocketBudget::TryAcquire( unsigned int count )
+{
+	if ( m_Interrupted )
+	{
+		return false;
+	}
+
+	int inUse = m_InUse.load();
+	while ( true )
+	{
+		if ( inUse > 0 && inUse + static_cast< int >( count ) > m_Capacity.load() )
+		{
+			return false;
+		}
+		else if ( m_InUse.compare_exchange_weak( inUse, inUse + static_cast< int >( count ) ) )
+		{
+			return true;
+		}
+	}
+}
+
+void SocketBudget::Release( unsigned int count )
+{
+	m_InUse -= static_cast< int >( count );
+
+	if ( m_Capacity < m_MaximumCapacity && ++m_ReleasesSinceGrowth >= cGrowthInterval )
+	{
+		m_ReleasesSinceGrowth = 0;
+		m_Capacity++;
+	}
+
+	if ( m_Waiters > 0 )
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Condition.notify_all();
+	}
+}
+
+// Called when opening a socket failed for lack of descriptors even though it
+// was within the budget: the rest of the process is using more than was
+// reserved for it.
+void SocketBudget::OnExhausted()
+{
+	m_ExhaustedCount++;
+	m_ReleasesSinceGrowth = 0;
+	m_Capacity = std::max( cMinimumCapacity, m_InUse.load() - 1 );
+}
+
+void SocketBudget::Interrupt()
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_Interrupted = true;
+	m_Condition.notify_all();
+}
+
+void SocketBudget::Resume()
+{
+	m_Interrupted = false;
+}
+
+int SocketBudget::GetLimit() const
+{
+	return m_Limit;
+}
+
+int SocketBudget::GetCapacity() const
+{
+	return m_Capacity;
+}
+
+int SocketBudget::GetInUse() const
+{
+	return m_InUse;
+}
+
+uint64_t SocketBudget::GetExhaustedCount() const
+{
+	return m_ExhaustedCount;
+}
@@ -0,0 +1,77 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+//-----------------------------------------------------------------------------
+// SocketBudget
+// How many sockets the scanner may have open at once, shared by every worker.
+// Sized from the process' limit on open descriptors, which Initialise() first
+// raises as far as it can, minus what is reserved for the rest of the
+// application.
+// Workers acquire a slot for every socket before opening it and release it
+// once it's closed, blocking while the budget is spent. If opening a socket
+// fails for lack of descriptors regardless, the budget shrinks to what is in
+// use and then grows back slowly, so workers wait for room rather than
+// recording the attempt as a timeout.
+//-----------------------------------------------------------------------------
+class SocketBudget
+{
+public:
+	SocketBudget();
+
+	void Initialise();
+
+	// Blocks until there is room for "count" more sockets. A request larger than
+	// the whole budget is admitted once nothing else is in use.
+	// Returns false if interrupted.
+	bool Acquire( unsigned int count );
+	bool TryAcquire( unsigned int count );
+	void Release( unsigned int count );
+
+	void OnExhausted();
+
+	// Makes every pending and future Acquire() fail, until Resume().
+	void Interrupt();
+	void Resume();
+
+	int GetLimit() const;
+	int GetCapacity() const;
+	int GetInUse() const;
+	uint64_t GetExhaustedCount() const;
+
+private:
+	static constexpr int cReserved = 256; // Descriptors left for files, plugins and the like.
+	static constexpr int cMinimumCapacity = 16;
+	static constexpr int cGrowthInterval = 16; // Releases per slot regained after running out.
+
+	int m_Limit;
+	int m_MaximumCapacity;
+	std::atomic_int m_Capacity;
+	std::atomic_int m_InUse;
+	std::atomic_int m_ReleasesSinceGrowth;
+	std::atomic<uint64_t> m_ExhaustedCount;
+	std::atomic_bool m_Interrupted;
+
+	// Only used by workers which have to wait.
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::atomic_int m_Waiters;
+};
@@ -22,6 +22,8 @@ void Configuration::Save()
 	config[ "start_address" ] = m_StartAddress.GetHostAsString();
 	config[ "rate" ] = m_Rate;
 	config[ "ports" ] = m_Ports;
+	config[ "timeout_min" ] = m_MinimumTimeout;
+	config[ "timeout_max" ] = m_MaximumTimeout;
 
 	std::ofstream file( "config.json" );
 	file << config;
@@ -58,6 +60,14 @@ void Configuration::Load()
 					}
 				}
 			}
+			else if ( key == "timeout_min" && it.value().is_number_integer() )
+			{
+				m_MinimumTimeout = it.value();
+			}
+			else if ( key == "timeout_max" && it.value().is_number_integer() )
+			{
+				m_MaximumTimeout = it.value();
+			}
 		}
 	}
 }
@@ -67,6 +77,8 @@ void Configuration::UseDefaults()
 	m_StartAddress = Network::IPAddress( "1.0.0.0" );
 	m_Rate = 100;
 	m_Ports = { 80, 81, 8080 };
+	m_MinimumTimeout = 500;
+	m_MaximumTimeout = 2500;
 }
 
 Network::IPAddress Configuration::GetWebScannerStartAddress() const
@@ -98,3 +110,23 @@ void Configuration::SetWebScannerPorts( const Network::PortVector& ports )
 {
 	m_Ports = ports;
 }
+
+int Configuration::GetWebScannerMinimumTimeout() const
+{
+	return m_MinimumTimeout;
+}
+
+void Configuration::SetWebScannerMinimumTimeout( int value )
+{
+	m_MinimumTimeout = value;
+}
+
+int Configuration::GetWebScannerMaximumTimeout() const
+{
+	return m_MaximumTimeout;
+}
+
+void Configuration::SetWebScannerMaximumTimeout( int value )
+{
+	m_MaximumTimeout = value;
+}
@@ -18,6 +18,12 @@ public:
 	const Network::PortVector& GetWebScannerPorts() const;
 	void SetWebScannerPorts( const Network::PortVector& ports );
 
+	// Bounds for the probe timeouts derived from measured round trip times, in milliseconds.
+	int GetWebScannerMinimumTimeout() const;
+	void SetWebScannerMinimumTimeout( int value );
+	int GetWebScannerMaximumTimeout() const;
+	void SetWebScannerMaximumTimeout( int value );
+
 private:
 	void Save();
 	void Load();
@@ -26,4 +32,6 @@ private:
 	Network::IPAddress m_StartAddress;
 	int m_Rate;
 	Network::PortVector m_Ports;
+	int m_MinimumTimeout;
+	int m_MaximumTimeout;
 };
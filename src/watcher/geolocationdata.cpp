@@ -1,6 +1,7 @@
 #include "database/database.h"
 #include "json.h"
 #include "geolocationdata.h"
+#include "message.h"
 
 GeolocationData::GeolocationData( Network::IPAddress address ) :
 m_Address( address ),
@@ -20,14 +21,14 @@ bool GeolocationData::LoadFromDatabase( const std::string& city, const std::stri
 	return true;
 }
 
-bool GeolocationData::LoadFromJSON( const json& geolocationDataJson )
+bool GeolocationData::LoadFromMessage( const GeolocationResultMessage& message )
 {
-	m_City = geolocationDataJson[ "city" ];
-	m_Region = geolocationDataJson[ "region" ];
-	m_Country = geolocationDataJson[ "country" ];
-	m_Organisation = geolocationDataJson[ "org" ];
+	m_City = message.city;
+	m_Region = message.region;
+	m_Country = message.country;
+	m_Organisation = message.organisation;
 
-	std::string location = geolocationDataJson[ "loc" ];
+	const std::string location( message.location );
 	size_t locationSeparator = location.find_first_of(',');
 	if ( locationSeparator == std::string::npos )
 	{
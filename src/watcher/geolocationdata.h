@@ -10,6 +10,8 @@ namespace Database
 	class Database;
 };
 
+class GeolocationResultMessage;
+
 class GeolocationData;
 using GeolocationDataSharedPtr = std::shared_ptr<GeolocationData>;
 
@@ -18,7 +20,7 @@ class GeolocationData
 public:
 	GeolocationData( Network::IPAddress address );
 	bool LoadFromDatabase( const std::string& city, const std::string& region, const std::string& country, const std::string& organisation, float x, float y );
-	bool LoadFromJSON( const json& message );
+	bool LoadFromMessage( const GeolocationResultMessage& message );
 	void SaveToDatabase( Database::Database* pDatabase );
 
 	const Network::IPAddress& GetIPAddress() const;
@@ -0,0 +1,524 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+using json = nlohmann::json;
+
+//-----------------------------------------------------------------------------
+// MessageType
+// Interned identifier of a message's type: the FNV-1a hash of its name, so it
+// is computed at compile time and every plugin agrees on it without sharing a
+// registry. Messages sent as JSON get the hash of their "type".
+//-----------------------------------------------------------------------------
+using MessageType = uint32_t;
+
+constexpr MessageType GetMessageType( std::string_view name )
+{
+	uint32_t hash = 2166136261u;
+	for ( char c : name )
+	{
+		hash = ( hash ^ static_cast< uint8_t >( c ) ) * 16777619u;
+	}
+	return hash;
+}
+
+
+//-----------------------------------------------------------------------------
+// Hosts
+// Addresses travel as a uint32_t in host order, and as dotted quads in JSON.
+// These don't go through Network::IPAddress, which not every module shares.
+//-----------------------------------------------------------------------------
+
+// Longest dotted quad, "255.255.255.255", and its terminator.
+constexpr size_t cMaxHostStringSize = 16;
+
+// Writes "host" into a buffer of at least cMaxHostStringSize characters,
+// returning the length written.
+inline size_t FormatHost( uint32_t host, char* pBuffer )
+{
+	char* pEnd = pBuffer;
+	for ( int shift = 24; shift >= 0; shift -= 8 )
+	{
+		const uint32_t octet = ( host >> shift ) & 0xFF;
+		if ( octet >= 100 )
+		{
+			*pEnd++ = static_cast< char >( '0' + octet / 100 );
+		}
+		if ( octet >= 10 )
+		{
+			*pEnd++ = static_cast< char >( '0' + ( octet / 10 ) % 10 );
+		}
+		*pEnd++ = static_cast< char >( '0' + octet % 10 );
+		*pEnd++ = ( shift > 0 ) ? '.' : '\0';
+	}
+	return static_cast< size_t >( pEnd - pBuffer - 1 );
+}
+
+inline std::string FormatHost( uint32_t host )
+{
+	char buffer[ cMaxHostStringSize ];
+	return std::string( buffer, FormatHost( host, buffer ) );
+}
+
+// Only accepts exactly four dot separated octets of up to three digits each.
+// Leaves "host" untouched if the text isn't one.
+constexpr bool ParseHost( std::string_view text, uint32_t& host )
+{
+	uint32_t parsed = 0;
+	size_t position = 0;
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( i > 0 )
+		{
+			if ( position >= text.size() || text[ position ] != '.' )
+			{
+				return false;
+			}
+			position++;
+		}
+
+		uint32_t octet = 0;
+		size_t digits = 0;
+		while ( position < text.size() && text[ position ] >= '0' && text[ position ] <= '9' && digits < 3 )
+		{
+			octet = octet * 10 + static_cast< uint32_t >( text[ position++ ] - '0' );
+			digits++;
+		}
+
+		if ( digits == 0 || octet > 255 )
+		{
+			return false;
+		}
+		parsed = ( parsed << 8 ) | octet;
+	}
+
+	if ( position != text.size() )
+	{
+		return false;
+	}
+
+	host = parsed;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Message
+// Everything sent between the plugins and the watcher. The common messages
+// are typed, with a flat payload which only refers to data owned by whoever
+// sends it, so sending one allocates nothing. Any other message is JSON, as
+// are the messages of plugins which predate the typed ones.
+// Both can be viewed as the other: typed messages convert themselves to
+// JSON when a receiver wants it, and JSON messages of a typed message's type
+// are turned into that type before being dispatched (see DispatchJson()).
+// A message, and anything it refers to, only lasts as long as the call which
+// passes it on.
+//-----------------------------------------------------------------------------
+class Message
+{
+public:
+	MessageType GetType() const { return m_Type; }
+
+	// The message as a T, or nullptr if it is of another type.
+	template< typename T >
+	const T* As() const
+	{
+		return ( m_Type == T::cType && m_pJson == nullptr ) ? static_cast< const T* >( this ) : nullptr;
+	}
+
+	// Set for messages which were sent as JSON.
+	const json* GetJson() const { return m_pJson; }
+
+	// Allocates, unless the message was sent as JSON in the first place.
+	json ToJson() const
+	{
+		if ( m_pJson != nullptr )
+		{
+			return *m_pJson;
+		}
+
+		json result;
+		m_pToJson( *this, result );
+		return result;
+	}
+
+protected:
+	using ToJsonFunction = void (*)( const Message& message, json& result );
+
+	Message( MessageType type, ToJsonFunction pToJson, const json* pJson ) :
+		m_Type( type ),
+		m_pToJson( pToJson ),
+		m_pJson( pJson )
+	{
+
+	}
+
+private:
+	MessageType m_Type;
+	ToJsonFunction m_pToJson;
+	const json* m_pJson;
+};
+
+
+//-----------------------------------------------------------------------------
+// JsonMessage
+// Wraps a JSON message, which must have a "type", for as long as it is sent.
+//-----------------------------------------------------------------------------
+class JsonMessage : public Message
+{
+public:
+	explicit JsonMessage( const json& message ) :
+		Message( GetJsonMessageType( message ), nullptr, &message )
+	{
+
+	}
+
+private:
+	static MessageType GetJsonMessageType( const json& message )
+	{
+		json::const_iterator it = message.find( "type" );
+		return ( it != message.end() && it->is_string() ) ? GetMessageType( it->get_ref< const std::string& >() ) : 0;
+	}
+};
+
+
+//-----------------------------------------------------------------------------
+// Typed messages
+// Each one has its name and type, converts itself to JSON and can be built
+// from JSON, for as long as that JSON lasts.
+//-----------------------------------------------------------------------------
+template< typename T >
+class TypedMessage : public Message
+{
+protected:
+	TypedMessage() :
+		Message( T::cType, &T::WriteJson, nullptr )
+	{
+
+	}
+};
+
+// Views a JSON string without copying it, or an empty view if it isn't one.
+inline std::string_view GetJsonString( const json& object, const char* pKey )
+{
+	json::const_iterator it = object.find( pKey );
+	return ( it != object.end() && it->is_string() ) ? std::string_view( it->get_ref< const std::string& >() ) : std::string_view();
+}
+
+// Sent to everyone once per frame, on the main thread.
+class UpdateMessage : public TypedMessage< UpdateMessage >
+{
+public:
+	static constexpr const char* cName = "update";
+	static constexpr MessageType cType = GetMessageType( "update" );
+
+	static void WriteJson( const Message& /* message */, json& result )
+	{
+		result = { { "type", cName } };
+	}
+};
+
+class LogMessage : public TypedMessage< LogMessage >
+{
+public:
+	static constexpr const char* cName = "log";
+	static constexpr MessageType cType = GetMessageType( "log" );
+
+	enum class Level
+	{
+		Info,
+		Warning,
+		Error
+	};
+
+	LogMessage( Level level, std::string_view plugin, std::string_view text ) :
+		level( level ),
+		plugin( plugin ),
+		text( text )
+	{
+
+	}
+
+	Level level;
+	std::string_view plugin;
+	std::string_view text;
+
+	static void WriteJson( const Message& message, json& result )
+	{
+		const LogMessage& log = static_cast< const LogMessage& >( message );
+		result =
+		{
+			{ "type", cName },
+			{ "level", ( log.level == Level::Error ) ? "error" : ( log.level == Level::Warning ) ? "warning" : "info" },
+			{ "plugin", std::string( log.plugin ) },
+			{ "message", std::string( log.text ) }
+		};
+	}
+
+	template< typename F >
+	static void FromJson( const json& message, F dispatch )
+	{
+		const std::string_view level = GetJsonString( message, "level" );
+		dispatch( LogMessage( ( level == "error" ) ? Level::Error : ( level == "warning" ) ? Level::Warning : Level::Info, GetJsonString( message, "plugin" ), GetJsonString( message, "message" ) ) );
+	}
+};
+
+// Web servers found by a scanner, to be checked for cameras.
+class HTTPServersFoundMessage : public TypedMessage< HTTPServersFoundMessage >
+{
+public:
+	static constexpr const char* cName = "http_servers_found";
+	static constexpr MessageType cType = GetMessageType( "http_servers_found" );
+
+	struct Server
+	{
+		std::string_view url;
+		uint32_t host; // In host order.
+		uint16_t port;
+		std::string_view banner; // The start of the response to a request for "/", if it was read.
+	};
+
+	HTTPServersFoundMessage( const Server* pServers, size_t count ) :
+		pServers( pServers ),
+		count( count )
+	{
+
+	}
+
+	const Server* pServers;
+	size_t count;
+
+	static void WriteJson( const Message& message, json& result )
+	{
+		const HTTPServersFoundMessage& found = static_cast< const HTTPServersFoundMessage& >( message );
+		json servers = json::array();
+		for ( size_t i = 0; i < found.count; ++i )
+		{
+			const Server& server = found.pServers[ i ];
+			servers.push_back(
+			{
+				{ "url", std::string( server.url ) },
+				{ "ip_address", FormatHost( server.host ) },
+				{ "port", server.port }
+			} );
+			if ( server.banner.empty() == false )
+			{
+				servers.back()[ "banner" ] = std::string( server.banner );
+			}
+		}
+		result = { { "type", cName }, { "servers", servers } };
+	}
+
+	template< typename F >
+	static void FromJson( const json& message, F dispatch )
+	{
+		std::vector< Server > servers;
+		json::const_iterator it = message.find( "servers" );
+		if ( it != message.end() && it->is_array() )
+		{
+			// Servers without a valid address are dropped, rather than the whole batch.
+			for ( const json& server : *it )
+			{
+				uint32_t host = 0;
+				if ( ParseHost( GetJsonString( server, "ip_address" ), host ) )
+				{
+					json::const_iterator port = server.find( "port" );
+					servers.push_back( { GetJsonString( server, "url" ), host, static_cast< uint16_t >( ( port != server.end() && port->is_number_integer() ) ? port->get< int >() : 0 ), GetJsonString( server, "banner" ) } );
+				}
+			}
+		}
+		dispatch( HTTPServersFoundMessage( servers.data(), servers.size() ) );
+	}
+};
+
+// Whether a web server is a camera, once it has been looked at.
+class HTTPServerScanResultMessage : public TypedMessage< HTTPServerScanResultMessage >
+{
+public:
+	static constexpr const char* cName = "http_server_scan_result";
+	static constexpr MessageType cType = GetMessageType( "http_server_scan_result" );
+
+	HTTPServerScanResultMessage( std::string_view url, uint32_t host, uint16_t port, bool isCamera, std::string_view title ) :
+		url( url ),
+		host( host ),
+		port( port ),
+		isCamera( isCamera ),
+		title( title )
+	{
+
+	}
+
+	std::string_view url;
+	uint32_t host; // In host order.
+	uint16_t port;
+	bool isCamera;
+	std::string_view title;
+
+	static void WriteJson( const Message& message, json& result )
+	{
+		const HTTPServerScanResultMessage& scanResult = static_cast< const HTTPServerScanResultMessage& >( message );
+		result =
+		{
+			{ "type", cName },
+			{ "url", std::string( scanResult.url ) },
+			{ "ip_address", FormatHost( scanResult.host ) },
+			{ "port", scanResult.port },
+			{ "is_camera", scanResult.isCamera },
+			{ "title", std::string( scanResult.title ) }
+		};
+	}
+
+	template< typename F >
+	static void FromJson( const json& message, F dispatch )
+	{
+		uint32_t host = 0;
+		if ( ParseHost( GetJsonString( message, "ip_address" ), host ) == false )
+		{
+			return;
+		}
+
+		json::const_iterator port = message.find( "port" );
+		json::const_iterator isCamera = message.find( "is_camera" );
+		dispatch( HTTPServerScanResultMessage(
+			GetJsonString( message, "url" ),
+			host,
+			static_cast< uint16_t >( ( port != message.end() && port->is_number_integer() ) ? port->get< int >() : 0 ),
+			isCamera != message.end() && isCamera->is_boolean() && isCamera->get< bool >(),
+			GetJsonString( message, "title" ) ) );
+	}
+};
+
+// Asks for the location of an address, which comes back as a GeolocationResultMessage.
+class GeolocationRequestMessage : public TypedMessage< GeolocationRequestMessage >
+{
+public:
+	static constexpr const char* cName = "geolocation_request";
+	static constexpr MessageType cType = GetMessageType( "geolocation_request" );
+
+	explicit GeolocationRequestMessage( uint32_t host ) :
+		host( host )
+	{
+
+	}
+
+	uint32_t host; // In host order.
+
+	static void WriteJson( const Message& message, json& result )
+	{
+		const GeolocationRequestMessage& request = static_cast< const GeolocationRequestMessage& >( message );
+		result =
+		{
+			{ "type", cName },
+			{ "ip_address", FormatHost( request.host ) }
+		};
+	}
+
+	template< typename F >
+	static void FromJson( const json& message, F dispatch )
+	{
+		uint32_t host = 0;
+		if ( ParseHost( GetJsonString( message, "ip_address" ), host ) )
+		{
+			dispatch( GeolocationRequestMessage( host ) );
+		}
+	}
+};
+
+// Where an address is, as ipinfo.io has it. The location is "latitude,longitude".
+class GeolocationResultMessage : public TypedMessage< GeolocationResultMessage >
+{
+public:
+	static constexpr const char* cName = "geolocation_result";
+	static constexpr MessageType cType = GetMessageType( "geolocation_result" );
+
+	GeolocationResultMessage( uint32_t host, std::string_view city, std::string_view region, std::string_view country, std::string_view organisation, std::string_view location ) :
+		host( host ),
+		city( city ),
+		region( region ),
+		country( country ),
+		organisation( organisation ),
+		location( location )
+	{
+
+	}
+
+	uint32_t host; // In host order.
+	std::string_view city;
+	std::string_view region;
+	std::string_view country;
+	std::string_view organisation;
+	std::string_view location;
+
+	static void WriteJson( const Message& message, json& result )
+	{
+		const GeolocationResultMessage& geolocation = static_cast< const GeolocationResultMessage& >( message );
+		result =
+		{
+			{ "type", cName },
+			{ "address", FormatHost( geolocation.host ) },
+			{ "city", std::string( geolocation.city ) },
+			{ "region", std::string( geolocation.region ) },
+			{ "country", std::string( geolocation.country ) },
+			{ "org", std::string( geolocation.organisation ) },
+			{ "loc", std::string( geolocation.location ) }
+		};
+	}
+
+	template< typename F >
+	static void FromJson( const json& message, F dispatch )
+	{
+		uint32_t host = 0;
+		if ( ParseHost( GetJsonString( message, "address" ), host ) == false )
+		{
+			return;
+		}
+
+		dispatch( GeolocationResultMessage(
+			host,
+			GetJsonString( message, "city" ),
+			GetJsonString( message, "region" ),
+			GetJsonString( message, "country" ),
+			GetJsonString( message, "org" ),
+			GetJsonString( message, "loc" ) ) );
+	}
+};
+
+// Passes "message" to "dispatch" as the typed message of the same type, if
+// there is one, or as it is otherwise. Messages which can't be made into their
+// typed message, such as those with a malformed address, are dropped.
+template< typename F >
+void DispatchJson( const json& message, F dispatch )
+{
+	const JsonMessage jsonMessage( message );
+	switch ( jsonMessage.GetType() )
+	{
+	case UpdateMessage::cType: dispatch( UpdateMessage() ); break;
+	case LogMessage::cType: LogMessage::FromJson( message, dispatch ); break;
+	case HTTPServersFoundMessage::cType: HTTPServersFoundMessage::FromJson( message, dispatch ); break;
+	case HTTPServerScanResultMessage::cType: HTTPServerScanResultMessage::FromJson( message, dispatch ); break;
+	case GeolocationRequestMessage::cType: GeolocationRequestMessage::FromJson( message, dispatch ); break;
+	case GeolocationResultMessage::cType: GeolocationResultMessage::FromJson( message, dispatch ); break;
+	default: dispatch( jsonMessage ); break;
+	}
+}
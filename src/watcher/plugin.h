@@ -1,6 +1,8 @@
 #pragma once
 
+#include <vector>
 #include "json.h"
+#include "message.h"
 using json = nlohmann::json;
 
 #ifdef _WIN32
@@ -10,15 +12,37 @@ using json = nlohmann::json;
 #endif //_WIN32
 
 struct ImGuiContext;
-using PluginMessageCallback = void (*)( const json& message );
+using PluginMessageCallback = void (*)( const Message& message );
+
+// The message types a plugin consumes, filled in by its Initialise(). Only
+// these are ever delivered to OnMessage(), so a plugin must list every type
+// it handles, including those it sends to itself.
+class MessageSubscriptions
+{
+public:
+	void Add( MessageType type ) { m_Types.push_back( type ); }
+	template< typename T > void Add() { Add( T::cType ); }
+	const std::vector< MessageType >& GetTypes() const { return m_Types; }
+
+private:
+	std::vector< MessageType > m_Types;
+};
 
 class Plugin
 {
 public:
-	virtual bool Initialise( PluginMessageCallback pMessageCallback ) = 0;
-	virtual void OnMessageReceived( const json& message ) = 0;
+	virtual bool Initialise( PluginMessageCallback pMessageCallback, MessageSubscriptions& subscriptions ) = 0;
 	virtual void DrawUI( ImGuiContext* pContext ) = 0;
 
+	// Every message is passed on to OnMessageReceived() as JSON unless this is
+	// overridden, which makes typed messages allocate.
+	virtual void OnMessage( const Message& message )
+	{
+		const json* pJson = message.GetJson();
+		OnMessageReceived( ( pJson != nullptr ) ? *pJson : message.ToJson() );
+	}
+	virtual void OnMessageReceived( const json& /* message */ ) {}
+
 	virtual std::string GetName() const = 0;
 	virtual void GetVersion( int& majorVersion, int& minorVersion, int& patchVersion ) const = 0;
 };
@@ -5,13 +5,14 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #endif
+#include <algorithm>
 #include "log.h"
 #include "plugin.h"
 #include "plugin_manager.h"
 #include "watcher.h"
 
 extern Watcher* g_pWatcher;
-void WatcherMessageCallback( const json& message )
+void WatcherMessageCallback( const Message& message )
 {
 	g_pWatcher->OnMessageReceived( message );
 }
@@ -141,14 +142,39 @@ void PluginManager::InitialisePlugins()
 {
 	for ( Plugin* pPlugin : m_Plugins )
 	{
-		pPlugin->Initialise( &WatcherMessageCallback );
+		MessageSubscriptions subscriptions;
+		if ( pPlugin->Initialise( &WatcherMessageCallback, subscriptions ) == false )
+		{
+			Log::Warning( "Plugin %s failed to initialise.", pPlugin->GetName().c_str() );
+			continue;
+		}
+
+		for ( MessageType type : subscriptions.GetTypes() )
+		{
+			PluginVector& subscribers = m_Subscribers[ type ];
+			if ( std::find( subscribers.begin(), subscribers.end(), pPlugin ) == subscribers.end() )
+			{
+				subscribers.push_back( pPlugin );
+			}
+		}
 	}
 }
 
-void PluginManager::BroadcastMessage( const nlohmann::json& message )
+void PluginManager::BroadcastMessage( const Message& message )
 {
-	for ( Plugin* pPlugin : m_Plugins )
+	std::unordered_map< MessageType, PluginVector >::const_iterator it = m_Subscribers.find( message.GetType() );
+	if ( it == m_Subscribers.end() )
+	{
+		return;
+	}
+
+	for ( Plugin* pPlugin : it->second )
 	{
-		pPlugin->OnMessageReceived( message );
+		pPlugin->OnMessage( message );
 	}
+}
+
+void PluginManager::BroadcastMessage( const nlohmann::json& message )
+{
+	DispatchJson( message, [ this ]( const Message& typedMessage ) { BroadcastMessage( typedMessage ); } );
 }
\ No newline at end of file
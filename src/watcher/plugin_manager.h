@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "json.h"
+#include "message.h"
 
 class Plugin;
 using PluginVector = std::vector< Plugin* >;
@@ -11,6 +13,11 @@ class PluginManager
 {
 public:
 	PluginManager();
+
+	// Only reaches the plugins which subscribed to the message's type.
+	void BroadcastMessage( const Message& message );
+
+	// Goes out as a typed message if there is one of the same type.
 	void BroadcastMessage( const nlohmann::json& message );
 	const PluginVector& GetPlugins() const { return m_Plugins; }
 
@@ -22,4 +29,5 @@ private:
 	void InitialisePlugins();
 
 	PluginVector m_Plugins;
+	std::unordered_map< MessageType, PluginVector > m_Subscribers;
 };
\ No newline at end of file
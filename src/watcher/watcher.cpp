@@ -49,6 +49,7 @@ Watcher::Watcher(SDL_Window* pWindow, unsigned int scannerCount) :
 	m_pRep = std::make_unique< WatcherRep >(pWindow);
 
 	m_pPluginManager = std::make_unique<PluginManager>();
+	BroadcastConfiguration();
 	InitialiseDatabase();
 
 	// All the geolocation data needs to be loaded before the cameras are, as every 
@@ -87,6 +88,43 @@ void Watcher::InitialiseDatabase()
 	m_pDatabase = std::make_unique< Database::Database >(databaseFilename);
 }
 
+// Lets the plugins know about the settings which concern them.
+void Watcher::BroadcastConfiguration()
+{
+	json message =
+	{
+		{ "type", "configuration" },
+		{ "web_scanner_rate", m_pConfiguration->GetWebScannerRate() },
+		{ "web_scanner_ports", m_pConfiguration->GetWebScannerPorts() },
+		{ "web_scanner_timeout_min", m_pConfiguration->GetWebScannerMinimumTimeout() },
+		{ "web_scanner_timeout_max", m_pConfiguration->GetWebScannerMaximumTimeout() }
+	};
+	m_pPluginManager->BroadcastMessage(message);
+}
+
+// Plugins send "set_configuration" messages when the user changes a setting in their UI.
+// The configuration is saved when the application exits.
+void Watcher::ApplyConfiguration(const json& message)
+{
+	json::const_iterator it = message.find("web_scanner_rate");
+	if (it != message.end() && it->is_number_integer())
+	{
+		m_pConfiguration->SetWebScannerRate(it->get<int>());
+	}
+
+	it = message.find("web_scanner_timeout_min");
+	if (it != message.end() && it->is_number_integer())
+	{
+		m_pConfiguration->SetWebScannerMinimumTimeout(it->get<int>());
+	}
+
+	it = message.find("web_scanner_timeout_max");
+	if (it != message.end() && it->is_number_integer())
+	{
+		m_pConfiguration->SetWebScannerMaximumTimeout(it->get<int>());
+	}
+}
+
 void Watcher::GeolocationRequestCallback(const Database::QueryResult& result, void* pData)
 {
 	PluginManager* pPluginManager = reinterpret_cast<PluginManager*>(pData);
@@ -94,12 +132,11 @@ void Watcher::GeolocationRequestCallback(const Database::QueryResult& result, vo
 	{
 		for (auto& cell : row)
 		{
-			json message =
+			uint32_t host = 0;
+			if (ParseHost(cell->GetString(), host))
 			{
-				{ "type", "geolocation_request" },
-				{ "ip_address", cell->GetString() },
-			};
-			pPluginManager->BroadcastMessage(message);
+				pPluginManager->BroadcastMessage(GeolocationRequestMessage(host));
+			}
 		}
 	}
 }
@@ -128,11 +165,7 @@ void Watcher::Update()
 {
 	TextureLoader::Update();
 
-	json updateMessage =
-	{
-		{ "type", "update" }
-	};
-	m_pPluginManager->BroadcastMessage(updateMessage);
+	m_pPluginManager->BroadcastMessage(UpdateMessage());
 
 	m_pRep->Update();
 	m_pRep->Render();
@@ -174,35 +207,61 @@ void Watcher::Update()
 	ImGui::End();
 }
 
+static constexpr MessageType cSetConfigurationMessage = GetMessageType("set_configuration");
+static constexpr MessageType cStreamStartedMessage = GetMessageType("stream_started");
+
+// Messages sent as JSON are turned into typed ones where possible, so that
+// everything after this only ever has to handle the typed version.
+void Watcher::OnMessageReceived(const Message& message)
+{
+	const json* pJson = message.GetJson();
+	if (pJson != nullptr)
+	{
+		DispatchJson(*pJson, [this](const Message& typedMessage) { ProcessMessage(typedMessage); });
+	}
+	else
+	{
+		ProcessMessage(message);
+	}
+}
+
 void Watcher::OnMessageReceived(const json& message)
 {
-	const std::string& messageType = message["type"];
-	if (messageType == "log")
+	OnMessageReceived(JsonMessage(message));
+}
+
+void Watcher::ProcessMessage(const Message& message)
+{
+	if (const LogMessage* pLog = message.As<LogMessage>())
+	{
+		const int pluginLength = static_cast<int>(pLog->plugin.size());
+		const int textLength = static_cast<int>(pLog->text.size());
+		if (pLog->level == LogMessage::Level::Warning) Log::Warning("%.*s %.*s", pluginLength, pLog->plugin.data(), textLength, pLog->text.data());
+		else if (pLog->level == LogMessage::Level::Error) Log::Error("%.*s %.*s", pluginLength, pLog->plugin.data(), textLength, pLog->text.data());
+		else Log::Info("%.*s %.*s", pluginLength, pLog->plugin.data(), textLength, pLog->text.data());
+	}
+	else if (const HTTPServerScanResultMessage* pResult = message.As<HTTPServerScanResultMessage>())
 	{
-		const std::string& messageLevel = message["level"];
-		const std::string& messagePlugin = message["plugin"];
-		const std::string& messageText = message["message"];
-		if (messageLevel == "warning") Log::Warning("%s %s", messagePlugin.c_str(), messageText.c_str());
-		else if (messageLevel == "error") Log::Error("%s %s", messagePlugin.c_str(), messageText.c_str());
-		else Log::Info("%s %s", messagePlugin.c_str(), messageText.c_str());
+		AddCamera(*pResult);
 	}
-	else if (messageType == "geolocation_result")
+	else if (const GeolocationResultMessage* pGeolocation = message.As<GeolocationResultMessage>())
 	{
-		AddGeolocationData(message);
+		AddGeolocationData(*pGeolocation);
 	}
-	else if (messageType == "http_server_scan_result")
+	else if (message.GetType() == cSetConfigurationMessage)
 	{
-		AddCamera(message);
+		ApplyConfiguration(*message.GetJson());
 	}
-	else if (messageType == "stream_started")
+	else if (message.GetType() == cStreamStartedMessage)
 	{
-		CameraSharedPtr pCamera = FindCamera(message["url"]);
+		CameraSharedPtr pCamera = FindCamera((*message.GetJson())["url"]);
 		if (pCamera != nullptr)
 		{
 			ChangeCameraState(pCamera, Camera::State::StreamAvailable);
 		}
 	}
 
+	// Everything is passed on, but only reaches the plugins subscribed to it.
 	m_pPluginManager->BroadcastMessage(message);
 }
 
@@ -283,12 +342,12 @@ void Watcher::LoadCamerasCallback(const Database::QueryResult& result, void* pDa
 	}
 }
 
-void Watcher::AddGeolocationData(const json& message)
+void Watcher::AddGeolocationData(const GeolocationResultMessage& message)
 {
-	std::string addressStr = message["address"];
-	const Network::IPAddress address(addressStr);
+	const std::string addressStr = FormatHost(message.host);
+	const Network::IPAddress address(message.host, 0);
 	GeolocationDataSharedPtr pGeolocationData = std::make_shared<GeolocationData>(address);
-	pGeolocationData->LoadFromJSON(message);
+	pGeolocationData->LoadFromMessage(message);
 	Log::Info("Added geolocation data for %s: %s, %s", addressStr.c_str(), pGeolocationData->GetCity().c_str(), pGeolocationData->GetCountry().c_str());
 
 	{
@@ -327,20 +386,14 @@ std::string Watcher::GetDate() const
 	}
 }
 
-void Watcher::AddCamera(const json& message)
+void Watcher::AddCamera(const HTTPServerScanResultMessage& result)
 {
-	if (message["type"] != "http_server_scan_result")
+	if (result.isCamera)
 	{
-		Log::Warning("Called AddCamera() with a message type of '%s', rather than the expected 'http_server_scan_result'", message["type"]);
-		return;
-	}
-
-	if (message["is_camera"])
-	{
-		const std::string url = message["url"];
-		const std::string ipAddress = message["ip_address"];
-		int port = message["port"];
-		const std::string title = message["title"];
+		const std::string url(result.url);
+		const std::string ipAddress = FormatHost(result.host);
+		int port = result.port;
+		const std::string title(result.title);
 		const std::string username;
 		const std::string password;
 
@@ -355,17 +408,11 @@ void Watcher::AddCamera(const json& message)
 
 		m_pDatabase->Execute(addCameraStatement);
 
-		json message =
-		{
-			{ "type", "geolocation_request" },
-			{ "ip_address", ipAddress },
-		};
-		m_pPluginManager->BroadcastMessage(message);
+		m_pPluginManager->BroadcastMessage(GeolocationRequestMessage(result.host));
 
 		{
 			std::scoped_lock lock(m_CamerasMutex);
-			Network::IPAddress fullAddress(ipAddress);
-			fullAddress.SetPort(port);
+			Network::IPAddress fullAddress(result.host, result.port);
 
 			CameraSharedPtr camera = std::make_shared<Camera>(title, url, fullAddress);
 			m_Cameras.push_back(camera);
@@ -26,6 +26,7 @@
 #include "network/network.h"
 #include "camera.h"
 #include "geolocationdata.h"
+#include "message.h"
 
 #include "json.h"
 using json = nlohmann::json;
@@ -51,6 +52,7 @@ public:
 	bool IsActive() const;
 	Configuration* GetConfiguration() const;
 
+	void OnMessageReceived(const Message& message);
 	void OnMessageReceived(const json& message);
 
 	CameraVector GetCameras() const;
@@ -60,11 +62,14 @@ private:
 	static void LoadGeolocationDataCallback(const Database::QueryResult& result, void* pData);
 	static void LoadCamerasCallback(const Database::QueryResult& result, void* pData);
 
+	void BroadcastConfiguration();
+	void ApplyConfiguration(const json& message);
 	void InitialiseDatabase();
 	void InitialiseGeolocation();
 	void InitialiseCameras();
-	void AddGeolocationData(const json& message);
-	void AddCamera(const json& message);
+	void AddGeolocationData(const GeolocationResultMessage& message);
+	void ProcessMessage(const Message& message);
+	void AddCamera(const HTTPServerScanResultMessage& result);
 	std::string GetDate() const;
 	CameraSharedPtr FindCamera(const std::string& url);
 	void ChangeCameraState(CameraSharedPtr pCamera, Camera::State state);
@@ -0,0 +1,240 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <vector>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_uring_linux.h"
+
+namespace Network
+{
+
+static int IOUringSetup( unsigned int entries, io_uring_params* pParams )
+{
+	return static_cast< int >( syscall( __NR_io_uring_setup, entries, pParams ) );
+}
+
+static int IOUringEnter( int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags )
+{
+	return static_cast< int >( syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0 ) );
+}
+
+static int IOUringRegister( int fd, unsigned int opcode, void* pArg, unsigned int numArgs )
+{
+	return static_cast< int >( syscall( __NR_io_uring_register, fd, opcode, pArg, numArgs ) );
+}
+
+IOUring::IOUring( unsigned int entries ) :
+m_Fd( -1 ),
+m_pSqRing( MAP_FAILED ),
+m_pCqRing( MAP_FAILED ),
+m_pSqes( reinterpret_cast< io_uring_sqe* >( MAP_FAILED ) ),
+m_SqRingSize( 0 ),
+m_CqRingSize( 0 ),
+m_SqesSize( 0 ),
+m_SqLocalTail( 0 ),
+m_SqSubmittedTail( 0 )
+{
+	io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+	m_Fd = IOUringSetup( entries, &params );
+	if ( m_Fd < 0 )
+	{
+		m_Fd = -1;
+		return;
+	}
+
+	m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int );
+	m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+	const bool singleMap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+	if ( singleMap )
+	{
+		m_SqRingSize = m_CqRingSize = std::max( m_SqRingSize, m_CqRingSize );
+	}
+
+	m_pSqRing = mmap( nullptr, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQ_RING );
+	if ( m_pSqRing == MAP_FAILED )
+	{
+		Release();
+		return;
+	}
+
+	if ( singleMap )
+	{
+		m_pCqRing = m_pSqRing;
+	}
+	else
+	{
+		m_pCqRing = mmap( nullptr, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_CQ_RING );
+		if ( m_pCqRing == MAP_FAILED )
+		{
+			Release();
+			return;
+		}
+	}
+
+	m_SqesSize = params.sq_entries * sizeof( io_uring_sqe );
+	m_pSqes = reinterpret_cast< io_uring_sqe* >( mmap( nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQES ) );
+	if ( m_pSqes == MAP_FAILED )
+	{
+		Release();
+		return;
+	}
+
+	unsigned char* pSq = reinterpret_cast< unsigned char* >( m_pSqRing );
+	m_pSqHead = reinterpret_cast< unsigned int* >( pSq + params.sq_off.head );
+	m_pSqTail = reinterpret_cast< unsigned int* >( pSq + params.sq_off.tail );
+	m_pSqArray = reinterpret_cast< unsigned int* >( pSq + params.sq_off.array );
+	m_SqMask = *reinterpret_cast< unsigned int* >( pSq + params.sq_off.ring_mask );
+	m_SqEntries = *reinterpret_cast< unsigned int* >( pSq + params.sq_off.ring_entries );
+	m_SqLocalTail = m_SqSubmittedTail = *m_pSqTail;
+
+	unsigned char* pCq = reinterpret_cast< unsigned char* >( m_pCqRing );
+	m_pCqHead = reinterpret_cast< unsigned int* >( pCq + params.cq_off.head );
+	m_pCqTail = reinterpret_cast< unsigned int* >( pCq + params.cq_off.tail );
+	m_pCqes = reinterpret_cast< io_uring_cqe* >( pCq + params.cq_off.cqes );
+	m_CqMask = *reinterpret_cast< unsigned int* >( pCq + params.cq_off.ring_mask );
+}
+
+IOUring::~IOUring()
+{
+	Release();
+}
+
+void IOUring::Release()
+{
+	if ( m_pSqes != MAP_FAILED )
+	{
+		munmap( m_pSqes, m_SqesSize );
+		m_pSqes = reinterpret_cast< io_uring_sqe* >( MAP_FAILED );
+	}
+
+	if ( m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing )
+	{
+		munmap( m_pCqRing, m_CqRingSize );
+	}
+	m_pCqRing = MAP_FAILED;
+
+	if ( m_pSqRing != MAP_FAILED )
+	{
+		munmap( m_pSqRing, m_SqRingSize );
+		m_pSqRing = MAP_FAILED;
+	}
+
+	if ( m_Fd != -1 )
+	{
+		close( m_Fd );
+		m_Fd = -1;
+	}
+}
+
+bool IOUring::IsValid() const
+{
+	return m_Fd != -1;
+}
+
+bool IOUring::IsSupported()
+{
+	IOUring ring( 2 );
+	if ( ring.IsValid() == false )
+	{
+		return false;
+	}
+
+	// IORING_REGISTER_PROBE itself only exists from 5.6 onwards, which is also when
+	// IORING_OP_CONNECT was introduced, so older kernels will fail here.
+	const size_t numOps = 256;
+	std::vector< unsigned char > buffer( sizeof( io_uring_probe ) + numOps * sizeof( io_uring_probe_op ), 0 );
+	io_uring_probe* pProbe = reinterpret_cast< io_uring_probe* >( buffer.data() );
+	if ( IOUringRegister( ring.m_Fd, IORING_REGISTER_PROBE, pProbe, numOps ) < 0 )
+	{
+		return false;
+	}
+
+	auto isOpSupported = [ pProbe ]( unsigned int op ) -> bool
+	{
+		return op <= pProbe->last_op && ( pProbe->ops[ op ].flags & IO_URING_OP_SUPPORTED ) != 0;
+	};
+
+	return isOpSupported( IORING_OP_CONNECT ) && isOpSupported( IORING_OP_LINK_TIMEOUT ) && isOpSupported( IORING_OP_CLOSE );
+}
+
+io_uring_sqe* IOUring::GetSubmissionEntry()
+{
+	const unsigned int head = __atomic_load_n( m_pSqHead, __ATOMIC_ACQUIRE );
+	if ( m_SqLocalTail - head >= m_SqEntries )
+	{
+		return nullptr;
+	}
+
+	const unsigned int index = m_SqLocalTail & m_SqMask;
+	io_uring_sqe* pSqe = &m_pSqes[ index ];
+	memset( pSqe, 0, sizeof( io_uring_sqe ) );
+	m_pSqArray[ index ] = index;
+	m_SqLocalTail++;
+	return pSqe;
+}
+
+unsigned int IOUring::GetPendingSubmissions() const
+{
+	return m_SqLocalTail - m_SqSubmittedTail;
+}
+
+int IOUring::Submit( unsigned int waitFor )
+{
+	const unsigned int toSubmit = GetPendingSubmissions();
+	__atomic_store_n( m_pSqTail, m_SqLocalTail, __ATOMIC_RELEASE );
+
+	int result;
+	do
+	{
+		result = IOUringEnter( m_Fd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0 );
+	}
+	while ( result < 0 && errno == EINTR );
+
+	if ( result < 0 )
+	{
+		return -errno;
+	}
+
+	m_SqSubmittedTail += static_cast< unsigned int >( result );
+	return result;
+}
+
+bool IOUring::GetCompletion( io_uring_cqe& cqe )
+{
+	const unsigned int head = *m_pCqHead;
+	const unsigned int tail = __atomic_load_n( m_pCqTail, __ATOMIC_ACQUIRE );
+	if ( head == tail )
+	{
+		return false;
+	}
+
+	cqe = m_pCqes[ head & m_CqMask ];
+	__atomic_store_n( m_pCqHead, head + 1, __ATOMIC_RELEASE );
+	return true;
+}
+
+}
+
+#endif
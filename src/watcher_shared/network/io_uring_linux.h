@@ -0,0 +1,81 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+
+namespace Network
+{
+
+//-----------------------------------------------------------------------------
+// IOUring
+// Minimal wrapper around an io_uring instance, talking to the kernel through
+// the raw system calls so we don't depend on liburing.
+// Only used internally by the Linux network backend. Not thread safe.
+//-----------------------------------------------------------------------------
+class IOUring
+{
+public:
+	IOUring( unsigned int entries );
+	~IOUring();
+
+	bool IsValid() const;
+
+	// Returns whether the running kernel supports every operation the network
+	// backend needs (connect, linked timeouts and close).
+	static bool IsSupported();
+
+	// Returns a zeroed submission queue entry, or nullptr if the queue is full.
+	io_uring_sqe* GetSubmissionEntry();
+	unsigned int GetPendingSubmissions() const;
+
+	// Submits every pending entry and waits until at least "waitFor" completions
+	// are available. Returns the number of entries submitted or -errno.
+	int Submit( unsigned int waitFor );
+
+	// Copies the oldest completion into "cqe". Returns false if there are none.
+	bool GetCompletion( io_uring_cqe& cqe );
+
+private:
+	void Release();
+
+	int m_Fd;
+	void* m_pSqRing;
+	void* m_pCqRing;
+	io_uring_sqe* m_pSqes;
+	size_t m_SqRingSize;
+	size_t m_CqRingSize;
+	size_t m_SqesSize;
+
+	unsigned int* m_pSqHead;
+	unsigned int* m_pSqTail;
+	unsigned int* m_pSqArray;
+	unsigned int m_SqMask;
+	unsigned int m_SqEntries;
+	unsigned int m_SqLocalTail;
+	unsigned int m_SqSubmittedTail;
+
+	unsigned int* m_pCqHead;
+	unsigned int* m_pCqTail;
+	io_uring_cqe* m_pCqes;
+	unsigned int m_CqMask;
+};
+
+}
+
+#endif
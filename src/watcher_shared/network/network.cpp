@@ -14,7 +14,6 @@
 // along with watcher. If not, see <https://www.gnu.org/licenses/>.
 
 #include <cassert>
-#include <sstream>
 #include "network.h"
 
 namespace Network
@@ -24,161 +23,69 @@ namespace Network
 	// IPAddress
 	//-----------------------------------------------------------------------------
 
-	IPAddress::IPAddress() :
-		m_Host(0),
-		m_Port(0),
-		m_Block(0)
+	void IPAddress::SetPort(uint16_t port)
 	{
-
+		m_Port = port;
 	}
 
-	IPAddress::IPAddress(const std::vector< int >& host, uint16_t port)
+	void IPAddress::SetBlock(uint8_t block)
 	{
-		SetHost(host);
-		SetPort(port);
-		SetBlock(0);
+		assert(block == 0u || m_Port == 0u);
+		m_Block = block;
 	}
 
-	IPAddress::IPAddress(unsigned int host, uint16_t port)
+	std::string IPAddress::ToString() const
 	{
-		m_Host = host;
-		SetPort(port);
-		SetBlock(0);
+		char buffer[cMaxStringSize];
+		return std::string(buffer, ToChars(buffer));
 	}
 
-	IPAddress::IPAddress(const std::string& address)
+	std::string IPAddress::GetHostAsString() const
 	{
-#ifdef _WIN32
-#define sscanf sscanf_s
-#endif
-
-		assert(IPAddress::IsValid(address));
-
-		std::vector< int > v = { 0, 0, 0, 0 };
-		int port = 0;
-		int block = 0;
-		if (sscanf(address.c_str(), "%d.%d.%d.%d:%d", &v[0], &v[1], &v[2], &v[3], &port) == 5)
-		{
-			SetHost(v);
-			SetPort(port);
-			SetBlock(0);
-		}
-		else if (sscanf(address.c_str(), "%d.%d.%d.%d/%d", &v[0], &v[1], &v[2], &v[3], &block) == 5)
-		{
-			SetHost(v);
-			SetPort(0);
-			SetBlock(block);
-		}
-		else if (sscanf(address.c_str(), "%d.%d.%d.%d", &v[0], &v[1], &v[2], &v[3]) == 4)
-		{
-			SetHost(v);
-			SetPort(0);
-			SetBlock(0);
-		}
-		else
-		{
-			// Invalid format
-			assert(false);
-		}
-#ifdef _WIN32
-#undef sscanf
-#endif
+		char buffer[cMaxStringSize];
+		return std::string(buffer, HostToChars(buffer));
 	}
 
-	bool IPAddress::IsValid(const std::string& address)
+	// Writes "value" in decimal, returning one past the last character written.
+	static char* WriteDecimal(char* pBuffer, unsigned int value)
 	{
-#ifdef _WIN32
-#define sscanf sscanf_s
-#endif
-		std::vector< int > v = { 0, 0, 0, 0 };
-		int port = 0;
-		int block = 0;
-		if (sscanf(address.c_str(), "%d.%d.%d.%d:%d", &v[0], &v[1], &v[2], &v[3], &port) == 5 ||
-			sscanf(address.c_str(), "%d.%d.%d.%d/%d", &v[0], &v[1], &v[2], &v[3], &block) == 5 ||
-			sscanf(address.c_str(), "%d.%d.%d.%d", &v[0], &v[1], &v[2], &v[3]) == 4)
+		char digits[5];
+		int count = 0;
+		do
 		{
-			for (int i = 0; i < 4; ++i)
-			{
-				if (v[i] < 0 || v[i] > 255)
-				{
-					return false;
-				}
-			}
-
-			if (port < 0 || port > 65535)
-			{
-				return false;
-			}
-			else if ((block > 0 && block < 8) || block > 24)
-			{
-				return false;
-			}
+			digits[count++] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
 
-			return true;
+		while (count > 0)
+		{
+			*pBuffer++ = digits[--count];
 		}
-
-		return false;
-
-#ifdef _WIN32
-#undef sscanf
-#endif
-	}
-
-	void IPAddress::SetHost(const std::vector< int >& host)
-	{
-		// Convert the vector into a single unsigned integer in host order.
-		assert(host.size() == 4);
-		m_Host = (host[0] << 24) | (host[1] << 16) | (host[2] << 8) | (host[3]);
+		return pBuffer;
 	}
 
-	uint32_t IPAddress::GetHost() const
+	size_t IPAddress::ToChars(char* pBuffer) const
 	{
-		return m_Host;
-	}
-
-	void IPAddress::SetPort(uint16_t port)
-	{
-		m_Port = port;
-	}
-
-	uint16_t IPAddress::GetPort() const
-	{
-		return m_Port;
-	}
-
-	void IPAddress::SetBlock(uint8_t block)
-	{
-		assert(block == 0u || m_Port == 0u);
-		m_Block = block;
-	}
-
-	uint8_t IPAddress::GetBlock() const
-	{
-		return m_Block;
-	}
-
-	std::string IPAddress::ToString() const
-	{
-		std::stringstream ss;
-		ss << GetHostAsString();
-
+		char* pEnd = pBuffer + HostToChars(pBuffer);
 		if (m_Port != 0u)
 		{
-			ss << ":" << m_Port;
+			*pEnd++ = ':';
+			pEnd = WriteDecimal(pEnd, m_Port);
+			*pEnd = '\0';
 		}
-
-		return ss.str();
+		return static_cast<size_t>(pEnd - pBuffer);
 	}
 
-	std::string IPAddress::GetHostAsString() const
+	size_t IPAddress::HostToChars(char* pBuffer) const
 	{
-		std::stringstream ss;
-		ss <<
-			(m_Host >> 24) << "." <<
-			((m_Host >> 16) & 0xFF) << "." <<
-			((m_Host >> 8) & 0xFF) << "." <<
-			(m_Host & 0xFF);
-		return ss.str();
+		char* pEnd = pBuffer;
+		for (int shift = 24; shift >= 0; shift -= 8)
+		{
+			pEnd = WriteDecimal(pEnd, (m_Host >> shift) & 0xFF);
+			*pEnd++ = '.';
+		}
+		*--pEnd = '\0';
+		return static_cast<size_t>(pEnd - pBuffer);
 	}
 
 }
\ No newline at end of file
@@ -15,7 +15,11 @@
 
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // windows.h redefines SetPort as either SetPortA or SetPortW, which will cause
@@ -32,26 +36,133 @@ using PortVector = std::vector< unsigned short >;
 //-----------------------------------------------------------------------------
 // IPAddress
 // All return values are in host order, not network order.
+// Parsing and formatting never allocate, and an address can be built from a
+// literal at compile time.
 //-----------------------------------------------------------------------------
 class IPAddress
 {
 public:
-	IPAddress();
-	IPAddress( const std::vector< int >& host, uint16_t port );
-	IPAddress( uint32_t host, uint16_t port );
-	IPAddress( const std::string& address );
-	void SetHost( const std::vector< int >& host );
-	uint32_t GetHost() const;
+	constexpr IPAddress() :
+		m_Host( 0 ),
+		m_Port( 0 ),
+		m_Block( 0 )
+	{
+
+	}
+
+	constexpr IPAddress( uint32_t host, uint16_t port ) :
+		m_Host( host ),
+		m_Port( port ),
+		m_Block( 0 )
+	{
+
+	}
+
+	// Accepts "a.b.c.d", "a.b.c.d:port" or "a.b.c.d/block".
+	constexpr IPAddress( std::string_view address ) :
+		m_Host( 0 ),
+		m_Port( 0 ),
+		m_Block( 0 )
+	{
+		if ( Parse( address, *this ) == false )
+		{
+			assert( false );
+		}
+	}
+
+	constexpr void SetHost( uint32_t host ) { m_Host = host; }
+	constexpr void SetHost( uint8_t a, uint8_t b, uint8_t c, uint8_t d ) { m_Host = ( uint32_t( a ) << 24 ) | ( uint32_t( b ) << 16 ) | ( uint32_t( c ) << 8 ) | d; }
+	constexpr uint32_t GetHost() const { return m_Host; }
 	void SetPort( uint16_t port );
-	uint16_t GetPort() const;
+	constexpr uint16_t GetPort() const { return m_Port; }
 	void SetBlock( uint8_t block );
-	uint8_t GetBlock() const;
+	constexpr uint8_t GetBlock() const { return m_Block; }
 	std::string ToString() const;
 	std::string GetHostAsString() const;
 
-	static bool IsValid( const std::string& address );
+	// Longest string ToChars() writes, "255.255.255.255:65535", and its terminator.
+	static constexpr size_t cMaxStringSize = 22;
+
+	// Write the same as ToString() and GetHostAsString() into a buffer of at
+	// least cMaxStringSize characters, returning the length written.
+	size_t ToChars( char* pBuffer ) const;
+	size_t HostToChars( char* pBuffer ) const;
+
+	static constexpr bool IsValid( std::string_view address )
+	{
+		IPAddress parsed;
+		return Parse( address, parsed );
+	}
+
+	// Leaves "address" untouched unless the whole text is a valid address.
+	static constexpr bool Parse( std::string_view text, IPAddress& address )
+	{
+		size_t position = 0;
+		uint32_t host = 0;
+		for ( int i = 0; i < 4; ++i )
+		{
+			uint32_t octet = 0;
+			if ( ( i > 0 && ParseSeparator( text, position, '.' ) == false ) || ParseNumber( text, position, 3, octet ) == false || octet > 255 )
+			{
+				return false;
+			}
+			host = ( host << 8 ) | octet;
+		}
+
+		uint32_t port = 0;
+		uint32_t block = 0;
+		if ( ParseSeparator( text, position, ':' ) )
+		{
+			if ( ParseNumber( text, position, 5, port ) == false || port > 65535 )
+			{
+				return false;
+			}
+		}
+		else if ( ParseSeparator( text, position, '/' ) )
+		{
+			if ( ParseNumber( text, position, 2, block ) == false || ( block > 0 && block < 8 ) || block > 24 )
+			{
+				return false;
+			}
+		}
+
+		if ( position != text.size() )
+		{
+			return false;
+		}
+
+		address.m_Host = host;
+		address.m_Port = static_cast< uint16_t >( port );
+		address.m_Block = static_cast< uint8_t >( block );
+		return true;
+	}
 
 private:
+	static constexpr bool ParseSeparator( std::string_view text, size_t& position, char separator )
+	{
+		if ( position < text.size() && text[ position ] == separator )
+		{
+			position++;
+			return true;
+		}
+		return false;
+	}
+
+	static constexpr bool ParseNumber( std::string_view text, size_t& position, size_t maximumDigits, uint32_t& value )
+	{
+		const size_t first = position;
+		value = 0;
+		while ( position < text.size() && position - first < maximumDigits && text[ position ] >= '0' && text[ position ] <= '9' )
+		{
+			value = value * 10 + static_cast< uint32_t >( text[ position ] - '0' );
+			position++;
+		}
+
+		// Anything beyond the longest number allowed is an error rather than what follows it.
+		const bool tooLong = position < text.size() && text[ position ] >= '0' && text[ position ] <= '9';
+		return position != first && tooLong == false;
+	}
+
 	uint32_t m_Host;
 	uint16_t m_Port;
 	uint8_t m_Block;
@@ -90,14 +201,88 @@ enum class Result
 };
 
 
+//-----------------------------------------------------------------------------
+// Backend
+// Mechanism used to perform ConnectTCP() and Close(). Platforms which don't
+// support a given backend, or kernels which lack the necessary features, 
+// fall back to Backend::Sockets.
+// Backend::IOUring batches connections and their timeouts into a single 
+// submission, and defers closing sockets so they can be submitted alongside
+// the next batch.
+//-----------------------------------------------------------------------------
+enum class Backend
+{
+	Sockets,
+	IOUring
+};
+
+
+//-----------------------------------------------------------------------------
+// ConnectRequest
+// A single connection attempt in a batch passed to ConnectTCP().
+//-----------------------------------------------------------------------------
+struct ConnectRequest
+{
+	IPAddress address;
+	TCPSocket socket;
+	Result result;
+	unsigned int time; // How long the attempt took, in microseconds.
+};
+
+using ConnectRequests = std::vector< ConnectRequest >;
+
+
 //-----------------------------------------------------------------------------
 // Network API
 //-----------------------------------------------------------------------------
 
 Result Initialise();
 Result Shutdown();
+
+// Timeouts are in milliseconds.
 Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket );
 Result Close( TCPSocket socket );
+
+// Closes can be deferred by the backend, and until they have happened the
+// descriptors are still in use. These only concern the calling thread's closes.
+unsigned int GetDeferredCloseCount();
+void FlushCloses();
+
+// Selects the backend, returning the one actually in use.
+// Initialise() picks the most efficient backend supported.
+Backend SetBackend( Backend backend );
+Backend GetBackend();
+
+// Attempts every connection in "requests" at once where the backend allows it,
+// filling in the socket and result of each request.
+void ConnectTCP( ConnectRequests& requests, unsigned int timeout );
+
+// Starts a non-blocking connection attempt and returns immediately.
+// Returns Result::InProgress if the attempt is underway, in which case the socket 
+// becomes writable once it completes and GetConnectResult() provides the outcome.
+// Any other result means the attempt is already over (and the socket closed, 
+// unless the result is Result::Success).
+Result ConnectTCPNonBlocking( IPAddress address, TCPSocket& tcpSocket );
+Result GetConnectResult( TCPSocket tcpSocket );
+
+// Sends all of "size" bytes on a connected socket, waiting at most "timeout"
+// milliseconds for there to be room. Returns Result::Timeout if it runs out of time.
+Result Send( TCPSocket tcpSocket, const void* pData, size_t size, unsigned int timeout );
+
+// Receives up to "size" bytes, waiting at most "timeout" milliseconds for anything
+// to arrive. Returns Result::Timeout if nothing did, otherwise "received" is 0 
+// once the peer has closed the connection.
+// With a timeout of 0, neither ever blocks.
+Result Receive( TCPSocket tcpSocket, void* pBuffer, size_t size, unsigned int timeout, size_t& received );
+
+// Listens for connections on the given port, on every interface or only on the
+// loopback one.
+Result ListenTCP( uint16_t port, bool loopbackOnly, TCPSocket& listenSocket );
+
+// Waits at most "timeout" milliseconds for a connection to come in on a listening
+// socket. Returns Result::Timeout if none did.
+Result AcceptTCP( TCPSocket listenSocket, unsigned int timeout, TCPSocket& tcpSocket, IPAddress& address );
+
 Result Resolve( const std::string& host, IPAddress& address );
 
 std::string ToString( Result result );
@@ -1,14 +1,21 @@
 #ifdef __linux__
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <memory>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "io_uring_linux.h"
 #include "network.h"
 
 namespace Network
@@ -16,8 +23,223 @@ namespace Network
 
 Result ToResult( int result );
 
+static std::atomic< Backend > sBackend( Backend::Sockets );
+
+//-----------------------------------------------------------------------------
+// io_uring backend
+// Rings aren't thread safe, so every thread which connects through io_uring
+// gets its own. Closes on that thread are queued on the ring rather than 
+// performed immediately, and get submitted alongside the next batch of 
+// connections (or once enough of them have accumulated).
+//-----------------------------------------------------------------------------
+static constexpr unsigned int cRingEntries = 256;
+static constexpr unsigned int cMaxPendingCloses = 32;
+static constexpr uint64_t cCloseTag = 1ull << 63;
+static constexpr uint64_t cTimeoutTag = 1ull << 62;
+
+class ThreadRing
+{
+public:
+	ThreadRing();
+	~ThreadRing();
+
+	IOUring& GetRing() { return m_Ring; }
+	bool QueueClose( TCPSocket socket );
+	void FlushCloses();
+	unsigned int GetOutstandingCloses() const { return m_OutstandingCloses; }
+	void ProcessCompletion( const io_uring_cqe& cqe, ConnectRequest* pRequests );
+
+private:
+	IOUring m_Ring;
+	unsigned int m_OutstandingCloses;
+};
+
+static thread_local std::unique_ptr< ThreadRing > tpThreadRing;
+
+ThreadRing::ThreadRing() :
+m_Ring( cRingEntries ),
+m_OutstandingCloses( 0 )
+{
+
+}
+
+ThreadRing::~ThreadRing()
+{
+	FlushCloses();
+}
+
+// Make sure every close this thread queued has actually happened.
+void ThreadRing::FlushCloses()
+{
+	while ( m_OutstandingCloses > 0 && m_Ring.Submit( m_OutstandingCloses ) >= 0 )
+	{
+		io_uring_cqe cqe;
+		while ( m_Ring.GetCompletion( cqe ) )
+		{
+			ProcessCompletion( cqe, nullptr );
+		}
+	}
+}
+
+bool ThreadRing::QueueClose( TCPSocket socket )
+{
+	if ( m_Ring.IsValid() == false )
+	{
+		return false;
+	}
+
+	io_uring_sqe* pSqe = m_Ring.GetSubmissionEntry();
+	if ( pSqe == nullptr )
+	{
+		return false;
+	}
+
+	pSqe->opcode = IORING_OP_CLOSE;
+	pSqe->fd = socket;
+	pSqe->user_data = cCloseTag;
+	m_OutstandingCloses++;
+
+	if ( m_Ring.GetPendingSubmissions() >= cMaxPendingCloses )
+	{
+		m_Ring.Submit( 0 );
+	}
+	return true;
+}
+
+void ThreadRing::ProcessCompletion( const io_uring_cqe& cqe, ConnectRequest* pRequests )
+{
+	if ( cqe.user_data & cCloseTag )
+	{
+		m_OutstandingCloses--;
+		if ( cqe.res < 0 )
+		{
+			printf( "close error (%d): %s\n", -cqe.res, strerror( -cqe.res ) );
+		}
+	}
+	else if ( ( cqe.user_data & cTimeoutTag ) == 0 && pRequests != nullptr )
+	{
+		// The connection's linked timeout cancels it if it expires first.
+		ConnectRequest& request = pRequests[ cqe.user_data ];
+		request.result = ( cqe.res == -ECANCELED ) ? Result::Timeout : ToResult( -cqe.res );
+	}
+}
+
+static unsigned int GetElapsedMicroseconds( std::chrono::steady_clock::time_point start )
+{
+	return static_cast< unsigned int >( std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now() - start ).count() );
+}
+
+static ThreadRing* GetThreadRing()
+{
+	if ( tpThreadRing == nullptr )
+	{
+		tpThreadRing = std::make_unique< ThreadRing >();
+	}
+	return tpThreadRing->GetRing().IsValid() ? tpThreadRing.get() : nullptr;
+}
+
+// Every connection is submitted as a connect linked to a timeout, so a batch only 
+// costs one socket() per connection plus a single io_uring_enter().
+static void ConnectTCPIOUring( ThreadRing* pThreadRing, ConnectRequest* pRequests, size_t count, unsigned int timeout )
+{
+	IOUring& ring = pThreadRing->GetRing();
+	const size_t cMaxBatchSize = ( cRingEntries - cMaxPendingCloses ) / 2;
+
+	__kernel_timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = ( timeout % 1000 ) * 1000000ll;
+
+	std::vector< sockaddr_in > addresses( std::min( count, cMaxBatchSize ) );
+	for ( size_t batchStart = 0; batchStart < count; batchStart += cMaxBatchSize )
+	{
+		const size_t batchEnd = std::min( count, batchStart + cMaxBatchSize );
+		unsigned int expectedCompletions = 0;
+		for ( size_t i = batchStart; i < batchEnd; ++i )
+		{
+			ConnectRequest& request = pRequests[ i ];
+			request.socket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+			if ( request.socket == -1 )
+			{
+				request.result = ToResult( errno );
+				request.time = 0;
+				continue;
+			}
+
+			sockaddr_in& addr = addresses[ i - batchStart ];
+			memset( &addr, 0, sizeof( addr ) );
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons( request.address.GetPort() );
+			addr.sin_addr.s_addr = htonl( request.address.GetHost() );
+
+			// The ring has room for a full batch plus the pending closes, so this can't fail.
+			io_uring_sqe* pConnectSqe = ring.GetSubmissionEntry();
+			io_uring_sqe* pTimeoutSqe = ring.GetSubmissionEntry();
+			assert( pConnectSqe != nullptr && pTimeoutSqe != nullptr );
+
+			pConnectSqe->opcode = IORING_OP_CONNECT;
+			pConnectSqe->fd = request.socket;
+			pConnectSqe->addr = reinterpret_cast< uint64_t >( &addr );
+			pConnectSqe->off = sizeof( addr );
+			pConnectSqe->flags = IOSQE_IO_LINK;
+			pConnectSqe->user_data = i;
+
+			pTimeoutSqe->opcode = IORING_OP_LINK_TIMEOUT;
+			pTimeoutSqe->fd = -1;
+			pTimeoutSqe->addr = reinterpret_cast< uint64_t >( &ts );
+			pTimeoutSqe->len = 1;
+			pTimeoutSqe->user_data = cTimeoutTag | i;
+
+			request.result = Result::InProgress;
+			expectedCompletions += 2;
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while ( expectedCompletions > 0 )
+		{
+			const int submitResult = ring.Submit( expectedCompletions );
+			if ( submitResult < 0 )
+			{
+				// Shouldn't happen, but don't leave requests hanging if it does.
+				for ( size_t i = batchStart; i < batchEnd; ++i )
+				{
+					if ( pRequests[ i ].result == Result::InProgress )
+					{
+						pRequests[ i ].result = ToResult( -submitResult );
+						pRequests[ i ].time = GetElapsedMicroseconds( start );
+					}
+				}
+				break;
+			}
+
+			io_uring_cqe cqe;
+			while ( ring.GetCompletion( cqe ) )
+			{
+				if ( ( cqe.user_data & cCloseTag ) == 0 && expectedCompletions > 0 )
+				{
+					expectedCompletions--;
+				}
+				if ( ( cqe.user_data & ( cCloseTag | cTimeoutTag ) ) == 0 )
+				{
+					pRequests[ cqe.user_data ].time = GetElapsedMicroseconds( start );
+				}
+				pThreadRing->ProcessCompletion( cqe, pRequests );
+			}
+		}
+
+		for ( size_t i = batchStart; i < batchEnd; ++i )
+		{
+			ConnectRequest& request = pRequests[ i ];
+			if ( request.result != Result::Success && request.socket != -1 )
+			{
+				Close( request.socket );
+			}
+		}
+	}
+}
+
 Result Initialise()
 {
+	SetBackend( Backend::IOUring );
 	return Result::Success;
 }
 
@@ -26,8 +248,56 @@ Result Shutdown()
 	return Result::Success;
 }
 
+Backend SetBackend( Backend backend )
+{
+	if ( backend == Backend::IOUring && IOUring::IsSupported() == false )
+	{
+		backend = Backend::Sockets;
+	}
+	sBackend = backend;
+	return backend;
+}
+
+Backend GetBackend()
+{
+	return sBackend;
+}
+
+void ConnectTCP( ConnectRequests& requests, unsigned int timeout )
+{
+	if ( timeout > 0u && sBackend == Backend::IOUring )
+	{
+		ThreadRing* pThreadRing = GetThreadRing();
+		if ( pThreadRing != nullptr )
+		{
+			ConnectTCPIOUring( pThreadRing, requests.data(), requests.size(), timeout );
+			return;
+		}
+	}
+
+	for ( ConnectRequest& request : requests )
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		request.result = ConnectTCP( request.address, timeout, request.socket );
+		request.time = GetElapsedMicroseconds( start );
+	}
+}
+
 Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket )
 {
+	if ( timeout > 0u && sBackend == Backend::IOUring )
+	{
+		ThreadRing* pThreadRing = GetThreadRing();
+		if ( pThreadRing != nullptr )
+		{
+			ConnectRequest request;
+			request.address = address;
+			ConnectTCPIOUring( pThreadRing, &request, 1, timeout );
+			tcpSocket = request.socket;
+			return request.result;
+		}
+	}
+
 	tcpSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 	if ( tcpSocket == -1 )
 	{
@@ -46,21 +316,26 @@ Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket
 
 		connect( tcpSocket, (sockaddr*)&addr, sizeof( addr ) );
 
-		fd_set fdset;
-		FD_ZERO( &fdset );
-		FD_SET( tcpSocket, &fdset );
-
-		struct timeval tv;
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
+		// Not select(), as the scanner raises the limit on descriptors well beyond FD_SETSIZE.
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+		pollfd pfd;
+		pfd.fd = tcpSocket;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		int pollResult;
+		do
+		{
+			const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count();
+			pollResult = poll( &pfd, 1, static_cast< int >( std::max( remaining, static_cast< decltype( remaining ) >( 0 ) ) ) );
+		}
+		while ( pollResult < 0 && errno == EINTR );
 
-		int selectResult = select( tcpSocket + 1, nullptr, &fdset, nullptr, &tv );
-		if ( selectResult == 0 )
+		if ( pollResult == 0 )
 		{
 			Close( tcpSocket );
 			return Result::Timeout;
 		}
-		else if ( selectResult == 1 )
+		else if ( pollResult == 1 )
 		{
 			int soError;
         	socklen_t len = sizeof( soError );
@@ -83,9 +358,9 @@ Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket
 		}
 		else
 		{
-			int selectError = errno;
+			int pollError = errno;
 			Close( tcpSocket );
-			return ToResult( selectError );
+			return ToResult( pollError );
 		}
 	}
 	else
@@ -102,9 +377,190 @@ Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket
 	}
 }
 
+Result ConnectTCPNonBlocking( IPAddress address, TCPSocket& tcpSocket )
+{
+	tcpSocket = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP );
+	if ( tcpSocket == -1 )
+	{
+		return ToResult( errno );
+	}
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( address.GetPort() );
+	addr.sin_addr.s_addr = htonl( address.GetHost() );
+
+	if ( connect( tcpSocket, (sockaddr*)&addr, sizeof( addr ) ) == 0 )
+	{
+		return Result::Success;
+	}
+	else if ( errno == EINPROGRESS )
+	{
+		return Result::InProgress;
+	}
+	else
+	{
+		int connectError = errno;
+		Close( tcpSocket );
+		return ToResult( connectError );
+	}
+}
+
+Result GetConnectResult( TCPSocket tcpSocket )
+{
+	int soError;
+	socklen_t len = sizeof( soError );
+	if ( getsockopt( tcpSocket, SOL_SOCKET, SO_ERROR, &soError, &len ) == -1 )
+	{
+		return ToResult( errno );
+	}
+	return ToResult( soError );
+}
+
+// Waits for the socket to become ready for "events", until the deadline.
+static Result Wait( TCPSocket tcpSocket, short events, std::chrono::steady_clock::time_point deadline )
+{
+	const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count();
+	if ( remaining <= 0 )
+	{
+		return Result::Timeout;
+	}
+
+	pollfd pfd;
+	pfd.fd = tcpSocket;
+	pfd.events = events;
+	pfd.revents = 0;
+	const int pollResult = poll( &pfd, 1, static_cast< int >( remaining ) );
+	if ( pollResult == 0 )
+	{
+		return Result::Timeout;
+	}
+	else if ( pollResult < 0 && errno != EINTR )
+	{
+		return ToResult( errno );
+	}
+	return Result::Success;
+}
+
+Result Send( TCPSocket tcpSocket, const void* pData, size_t size, unsigned int timeout )
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	const char* pBytes = static_cast< const char* >( pData );
+	while ( size > 0 )
+	{
+		const ssize_t sent = send( tcpSocket, pBytes, size, MSG_DONTWAIT | MSG_NOSIGNAL );
+		if ( sent >= 0 )
+		{
+			pBytes += sent;
+			size -= static_cast< size_t >( sent );
+		}
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+		{
+			const Result waitResult = Wait( tcpSocket, POLLOUT, deadline );
+			if ( waitResult != Result::Success )
+			{
+				return waitResult;
+			}
+		}
+		else if ( errno != EINTR )
+		{
+			return ToResult( errno );
+		}
+	}
+	return Result::Success;
+}
+
+Result Receive( TCPSocket tcpSocket, void* pBuffer, size_t size, unsigned int timeout, size_t& received )
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	received = 0;
+	while ( true )
+	{
+		const ssize_t result = recv( tcpSocket, pBuffer, size, MSG_DONTWAIT );
+		if ( result >= 0 )
+		{
+			received = static_cast< size_t >( result );
+			return Result::Success;
+		}
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+		{
+			const Result waitResult = Wait( tcpSocket, POLLIN, deadline );
+			if ( waitResult != Result::Success )
+			{
+				return waitResult;
+			}
+		}
+		else if ( errno != EINTR )
+		{
+			return ToResult( errno );
+		}
+	}
+}
+
+Result ListenTCP( uint16_t port, bool loopbackOnly, TCPSocket& listenSocket )
+{
+	listenSocket = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP );
+	if ( listenSocket == -1 )
+	{
+		return ToResult( errno );
+	}
+
+	// Allows a restarted server to listen again straight away.
+	const int reuse = 1;
+	setsockopt( listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( port );
+	addr.sin_addr.s_addr = htonl( loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY );
+
+	if ( bind( listenSocket, (sockaddr*)&addr, sizeof( addr ) ) == -1 || listen( listenSocket, SOMAXCONN ) == -1 )
+	{
+		const int listenError = errno;
+		Close( listenSocket );
+		return ToResult( listenError );
+	}
+	return Result::Success;
+}
+
+Result AcceptTCP( TCPSocket listenSocket, unsigned int timeout, TCPSocket& tcpSocket, IPAddress& address )
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	while ( true )
+	{
+		sockaddr_in addr;
+		socklen_t len = sizeof( addr );
+		tcpSocket = accept( listenSocket, (sockaddr*)&addr, &len );
+		if ( tcpSocket != -1 )
+		{
+			address = IPAddress( ntohl( addr.sin_addr.s_addr ), ntohs( addr.sin_port ) );
+			return Result::Success;
+		}
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+		{
+			const Result waitResult = Wait( listenSocket, POLLIN, deadline );
+			if ( waitResult != Result::Success )
+			{
+				return waitResult;
+			}
+		}
+		else if ( errno != EINTR && errno != ECONNABORTED )
+		{
+			return ToResult( errno );
+		}
+	}
+}
+
 Result Close( TCPSocket socket )
 {
-	if ( close( socket ) == 0 )
+	// Only threads which already own a ring defer their closes.
+	if ( sBackend == Backend::IOUring && tpThreadRing != nullptr && tpThreadRing->QueueClose( socket ) )
+	{
+		return Result::Success;
+	}
+	else if ( close( socket ) == 0 )
 	{
 		return Result::Success;
 	}
@@ -115,12 +571,55 @@ Result Close( TCPSocket socket )
 	}
 }
 
+unsigned int GetDeferredCloseCount()
+{
+	return ( tpThreadRing != nullptr ) ? tpThreadRing->GetOutstandingCloses() : 0u;
+}
+
+void FlushCloses()
+{
+	if ( tpThreadRing != nullptr )
+	{
+		tpThreadRing->FlushCloses();
+	}
+}
+
+Result Resolve( const std::string& host, IPAddress& address )
+{
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	struct addrinfo* pResult = nullptr;
+	if ( getaddrinfo( host.c_str(), nullptr, &hints, &pResult ) != 0 )
+	{
+		return Result::Unknown;
+	}
+
+	Result result = Result::Unknown;
+	for ( struct addrinfo* pData = pResult; pData != nullptr; pData = pData->ai_next )
+	{
+		if ( pData->ai_family == AF_INET )
+		{
+			const struct sockaddr_in* pSockAddr = reinterpret_cast< const struct sockaddr_in* >( pData->ai_addr );
+			address = IPAddress( ntohl( pSockAddr->sin_addr.s_addr ), 0 );
+			result = Result::Success;
+			break;
+		}
+	}
+	freeaddrinfo( pResult );
+	return result;
+}
+
 Result ToResult( int result )
 {
 	if ( result == 0 ) return Result::Success;
 	else if ( result == EBADF ) return Result::InvalidFileDescriptor;
 	else if ( result == ENOTSOCK ) return Result::NotSocket;
 	else if ( result == ENOTCONN ) return Result::NotConnected;  
+	else if ( result == ECONNRESET || result == ECONNABORTED || result == EPIPE ) return Result::NotConnected;
 	else if ( result == EACCES ) return Result::PermissionDenied;
 	else if ( result == EAFNOSUPPORT ) return Result::AddressFamilyNotSupported;
 	else if ( result == EINVAL ) return Result::Invalid;
@@ -153,6 +652,7 @@ std::string ToString( Result result )
 	else if ( result == Result::ConnectionRefused ) return "Connection refused";
 	else if ( result == Result::HostUnreachable ) return "Host unreachable";
 	else if ( result == Result::Timeout ) return "Timeout";
+	else if ( result == Result::InProgress ) return "In progress";
 	else return "Unknown";	
 }
 
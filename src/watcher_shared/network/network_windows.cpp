@@ -6,6 +6,7 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <cassert>
+#include <chrono>
 
 #include "network.h"
 
@@ -25,6 +26,27 @@ Result Shutdown()
 	return ToResult( WSACleanup() );
 }
 
+// Only Backend::Sockets is supported on Windows.
+Backend SetBackend( Backend backend )
+{
+	return Backend::Sockets;
+}
+
+Backend GetBackend()
+{
+	return Backend::Sockets;
+}
+
+void ConnectTCP( ConnectRequests& requests, unsigned int timeout )
+{
+	for ( ConnectRequest& request : requests )
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		request.result = ConnectTCP( request.address, timeout, request.socket );
+		request.time = static_cast< unsigned int >( std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now() - start ).count() );
+	}
+}
+
 Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket )
 {
 	tcpSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
@@ -52,8 +74,8 @@ Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket
 		FD_SET( tcpSocket, &fdset );
 
 		struct timeval tv;
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = ( timeout % 1000 ) * 1000;
 
 		int selectResult = select( tcpSocket + 1, nullptr, &fdset, nullptr, &tv );
 		if ( selectResult == 0 )
@@ -103,6 +125,198 @@ Result ConnectTCP( IPAddress address, unsigned int timeout, TCPSocket& tcpSocket
 	}
 }
 
+Result ConnectTCPNonBlocking( IPAddress address, TCPSocket& tcpSocket )
+{
+	tcpSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( tcpSocket == INVALID_SOCKET )
+	{
+		return ToResult( WSAGetLastError() );
+	}
+
+	// Set the socket to non-blocking.
+	unsigned long mode = 1u;
+	ioctlsocket( tcpSocket, FIONBIO, &mode );
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( address.GetPort() );
+	addr.sin_addr.s_addr = htonl( address.GetHost() );
+
+	if ( connect( tcpSocket, (sockaddr*)&addr, sizeof( addr ) ) == 0 )
+	{
+		return Result::Success;
+	}
+
+	int connectError = WSAGetLastError();
+	if ( connectError == WSAEWOULDBLOCK )
+	{
+		return Result::InProgress;
+	}
+	else
+	{
+		Close( tcpSocket );
+		return ToResult( connectError );
+	}
+}
+
+Result GetConnectResult( TCPSocket tcpSocket )
+{
+	int soError = 0;
+	int len = static_cast< int >( sizeof( soError ) );
+	if ( getsockopt( tcpSocket, SOL_SOCKET, SO_ERROR, reinterpret_cast< char* >( &soError ), &len ) == SOCKET_ERROR )
+	{
+		return ToResult( WSAGetLastError() );
+	}
+	return ToResult( soError );
+}
+
+// Waits for the socket to become readable or writable, until the deadline.
+static Result Wait( TCPSocket tcpSocket, bool write, std::chrono::steady_clock::time_point deadline )
+{
+	const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count();
+	if ( remaining <= 0 )
+	{
+		return Result::Timeout;
+	}
+
+	fd_set fdset;
+	FD_ZERO( &fdset );
+	FD_SET( tcpSocket, &fdset );
+
+	struct timeval tv;
+	tv.tv_sec = static_cast< long >( remaining / 1000 );
+	tv.tv_usec = static_cast< long >( ( remaining % 1000 ) * 1000 );
+
+	const int selectResult = select( tcpSocket + 1, write ? nullptr : &fdset, write ? &fdset : nullptr, nullptr, &tv );
+	if ( selectResult == 0 )
+	{
+		return Result::Timeout;
+	}
+	else if ( selectResult == SOCKET_ERROR )
+	{
+		return ToResult( WSAGetLastError() );
+	}
+	return Result::Success;
+}
+
+Result Send( TCPSocket tcpSocket, const void* pData, size_t size, unsigned int timeout )
+{
+	// Sockets connected with a timeout are already non-blocking, but not the others.
+	unsigned long mode = 1u;
+	ioctlsocket( tcpSocket, FIONBIO, &mode );
+
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	const char* pBytes = static_cast< const char* >( pData );
+	while ( size > 0 )
+	{
+		const int sent = send( tcpSocket, pBytes, static_cast< int >( size ), 0 );
+		if ( sent != SOCKET_ERROR )
+		{
+			pBytes += sent;
+			size -= static_cast< size_t >( sent );
+			continue;
+		}
+
+		const int sendError = WSAGetLastError();
+		if ( sendError != WSAEWOULDBLOCK )
+		{
+			return ToResult( sendError );
+		}
+
+		const Result waitResult = Wait( tcpSocket, true, deadline );
+		if ( waitResult != Result::Success )
+		{
+			return waitResult;
+		}
+	}
+	return Result::Success;
+}
+
+Result Receive( TCPSocket tcpSocket, void* pBuffer, size_t size, unsigned int timeout, size_t& received )
+{
+	unsigned long mode = 1u;
+	ioctlsocket( tcpSocket, FIONBIO, &mode );
+
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	received = 0;
+	while ( true )
+	{
+		const int result = recv( tcpSocket, static_cast< char* >( pBuffer ), static_cast< int >( size ), 0 );
+		if ( result != SOCKET_ERROR )
+		{
+			received = static_cast< size_t >( result );
+			return Result::Success;
+		}
+
+		const int recvError = WSAGetLastError();
+		if ( recvError != WSAEWOULDBLOCK )
+		{
+			return ToResult( recvError );
+		}
+
+		const Result waitResult = Wait( tcpSocket, false, deadline );
+		if ( waitResult != Result::Success )
+		{
+			return waitResult;
+		}
+	}
+}
+
+Result ListenTCP( uint16_t port, bool loopbackOnly, TCPSocket& listenSocket )
+{
+	listenSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( listenSocket == INVALID_SOCKET )
+	{
+		return ToResult( WSAGetLastError() );
+	}
+
+	unsigned long mode = 1u;
+	ioctlsocket( listenSocket, FIONBIO, &mode );
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( port );
+	addr.sin_addr.s_addr = htonl( loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY );
+
+	if ( bind( listenSocket, (sockaddr*)&addr, sizeof( addr ) ) == SOCKET_ERROR || listen( listenSocket, SOMAXCONN ) == SOCKET_ERROR )
+	{
+		const int listenError = WSAGetLastError();
+		Close( listenSocket );
+		return ToResult( listenError );
+	}
+	return Result::Success;
+}
+
+Result AcceptTCP( TCPSocket listenSocket, unsigned int timeout, TCPSocket& tcpSocket, IPAddress& address )
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+	while ( true )
+	{
+		sockaddr_in addr;
+		int len = static_cast< int >( sizeof( addr ) );
+		tcpSocket = accept( listenSocket, (sockaddr*)&addr, &len );
+		if ( tcpSocket != INVALID_SOCKET )
+		{
+			address = IPAddress( ntohl( addr.sin_addr.s_addr ), ntohs( addr.sin_port ) );
+			return Result::Success;
+		}
+
+		const int acceptError = WSAGetLastError();
+		if ( acceptError != WSAEWOULDBLOCK && acceptError != WSAECONNRESET )
+		{
+			return ToResult( acceptError );
+		}
+
+		const Result waitResult = Wait( listenSocket, false, deadline );
+		if ( waitResult != Result::Success )
+		{
+			return waitResult;
+		}
+	}
+}
+
 Result Close( TCPSocket socket )
 {
 	if ( closesocket( socket ) == 0 )
@@ -115,6 +329,17 @@ Result Close( TCPSocket socket )
 	}
 }
 
+// Sockets are always closed straight away.
+unsigned int GetDeferredCloseCount()
+{
+	return 0;
+}
+
+void FlushCloses()
+{
+
+}
+
 Result Resolve( const std::string& host, IPAddress& address )
 {
 	struct addrinfo hints;
@@ -124,27 +349,26 @@ Result Resolve( const std::string& host, IPAddress& address )
 	hints.ai_protocol = IPPROTO_TCP;
 
 	struct addrinfo* pResult = nullptr;
-	struct addrinfo* pPtr = nullptr;
 
 	DWORD retVal = getaddrinfo(host.c_str(), nullptr, &hints, &pResult);
-	if (retVal == 0)
+	if (retVal != 0)
 	{
-		for (struct addrinfo* pData = pResult; pData != nullptr; pData = pData->ai_next)
+		return Result::Unknown;
+	}
+
+	Result result = Result::Unknown;
+	for (struct addrinfo* pData = pResult; pData != nullptr; pData = pData->ai_next)
+	{
+		if (pData->ai_family == AF_INET)
 		{
-			if (pData->ai_family == AF_INET)
-			{
-				struct sockaddr_in* pSockAddr = reinterpret_cast<struct sockaddr_in*>(pData->ai_addr);
-				char buffer[INET_ADDRSTRLEN];
-				if (inet_ntop(AF_INET, &pSockAddr->sin_addr, buffer, INET_ADDRSTRLEN) != nullptr)
-				{
-					address = IPAddress(buffer);
-				}
-				return Result::Success;
-			}
+			struct sockaddr_in* pSockAddr = reinterpret_cast<struct sockaddr_in*>(pData->ai_addr);
+			address = IPAddress(ntohl(pSockAddr->sin_addr.s_addr), 0);
+			result = Result::Success;
+			break;
 		}
 	}
-
-	return Result::Unknown;
+	freeaddrinfo(pResult);
+	return result;
 }
 
 Result ToResult( int result )
@@ -157,6 +381,7 @@ Result ToResult( int result )
 	else if ( result == WSAEINPROGRESS ) return Result::InProgress;
 	else if ( result == WSAENOTSOCK ) return Result::NotSocket;
 	else if ( result == WSAECONNREFUSED ) return Result::ConnectionRefused;
+	else if ( result == WSAENOTCONN || result == WSAECONNRESET || result == WSAECONNABORTED ) return Result::NotConnected;
 	else if ( result == WSAEHOSTUNREACH ) return Result::HostUnreachable;
 	else if ( result == WSAETIMEDOUT ) return Result::Timeout;
 	else
@@ -186,6 +411,7 @@ std::string ToString( Result result )
 	else if ( result == Result::ConnectionRefused ) return "Connection refused";
 	else if ( result == Result::HostUnreachable ) return "Host unreachable";
 	else if ( result == Result::Timeout ) return "Timeout";
+	else if ( result == Result::InProgress ) return "In progress";
 	else return "Unknown";	
 }
 
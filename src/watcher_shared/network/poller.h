@@ -0,0 +1,81 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "network.h"
+
+namespace Network
+{
+
+//-----------------------------------------------------------------------------
+// Poller
+// Waits on any number of non-blocking sockets at once, through epoll on Linux
+// and WSAPoll on Windows. Each socket is registered with the events it is
+// interested in and an arbitrary value which is handed back when they occur.
+// Closing a socket removes it, so Remove() is only needed to stop waiting on
+// a socket which stays open.
+// Not thread safe: each poller is meant to be owned by a single thread.
+//-----------------------------------------------------------------------------
+class Poller
+{
+public:
+	static constexpr uint32_t cReadable = 1 << 0;
+	static constexpr uint32_t cWritable = 1 << 1;
+	static constexpr uint32_t cError = 1 << 2; // Always reported, whether asked for or not.
+
+	struct Event
+	{
+		uint64_t data;
+		uint32_t events;
+	};
+
+	Poller();
+	~Poller();
+
+	Poller( const Poller& ) = delete;
+	Poller& operator=( const Poller& ) = delete;
+
+	bool IsValid() const;
+
+	bool Add( TCPSocket socket, uint32_t events, uint64_t data );
+	bool Modify( TCPSocket socket, uint32_t events, uint64_t data );
+	bool Remove( TCPSocket socket );
+
+	// Waits at most "timeout" milliseconds for any registered socket to be ready,
+	// filling in at most "maxEvents" events. Returns how many were.
+	int Wait( Event* pEvents, int maxEvents, unsigned int timeout );
+
+private:
+#ifdef _WIN32
+	struct Registration
+	{
+		TCPSocket socket;
+		uint32_t events;
+		uint64_t data;
+	};
+	std::vector< Registration > m_Registrations;
+	std::unordered_map< TCPSocket, size_t > m_Indices; // Into m_Registrations.
+#else
+	int m_Epoll;
+#endif
+};
+
+}
@@ -0,0 +1,100 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "poller.h"
+
+namespace Network
+{
+
+static uint32_t ToEpollEvents( uint32_t events )
+{
+	uint32_t result = 0;
+	if ( events & Poller::cReadable )
+	{
+		result |= EPOLLIN;
+	}
+	if ( events & Poller::cWritable )
+	{
+		result |= EPOLLOUT;
+	}
+	return result;
+}
+
+Poller::Poller()
+{
+	m_Epoll = epoll_create1( EPOLL_CLOEXEC );
+}
+
+Poller::~Poller()
+{
+	if ( m_Epoll != -1 )
+	{
+		close( m_Epoll );
+	}
+}
+
+bool Poller::IsValid() const
+{
+	return m_Epoll != -1;
+}
+
+bool Poller::Add( TCPSocket socket, uint32_t events, uint64_t data )
+{
+	epoll_event event;
+	event.events = ToEpollEvents( events );
+	event.data.u64 = data;
+	return epoll_ctl( m_Epoll, EPOLL_CTL_ADD, socket, &event ) == 0;
+}
+
+bool Poller::Modify( TCPSocket socket, uint32_t events, uint64_t data )
+{
+	epoll_event event;
+	event.events = ToEpollEvents( events );
+	event.data.u64 = data;
+	return epoll_ctl( m_Epoll, EPOLL_CTL_MOD, socket, &event ) == 0;
+}
+
+bool Poller::Remove( TCPSocket socket )
+{
+	return epoll_ctl( m_Epoll, EPOLL_CTL_DEL, socket, nullptr ) == 0;
+}
+
+int Poller::Wait( Event* pEvents, int maxEvents, unsigned int timeout )
+{
+	constexpr int cMaxEpollEvents = 256;
+	epoll_event events[ cMaxEpollEvents ];
+	const int count = epoll_wait( m_Epoll, events, std::min( maxEvents, cMaxEpollEvents ), static_cast< int >( timeout ) );
+	for ( int i = 0; i < count; ++i )
+	{
+		pEvents[ i ].data = events[ i ].data.u64;
+		pEvents[ i ].events =
+			( ( events[ i ].events & EPOLLIN ) ? cReadable : 0 ) |
+			( ( events[ i ].events & EPOLLOUT ) ? cWritable : 0 ) |
+			( ( events[ i ].events & ( EPOLLERR | EPOLLHUP ) ) ? cError : 0 );
+	}
+
+	// Interrupted by a signal, which is the same as nothing happening.
+	return std::max( count, 0 );
+}
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+
+#include "poller.h"
+
+namespace Network
+{
+
+static SHORT ToPollEvents( uint32_t events )
+{
+	return ( ( events & Poller::cReadable ) ? POLLRDNORM : 0 ) | ( ( events & Poller::cWritable ) ? POLLWRNORM : 0 );
+}
+
+// Rebuilt on every wait, as WSAPoll() wants the descriptors contiguous.
+static thread_local std::vector< WSAPOLLFD > tDescriptors;
+
+Poller::Poller()
+{
+
+}
+
+Poller::~Poller()
+{
+
+}
+
+bool Poller::IsValid() const
+{
+	return true;
+}
+
+// A socket closed without being removed still has a registration, which is
+// replaced if its handle gets reused.
+bool Poller::Add( TCPSocket socket, uint32_t events, uint64_t data )
+{
+	std::unordered_map< TCPSocket, size_t >::iterator it = m_Indices.find( socket );
+	if ( it != m_Indices.end() )
+	{
+		m_Registrations[ it->second ] = { socket, events, data };
+		return true;
+	}
+
+	m_Indices[ socket ] = m_Registrations.size();
+	m_Registrations.push_back( { socket, events, data } );
+	return true;
+}
+
+bool Poller::Modify( TCPSocket socket, uint32_t events, uint64_t data )
+{
+	std::unordered_map< TCPSocket, size_t >::iterator it = m_Indices.find( socket );
+	if ( it == m_Indices.end() )
+	{
+		return false;
+	}
+
+	m_Registrations[ it->second ].events = events;
+	m_Registrations[ it->second ].data = data;
+	return true;
+}
+
+bool Poller::Remove( TCPSocket socket )
+{
+	std::unordered_map< TCPSocket, size_t >::iterator it = m_Indices.find( socket );
+	if ( it == m_Indices.end() )
+	{
+		return false;
+	}
+
+	const size_t index = it->second;
+	m_Indices.erase( it );
+	if ( index != m_Registrations.size() - 1 )
+	{
+		m_Registrations[ index ] = m_Registrations.back();
+		m_Indices[ m_Registrations[ index ].socket ] = index;
+	}
+	m_Registrations.pop_back();
+	return true;
+}
+
+int Poller::Wait( Event* pEvents, int maxEvents, unsigned int timeout )
+{
+	if ( m_Registrations.empty() )
+	{
+		Sleep( timeout );
+		return 0;
+	}
+
+	tDescriptors.resize( m_Registrations.size() );
+	for ( size_t i = 0; i < m_Registrations.size(); ++i )
+	{
+		tDescriptors[ i ].fd = static_cast< SOCKET >( m_Registrations[ i ].socket );
+		tDescriptors[ i ].events = ToPollEvents( m_Registrations[ i ].events );
+		tDescriptors[ i ].revents = 0;
+	}
+
+	if ( WSAPoll( tDescriptors.data(), static_cast< ULONG >( tDescriptors.size() ), static_cast< INT >( timeout ) ) <= 0 )
+	{
+		return 0;
+	}
+
+	// Sockets which have been closed are dropped, walking backwards so that
+	// removing one doesn't move any which are yet to be looked at.
+	int count = 0;
+	for ( size_t i = tDescriptors.size(); i-- > 0; )
+	{
+		const SHORT revents = tDescriptors[ i ].revents;
+		if ( revents & POLLNVAL )
+		{
+			Remove( m_Registrations[ i ].socket );
+		}
+		else if ( revents != 0 && count < maxEvents )
+		{
+			pEvents[ count ].data = m_Registrations[ i ].data;
+			pEvents[ count ].events =
+				( ( revents & POLLRDNORM ) ? cReadable : 0 ) |
+				( ( revents & POLLWRNORM ) ? cWritable : 0 ) |
+				( ( revents & ( POLLERR | POLLHUP ) ) ? cError : 0 );
+			count++;
+		}
+	}
+	return count;
+}
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <memory>
+#include "resolver.h"
+
+namespace Network
+{
+
+static constexpr std::chrono::seconds cDefaultResolvedTimeToLive( 300 );
+static constexpr std::chrono::seconds cDefaultFailedTimeToLive( 30 );
+
+Resolver::Resolver( unsigned int threadCount, size_t cacheCapacity, Lookup lookup ) :
+m_Lookup( lookup ),
+m_CacheCapacity( cacheCapacity ),
+m_ResolvedTimeToLive( cDefaultResolvedTimeToLive ),
+m_FailedTimeToLive( cDefaultFailedTimeToLive ),
+m_Stop( false ),
+m_CacheHits( 0 ),
+m_CacheMisses( 0 )
+{
+	for ( unsigned int i = 0; i < threadCount; ++i )
+	{
+		m_Threads.emplace_back( &Resolver::ThreadMain, this );
+	}
+}
+
+Resolver::~Resolver()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Stop = true;
+	}
+	m_Condition.notify_all();
+
+	for ( std::thread& thread : m_Threads )
+	{
+		thread.join();
+	}
+
+	// The threads finish the lookups they had started, but hosts still in the queue
+	// would otherwise never be answered, breaking the promise of any future waiting on them.
+	const Resolution resolution{ Result::NotReady, IPAddress() };
+	for ( std::pair< const std::string, std::vector< Callback > >& pending : m_Pending )
+	{
+		for ( Callback& callback : pending.second )
+		{
+			callback( resolution );
+		}
+	}
+	m_Pending.clear();
+	m_Queue.clear();
+}
+
+void Resolver::Resolve( const std::string& host, Callback callback )
+{
+	Resolution resolution;
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		if ( FindInCache( host, resolution ) == false )
+		{
+			std::unordered_map< std::string, std::vector< Callback > >::iterator it = m_Pending.find( host );
+			if ( it == m_Pending.end() )
+			{
+				m_Pending[ host ].push_back( callback );
+				m_Queue.push_back( host );
+				m_Condition.notify_one();
+			}
+			else
+			{
+				it->second.push_back( callback );
+			}
+			return;
+		}
+	}
+
+	callback( resolution );
+}
+
+std::future< Resolver::Resolution > Resolver::Resolve( const std::string& host )
+{
+	// std::function needs something copyable, which a promise isn't.
+	std::shared_ptr< std::promise< Resolution > > pPromise = std::make_shared< std::promise< Resolution > >();
+	std::future< Resolution > future = pPromise->get_future();
+	Resolve( host, [ pPromise ]( const Resolution& resolution ) { pPromise->set_value( resolution ); } );
+	return future;
+}
+
+void Resolver::SetTimeToLive( std::chrono::seconds resolved, std::chrono::seconds failed )
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_ResolvedTimeToLive = resolved;
+	m_FailedTimeToLive = failed;
+}
+
+void Resolver::ClearCache()
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	m_Cache.clear();
+	m_CacheIndex.clear();
+}
+
+size_t Resolver::GetCacheHits() const
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	return m_CacheHits;
+}
+
+size_t Resolver::GetCacheMisses() const
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+	return m_CacheMisses;
+}
+
+void Resolver::ThreadMain( Resolver* pResolver )
+{
+	while ( true )
+	{
+		std::string host;
+		{
+			std::unique_lock< std::mutex > lock( pResolver->m_Mutex );
+			pResolver->m_Condition.wait( lock, [ pResolver ]() { return pResolver->m_Stop || pResolver->m_Queue.empty() == false; } );
+			if ( pResolver->m_Stop )
+			{
+				return;
+			}
+			host = std::move( pResolver->m_Queue.front() );
+			pResolver->m_Queue.pop_front();
+		}
+
+		Resolution resolution;
+		resolution.result = pResolver->m_Lookup( host, resolution.address );
+
+		std::vector< Callback > callbacks;
+		{
+			std::lock_guard< std::mutex > lock( pResolver->m_Mutex );
+			pResolver->AddToCache( host, resolution );
+			std::unordered_map< std::string, std::vector< Callback > >::iterator it = pResolver->m_Pending.find( host );
+			callbacks = std::move( it->second );
+			pResolver->m_Pending.erase( it );
+		}
+
+		for ( Callback& callback : callbacks )
+		{
+			callback( resolution );
+		}
+	}
+}
+
+// Must be called with m_Mutex held.
+bool Resolver::FindInCache( const std::string& host, Resolution& resolution )
+{
+	std::unordered_map< std::string, CacheList::iterator >::iterator it = m_CacheIndex.find( host );
+	if ( it == m_CacheIndex.end() )
+	{
+		m_CacheMisses++;
+		return false;
+	}
+
+	if ( it->second->expiry <= Clock::now() )
+	{
+		m_Cache.erase( it->second );
+		m_CacheIndex.erase( it );
+		m_CacheMisses++;
+		return false;
+	}
+
+	m_Cache.splice( m_Cache.begin(), m_Cache, it->second );
+	resolution = it->second->resolution;
+	m_CacheHits++;
+	return true;
+}
+
+// Must be called with m_Mutex held.
+void Resolver::AddToCache( const std::string& host, const Resolution& resolution )
+{
+	if ( m_CacheCapacity == 0 )
+	{
+		return;
+	}
+
+	const std::chrono::seconds timeToLive = ( resolution.result == Result::Success ) ? m_ResolvedTimeToLive : m_FailedTimeToLive;
+	std::unordered_map< std::string, CacheList::iterator >::iterator it = m_CacheIndex.find( host );
+	if ( it != m_CacheIndex.end() )
+	{
+		m_Cache.erase( it->second );
+		m_CacheIndex.erase( it );
+	}
+	else if ( m_Cache.size() >= m_CacheCapacity )
+	{
+		m_CacheIndex.erase( m_Cache.back().host );
+		m_Cache.pop_back();
+	}
+
+	m_Cache.push_front( CacheEntry{ host, resolution, Clock::now() + timeToLive } );
+	m_CacheIndex[ host ] = m_Cache.begin();
+}
+
+}
@@ -0,0 +1,109 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "network.h"
+
+namespace Network
+{
+
+//-----------------------------------------------------------------------------
+// Resolver
+// Resolves host names on a set of worker threads, so that many lookups can be
+// underway at once without blocking the caller. Answers are cached for a
+// while, failures included, and the least recently used entries are dropped
+// once the cache is full. Requests for a host which is already being looked
+// up wait for that lookup rather than starting another one.
+// The lookup itself is Network::Resolve() unless another one is given, which
+// lets a stub stand in for the system's resolver.
+//-----------------------------------------------------------------------------
+class Resolver
+{
+public:
+	struct Resolution
+	{
+		Result result;
+		IPAddress address;
+	};
+
+	using Callback = std::function< void( const Resolution& resolution ) >;
+	using Lookup = std::function< Result( const std::string& host, IPAddress& address ) >;
+
+	Resolver( unsigned int threadCount = 8, size_t cacheCapacity = 4096, Lookup lookup = &Network::Resolve );
+	~Resolver();
+
+	Resolver( const Resolver& ) = delete;
+	Resolver& operator=( const Resolver& ) = delete;
+
+	// The callback is called on one of the resolver's threads, or straight away
+	// on the caller's if the answer is cached. It must not call Resolve() itself.
+	// Hosts still queued when the resolver is destroyed fail with Result::NotReady.
+	void Resolve( const std::string& host, Callback callback );
+	std::future< Resolution > Resolve( const std::string& host );
+
+	// How long answers stay cached. Lookups which failed are retried sooner.
+	void SetTimeToLive( std::chrono::seconds resolved, std::chrono::seconds failed );
+
+	void ClearCache();
+	size_t GetCacheHits() const;
+	size_t GetCacheMisses() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct CacheEntry
+	{
+		std::string host;
+		Resolution resolution;
+		Clock::time_point expiry;
+	};
+	using CacheList = std::list< CacheEntry >; // The most recently used first.
+
+	static void ThreadMain( Resolver* pResolver );
+	bool FindInCache( const std::string& host, Resolution& resolution );
+	void AddToCache( const std::string& host, const Resolution& resolution );
+
+	Lookup m_Lookup;
+	size_t m_CacheCapacity;
+	std::chrono::seconds m_ResolvedTimeToLive;
+	std::chrono::seconds m_FailedTimeToLive;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Stop;
+	std::deque< std::string > m_Queue;
+	std::unordered_map< std::string, std::vector< Callback > > m_Pending; // Hosts queued or being looked up.
+	CacheList m_Cache;
+	std::unordered_map< std::string, CacheList::iterator > m_CacheIndex;
+	size_t m_CacheHits;
+	size_t m_CacheMisses;
+	std::vector< std::thread > m_Threads;
+};
+
+}
@@ -0,0 +1,116 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include "timerwheel.h"
+
+namespace Network
+{
+
+TimerWheel::TimerWheel( size_t timerCount, unsigned int tickDuration, size_t slotCount ) :
+m_Timers( timerCount, Timer{ 0, cInvalidTimer, cInvalidTimer, false } ),
+m_Slots( slotCount, cInvalidTimer ),
+m_TickDuration( std::max( 1u, tickDuration ) ),
+m_StartTime( Clock::now() ),
+m_CurrentTick( 0 ),
+m_Expiring( cInvalidTimer )
+{
+
+}
+
+void TimerWheel::Schedule( int index, unsigned int timeout )
+{
+	Cancel( index );
+	Timer& timer = m_Timers[ index ];
+
+	// Rounded up from the current time rather than from the start of the current tick,
+	// which would let the timer fire up to a tick early. The elapsed time is truncated,
+	// so the partial millisecond counts as a whole one. Always at least the next tick,
+	// as the current one may already have been expired.
+	const uint64_t elapsed = GetElapsedTime();
+	const uint64_t deadline = ( elapsed + 1 + timeout + m_TickDuration - 1 ) / m_TickDuration;
+	timer.deadline = std::max( deadline, elapsed / m_TickDuration + 1 );
+	timer.scheduled = true;
+	Link( index );
+}
+
+void TimerWheel::Cancel( int index )
+{
+	Timer& timer = m_Timers[ index ];
+	if ( timer.scheduled == false )
+	{
+		return;
+	}
+
+	// The head of a list is either a slot's, or the one being expired.
+	if ( timer.previous != cInvalidTimer )
+	{
+		m_Timers[ timer.previous ].next = timer.next;
+	}
+	else if ( m_Expiring == index )
+	{
+		m_Expiring = timer.next;
+	}
+	else
+	{
+		m_Slots[ timer.deadline % m_Slots.size() ] = timer.next;
+	}
+
+	if ( timer.next != cInvalidTimer )
+	{
+		m_Timers[ timer.next ].previous = timer.previous;
+	}
+
+	timer.previous = cInvalidTimer;
+	timer.next = cInvalidTimer;
+	timer.scheduled = false;
+}
+
+bool TimerWheel::IsScheduled( int index ) const
+{
+	return m_Timers[ index ].scheduled;
+}
+
+unsigned int TimerWheel::GetTickDuration() const
+{
+	return m_TickDuration;
+}
+
+uint64_t TimerWheel::GetElapsedTime() const
+{
+	const auto elapsed = std::chrono::duration_cast< std::chrono::milliseconds >( Clock::now() - m_StartTime );
+	return static_cast< uint64_t >( elapsed.count() );
+}
+
+uint64_t TimerWheel::GetCurrentTick() const
+{
+	return GetElapsedTime() / m_TickDuration;
+}
+
+void TimerWheel::Link( int index )
+{
+	Timer& timer = m_Timers[ index ];
+	int& head = m_Slots[ timer.deadline % m_Slots.size() ];
+	timer.previous = cInvalidTimer;
+	timer.next = head;
+	if ( head != cInvalidTimer )
+	{
+		m_Timers[ head ].previous = index;
+	}
+	head = index;
+}
+
+}
@@ -0,0 +1,126 @@
+// This file is part of watcher.
+//
+// watcher is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// watcher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with watcher. If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Network
+{
+
+//-----------------------------------------------------------------------------
+// TimerWheel
+// Timeouts for a fixed number of timers, identified by their index, such as
+// one per connection a Poller waits on. Each slot holds an intrusive list of
+// the timers whose deadline falls on that slot, modulo the number of slots, so
+// scheduling and cancelling are constant time. Deadlines longer than a full
+// revolution are supported; they're just skipped until due.
+// Deadlines are rounded up to the next tick, and never fire early.
+// Not thread safe.
+//-----------------------------------------------------------------------------
+class TimerWheel
+{
+public:
+	TimerWheel( size_t timerCount, unsigned int tickDuration = 10, size_t slotCount = 1024 );
+
+	// Fires after "timeout" milliseconds, replacing the timer's previous deadline if it had one.
+	void Schedule( int timer, unsigned int timeout );
+	void Cancel( int timer );
+	bool IsScheduled( int timer ) const;
+
+	// In milliseconds. Waiting longer than this between calls to Expire() lets the wheel fall behind.
+	unsigned int GetTickDuration() const;
+
+	// Calls "expired( timer )" for every timer which is due, cancelling it first.
+	// The function is free to schedule or cancel any timer.
+	template< typename F >
+	void Expire( F expired );
+
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr int cInvalidTimer = -1;
+
+	struct Timer
+	{
+		uint64_t deadline; // In ticks.
+		int previous;
+		int next;
+		bool scheduled;
+	};
+
+	uint64_t GetElapsedTime() const; // In milliseconds.
+	uint64_t GetCurrentTick() const;
+	void Link( int timer );
+
+	std::vector< Timer > m_Timers;
+	std::vector< int > m_Slots;
+	unsigned int m_TickDuration;
+	Clock::time_point m_StartTime;
+	uint64_t m_CurrentTick;
+	int m_Expiring; // The timers of the slot being expired which have yet to be looked at.
+};
+
+// Walks every slot between the last processed tick and the current one.
+// If we've fallen more than a full revolution behind, every slot gets visited
+// exactly once instead. Each slot's list is detached before it is walked, so
+// the function can change any timer without the walk losing its place.
+template< typename F >
+void TimerWheel::Expire( F expired )
+{
+	const uint64_t now = GetCurrentTick();
+	if ( now <= m_CurrentTick )
+	{
+		return;
+	}
+
+	const uint64_t slotCount = m_Slots.size();
+	const uint64_t first = ( now - m_CurrentTick > slotCount ) ? now - slotCount + 1 : m_CurrentTick + 1;
+	for ( uint64_t tick = first; tick <= now; ++tick )
+	{
+		int& slot = m_Slots[ tick % slotCount ];
+		m_Expiring = slot;
+		slot = cInvalidTimer;
+
+		while ( m_Expiring != cInvalidTimer )
+		{
+			const int index = m_Expiring;
+			Timer& timer = m_Timers[ index ];
+			m_Expiring = timer.next;
+			if ( m_Expiring != cInvalidTimer )
+			{
+				m_Timers[ m_Expiring ].previous = cInvalidTimer;
+			}
+
+			if ( timer.deadline <= now )
+			{
+				timer.scheduled = false;
+				timer.next = cInvalidTimer;
+				expired( index );
+			}
+			else
+			{
+				Link( index );
+			}
+		}
+	}
+
+	m_CurrentTick = now;
+}
+
+}